@@ -37,6 +37,7 @@ struct DHTXXD_s
    int _bits;
    int _ready;
    int _new_reading;
+   double _trigger_timestamp;
    DHTXXD_data_t _data;
    uint32_t _last_edge_tick;
    int _ignore_reading;
@@ -329,28 +330,46 @@ DHTXXD_data_t DHTXXD_data(DHTXXD_t *self)
 void DHTXXD_manual_read(DHTXXD_t *self)
 {
    int i;
-   double timestamp;
 
-   self->_new_reading = 0;
-   _trigger(self);
-   timestamp = time_time();
+   DHTXXD_manual_trigger(self);
 
    /* timeout if no new reading */
 
    for (i=0; i<5; i++) /* 0.25 seconds */
    {
       time_sleep(0.05);
-      if (self->_new_reading) break;
+      if (DHTXXD_manual_done(self, 0)) return;
    }
 
-   if (!self->_new_reading)
-   {
-      self->_data.timestamp = timestamp;
-      self->_data.status = DHT_TIMEOUT;
-      self->_ready = 1;
+   DHTXXD_manual_done(self, 1);
+}
 
-      if (self->cb) (self->cb)(self->_data);
-   }
+void DHTXXD_manual_trigger(DHTXXD_t *self)
+{
+   /*
+   Triggers a single reading without waiting for it.
+   */
+   self->_new_reading = 0;
+   _trigger(self);
+   self->_trigger_timestamp = time_time();
+}
+
+int DHTXXD_manual_done(DHTXXD_t *self, int timed_out)
+{
+   /*
+   Returns True if the reading triggered last has arrived or,
+   if timed_out, has been recorded as a timeout.
+   */
+   if (self->_new_reading) return 1;
+   if (!timed_out) return 0;
+
+   self->_data.timestamp = self->_trigger_timestamp;
+   self->_data.status = DHT_TIMEOUT;
+   self->_ready = 1;
+
+   if (self->cb) (self->cb)(self->_data);
+
+   return 1;
 }
 
 void DHTXXD_auto_read(DHTXXD_t *self, float seconds)
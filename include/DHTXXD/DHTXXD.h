@@ -47,6 +47,11 @@ called to check for new data which may then be retrieved by
 a call to DHTXXD_data.
 
 A single reading may be triggered with DHTXXD_manual_read.
+It blocks for up to 0.25 seconds.  To wait elsewhere, e.g.
+in an event loop, trigger the reading with
+DHTXXD_manual_trigger and then call DHTXXD_manual_done
+every 0.05 seconds or so until it returns True, with
+timed_out set once 0.25 seconds have passed.
 
 A reading may be triggered at regular intervals using
 DHTXXD_auto_read.  If the auto trigger interval is 30
@@ -73,6 +78,10 @@ DHTXXD_data_t DHTXXD_data        (DHTXXD_t *self);
 
 void          DHTXXD_manual_read (DHTXXD_t *self);
 
+void          DHTXXD_manual_trigger(DHTXXD_t *self);
+
+int           DHTXXD_manual_done (DHTXXD_t *self, int timed_out);
+
 void          DHTXXD_auto_read   (DHTXXD_t *self, float seconds);
 
 #endif
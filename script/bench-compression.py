@@ -0,0 +1,282 @@
+"""Compression benchmark for the data files of the `sensor-logging` project.
+
+See usage message for further documentation.
+"""
+
+import argparse
+import os
+import sys
+import socket
+import platform
+import subprocess
+import tempfile
+import hashlib
+import collections
+import json
+import time
+import re
+import io
+import tarfile
+import lzma
+
+# Parse arguments
+argparser = argparse.ArgumentParser(
+  description = "Measures compression ratio, compression and decompression "
+    "throughput and peak memory usage for a matrix of codecs and settings on "
+    "a directory of `shortly` data files, e.g. `data/shortly/<hostname>`. The "
+    "matrix covers xz presets, the settings of `daily.py`, the xz delta "
+    "filter, a column-wise (transposed) layout of the files and, if a "
+    "`sensor-logging` binary is given, its native column codec. Results are "
+    "written as JSON lines, one object per configuration, preceded by one "
+    "object describing the environment and the input.",
+  epilog = "Each configuration is measured in a forked child process, whose "
+    "peak resident set size is reported. Since the child inherits the input "
+    "data from this process, compare against the `peak_rss_in_kib` of the "
+    "environment object, which is measured with a child doing nothing.")
+argparser.add_argument("--binary",
+  metavar = "<path>",
+  help = "the `sensor-logging` binary whose `codec` mode to benchmark (the "
+    "native codec is skipped if omitted)")
+argparser.add_argument("--presets",
+  default = "0,3,6,9,9e",
+  metavar = "<list>",
+  help = "comma-separated xz presets to try, with an `e` suffix for extreme "
+    "(default: 0,3,6,9,9e)")
+argparser.add_argument("--repeats",
+  type = int,
+  default = 3,
+  metavar = "<n>",
+  help = "number of repetitions to average timings over (default: 3)")
+argparser.add_argument("--output",
+  default = "-",
+  metavar = "<path>",
+  help = "where to write the JSON lines (default: `-`, i.e. stdout)")
+argparser.add_argument("--file-extension",
+  default = "csv",
+  metavar = "<extension>",
+  help = "the file extension (case-sensitive, without dot) of the data files "
+    "(default: csv)")
+argparser.add_argument("directory",
+  help = "the directory containing the data files")
+
+args = argparser.parse_args()
+
+# NOTE: Has to be kept in sync with the settings in `daily.py`.
+filters_daily = [{
+  "id": lzma.FILTER_LZMA2,
+  "dict_size": 16777216,
+  "lc": 4,
+  "lp": 0,
+  "pb": 0,
+  "mf": lzma.MF_HC4,
+  "mode": lzma.MODE_NORMAL,
+  "nice_len": 273,
+  "depth": 200}]
+
+# Only per-run, per-sensor files, as the native codec does not handle segment
+# files
+pattern = re.compile("[0-9]{4}-[0-9]{2}-[0-9]{2}-[0-9]{2}-[0-9]{2}-[0-9]{2}Z-"
+  f"(.*)\\.{re.escape(args.file_extension)}")
+
+# Input layouts
+# NOTE: All of these are tar archives, like the ones `daily.py` writes, so that
+# the sizes are comparable.
+def as_tar(members):
+  buffer = io.BytesIO()
+  with tarfile.open(None, "w", buffer, format = tarfile.GNU_FORMAT) as tar:
+    for (name, data) in members:
+      info = tarfile.TarInfo(name)
+      info.size = len(data)
+      tar.addfile(info, io.BytesIO(data))
+  return buffer.getvalue()
+
+def transposed(data):
+  """Writes a CSV file column by column instead of row by row.
+
+  Each column's fields go on one line each, columns are separated by an empty
+  line. This is reversible as long as no field contains a newline.
+  """
+  lines = data.split(b"\n")
+  header, rows = lines[0], [line.split(b", ") for line in lines[1:] if line]
+  return header + b"\n" + b"\n\n".join(b"\n".join(row[j] for row in rows
+    if j < len(row)) for j in range(max(map(len, rows), default = 0))) + b"\n"
+
+def most_common_line_length(members):
+  counter = collections.Counter(len(line) + 1 for (_, data) in members
+    for line in data.split(b"\n")[1:] if line)
+  return counter.most_common(1)[0][0] if counter else 1
+
+# Measurements
+def measure_in_child(f):
+  """Runs `f` in a forked child and returns its result and peak RSS in KiB."""
+  r, w = os.pipe()
+  pid = os.fork()
+  if pid == 0:
+    os.close(r)
+    try:
+      result = f()
+    except Exception as e:
+      result = {"error": repr(e)}
+    with os.fdopen(w, "w") as g:
+      json.dump(result, g)
+    os._exit(0)
+  os.close(w)
+  with os.fdopen(r) as g:
+    result = json.loads(g.read() or "{}")
+  _, _, rusage = os.wait4(pid, 0)
+  result["peak_rss_in_kib"] = rusage.ru_maxrss
+  return result
+
+def measure_xz(data, filters):
+  def f():
+    tic = time.perf_counter()
+    for _ in range(args.repeats):
+      compressed = lzma.compress(data, lzma.FORMAT_XZ, lzma.CHECK_CRC64,
+        None, filters)
+    duration_compress = (time.perf_counter() - tic) / args.repeats
+    tic = time.perf_counter()
+    for _ in range(args.repeats):
+      decompressed = lzma.decompress(compressed, lzma.FORMAT_XZ)
+    duration_decompress = (time.perf_counter() - tic) / args.repeats
+    return {
+      "size_compressed_in_bytes": len(compressed),
+      "round_trip_okay": decompressed == data,
+      "duration_compress_in_seconds": duration_compress,
+      "duration_decompress_in_seconds": duration_decompress}
+  return measure_in_child(f)
+
+def measure_native(filepaths, encoded_filepath):
+  """Runs the `codec` mode of the binary and returns its report."""
+  process = subprocess.Popen([args.binary, "codec", "--no-xz",
+    f"--repeats={args.repeats}", f"--write-encoded={encoded_filepath}",
+    "--", *filepaths], stdout = subprocess.PIPE, stderr = subprocess.DEVNULL,
+    text = True)
+  output = process.stdout.read()
+  # NOTE: Waiting manually instead of via `process.wait`, to get the resource
+  # usage of the child.
+  _, status, rusage = os.wait4(process.pid, 0)
+  process.returncode = os.waitstatus_to_exitcode(status)
+  # The report is flat TOML, so it can be parsed without a TOML library
+  report = {}
+  for line in output.splitlines():
+    if "=" in line:
+      k, v = (s.strip() for s in line.split("=", 1))
+      report[k] = json.loads(v)
+  report["exit_code"] = process.returncode
+  report["peak_rss_in_kib"] = rusage.ru_maxrss
+  return report
+
+def presets_filters(preset):
+  extreme = preset.endswith("e")
+  return [{"id": lzma.FILTER_LZMA2,
+    "preset": int(preset.rstrip("e")) | (lzma.PRESET_EXTREME if extreme else 0)
+  }]
+
+def benchmark(output):
+  def write(record):
+    output.write(json.dumps(record) + "\n")
+    output.flush()
+
+  # Gather input, sorted by name as in `daily.py`
+  matches = sorted((item.name, pattern.fullmatch(item.name).group(1))
+    for item in os.scandir(args.directory)
+    if item.is_file() and pattern.fullmatch(item.name))
+  members = []
+  for (basename, _) in matches:
+    with open(os.path.join(args.directory, basename), "rb") as g:
+      members.append((basename, g.read()))
+  if not members:
+    sys.exit(f"{sys.argv[0]}: ERROR: no data files in `{args.directory}`.")
+  size_csv = sum(len(data) for (_, data) in members)
+  digest = hashlib.sha256()
+  for (basename, data) in members:
+    digest.update(basename.encode() + b"\0" + data)
+
+  environment = {
+    "kind": "environment",
+    "hostname": socket.gethostname(),
+    "machine": platform.machine(),
+    "python": sys.version,
+    "directory": os.path.abspath(args.directory),
+    "number_files": len(members),
+    "size_csv_in_bytes": size_csv,
+    "input_sha256": digest.hexdigest(),
+    "repeats": args.repeats}
+  environment.update(measure_in_child(lambda: {}))
+  write(environment)
+
+  by_sensor = sorted(members,
+    key = lambda m: (pattern.fullmatch(m[0]).group(1), m[0]))
+  layouts = {
+    "files": as_tar(members),
+    "by_sensor": as_tar(by_sensor),
+    "transposed": as_tar([(name, transposed(data)) for (name, data)
+      in members])}
+  # NOTE: The delta filter only makes sense if equal fields of consecutive
+  # rows are at a fixed distance, i.e. for rows of fixed width. Files of the
+  # same sensor type have the same width, so the `by_sensor` layout should
+  # fare best with it.
+  delta_distance = min(256, most_common_line_length(members))
+
+  chains = {"daily": filters_daily}
+  chains.update({f"preset_{preset}": presets_filters(preset)
+    for preset in args.presets.split(",") if preset})
+  chains["delta_daily"] = [{"id": lzma.FILTER_DELTA,
+    "dist": delta_distance}] + filters_daily
+
+  # NOTE: Ratios and throughputs are relative to the size of the CSV files
+  # that went into the result, which for the native codec excludes the files
+  # it skipped.
+  def record(layout, chain, size_input, result, size_original = size_csv):
+    r = {"kind": "result", "layout": layout, "codec": chain,
+      "size_input_in_bytes": size_input}
+    r.update(result)
+    if not size_original:
+      return r
+    if r.get("size_compressed_in_bytes"):
+      r["ratio"] = size_original / r["size_compressed_in_bytes"]
+    for direction in ["compress", "decompress"]:
+      duration = r.get(f"duration_{direction}_in_seconds")
+      if duration:
+        r[f"throughput_{direction}_in_mib_per_second"] = \
+          size_original / duration / 2**20
+    return r
+
+  for (layout, data) in layouts.items():
+    for (chain, filters) in chains.items():
+      if chain == "delta_daily" and layout == "transposed":
+        continue
+      write(record(layout, chain, len(data), measure_xz(data, filters)))
+
+  if args.binary is not None:
+    with tempfile.TemporaryDirectory() as tmp:
+      encoded_filepath = os.path.join(tmp, "encoded")
+      report = measure_native(
+        [os.path.join(args.directory, basename) for (basename, _) in matches],
+        encoded_filepath)
+      size_native = report.get("size_csv_in_bytes")
+      write(record("native", "native", size_native, {
+        "size_compressed_in_bytes": report.get("size_codec_in_bytes"),
+        "round_trip_okay": report.get("round_trip_okay"),
+        "number_files_skipped": report.get("number_files_skipped"),
+        "duration_compress_in_seconds":
+          report.get("duration_encode_in_seconds"),
+        "duration_decompress_in_seconds":
+          report.get("duration_decode_in_seconds"),
+        "exit_code": report.get("exit_code"),
+        "peak_rss_in_kib": report.get("peak_rss_in_kib")}, size_native))
+      if report.get("exit_code") == 0:
+        with open(encoded_filepath, "rb") as g:
+          encoded = g.read()
+        # NOTE: The timings of these include only the xz part, as the native
+        # codec has been measured above.
+        for (chain, filters) in chains.items():
+          if chain != "delta_daily":
+            write(record("native", chain, len(encoded),
+              measure_xz(encoded, filters), size_native))
+
+if args.output == "-":
+  benchmark(sys.stdout)
+else:
+  with open(args.output, "w", encoding = "utf-8") as output:
+    benchmark(output)
@@ -98,6 +98,11 @@ def load_and_expand_jsons():
       for field_name, field_params in sensor.items():
         if not "aggregate" in field_params:
           field_params["aggregate"] = "first"
+        # NOTE: Switches rarely change, so they are logged change-only with
+        # `shortly --deadband`.
+        if type_identifier == "state" and field_params["type"] == "bool" and \
+            not "deadband" in field_params:
+          field_params["deadband"] = 0
       sensors[f'control_{type_identifier}_{host_identifier}'] = sensor
 
   return sensors, control_structs
@@ -106,8 +111,8 @@ def generated_cpp_file_path(name):
   return os.path.join(os.path.dirname(__file__), "..", "src",
     f"{name}.generated.cpp")
 
-def write_generated_cpp_file(name, str):
-  with open(generated_cpp_file_path(name), "w") as f:
+def write_generated_cpp_file(name, str, path = None):
+  with open(path or generated_cpp_file_path(name), "w") as f:
     f.write(str)
 
   # print(string, end = "")
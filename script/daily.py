@@ -27,6 +27,8 @@ import re
 import textwrap
 import tarfile
 import lzma
+import struct
+import calendar
 
 localhostname = socket.gethostname()
 env_keys = ["command", "file_extension", "hostname", "base_path", "names"]
@@ -228,6 +230,195 @@ relpaths = [
   os.path.join("data", "daily"),
   os.path.join("logs", "daily")]
 
+# Archive helpers
+# NOTE: `shortly --archive` appends each finished run to a partial archive
+# `<date>.tar.xz.part` as a separate xz stream of tar members, leaving out the
+# tar end-of-archive marker. A sequence of xz streams is a valid xz file, so
+# the functions below can simply append more streams to it. Archives built from
+# scratch get the same layout, i.e. one xz stream per run.
+#
+# Finalizing an archive appends one last stream with an index member and the
+# end-of-archive marker. For each member, the index lists the time range it
+# covers (in seconds since epoch) and the byte range of the xz stream holding
+# it. That way, readers can locate the index from the end of the file and then
+# decompress only the streams they need (see `archive::read_index` in
+# `shortly`).
+run_pattern = re.compile(
+  "([0-9]{4}-[0-9]{2}-[0-9]{2}-[0-9]{2}-[0-9]{2}-[0-9]{2}Z)-(.*)")
+segment_chunk_pattern = re.compile(
+  "([0-9]{4}-[0-9]{2}-[0-9]{2})-[0-9]{2}-[0-9]{2}-[0-9]{2}Z-segment\\.(.*)")
+run_time_format = "%Y-%m-%d-%H-%M-%SZ"
+# NOTE: Has to be kept in sync with `cc::basename_file_archive_index`.
+index_basename = "index.csv"
+
+def append_stream(archive_filepath, members, p, end_of_archive = False):
+  """Appends `(name, data, mtime)` members as tar members in a new xz stream.
+
+  The end-of-archive marker is only written if `end_of_archive` is set.
+  """
+  with lzma.open(archive_filepath, "ab", **p["lzma_args"]) as xz:
+    for (name, data, mtime) in members:
+      info = tarfile.TarInfo(name)
+      info.size = len(data)
+      info.mtime = mtime
+      info.mode = 0o644
+      xz.write(info.tobuf(p["tar_args"]["format"], tarfile.ENCODING,
+        "surrogateescape"))
+      xz.write(data)
+      xz.write(tarfile.NUL * (-len(data) % tarfile.BLOCKSIZE))
+    if end_of_archive:
+      xz.write(tarfile.NUL * (2 * tarfile.BLOCKSIZE))
+
+def file_member(filepath, basename):
+  with open(filepath, "rb") as g:
+    data = g.read()
+  return (basename, data, int(os.stat(filepath).st_mtime))
+
+def segment_chunks(filepath, basename, index_filepath):
+  """Splits a segment file into its runs' chunks, along its index file.
+
+  The chunks are named like the ones `shortly --archive --segment` writes.
+  Returns `None` if the index does not describe the segment file fully.
+  """
+  with open(filepath, "rb") as g:
+    data = g.read()
+  with open(index_filepath, "rb") as g:
+    index = g.read()
+  # NOTE: Format of `segment::index_entry`; a trailing partial entry is ignored,
+  # as `segment::append_index_entry` cuts it off before appending to the index.
+  entries = list(struct.iter_unpack("<qQ",
+    index[:len(index) - len(index) % 16]))
+  offsets = [offset for (_, offset) in entries] + [len(data)]
+  if (not bool(entries) or offsets[0] != 0 or
+      any(o0 > o1 for (o0, o1) in zip(offsets, offsets[1:]))):
+    return None
+  # The run start in milliseconds is the same time point that `shortly` uses
+  # for the file name prefix.
+  starts = [timestamp // 1000 for (timestamp, _) in entries]
+  mtimes = starts[1:] + [int(os.stat(filepath).st_mtime)]
+  suffix = basename[len("YYYY-MM-DD"):]
+  return [(time.strftime(run_time_format, time.gmtime(start)) + suffix,
+      data[o0:o1], mtime)
+    for (start, o0, o1, mtime) in zip(starts, offsets, offsets[1:], mtimes)]
+
+def run_streams(filepaths, basenames, p):
+  """Groups the files' contents into one list of members per run, in order.
+
+  Segment files are split into chunks if possible. Files that do not belong to
+  a single run get a stream of their own.
+  """
+  paths = dict(zip(basenames, filepaths))
+  streams = {}
+  for (filepath, basename) in zip(filepaths, basenames):
+    members = None
+    if basename.endswith("-segment." + p["file_extension"]) and \
+        basename + ".idx" in paths:
+      members = segment_chunks(filepath, basename, paths[basename + ".idx"])
+    if members is None:
+      members = [file_member(filepath, basename)]
+    for member in members:
+      m = run_pattern.fullmatch(member[0])
+      streams.setdefault(m.group(1) if m else member[0], []).append(member)
+  return [sorted(streams[key]) for key in sorted(streams)]
+
+def time_begin(name, mtime):
+  """Start of the time range covered by a member, derived from its name."""
+  m = run_pattern.fullmatch(name)
+  try:
+    return calendar.timegm(time.strptime(m.group(1), run_time_format) if m
+      else time.strptime(name[:len("YYYY-MM-DD")], "%Y-%m-%d"))
+  except ValueError:
+    return mtime
+
+def index_archive(archive_filepath):
+  """Lists `(name, time_begin, time_end, offset, size)` for all members.
+
+  `offset` and `size` refer to the xz stream holding the member. The end of
+  the time range is the member's modification time.
+  """
+  with open(archive_filepath, "rb") as g:
+    data = g.read()
+  entries, offset = [], 0
+  while offset < len(data):
+    decompressor = lzma.LZMADecompressor(lzma.FORMAT_XZ)
+    position, tar = offset, b""
+    while not decompressor.eof:
+      chunk = data[position:position + 65536]
+      if not bool(chunk):
+        raise ValueError(f"truncated xz stream at byte {offset}")
+      position += len(chunk)
+      tar += decompressor.decompress(chunk)
+    size = position - len(decompressor.unused_data) - offset
+    position = 0
+    while position + tarfile.BLOCKSIZE <= len(tar):
+      block = tar[position:position + tarfile.BLOCKSIZE]
+      if block == tarfile.NUL * tarfile.BLOCKSIZE:
+        break
+      info = tarfile.TarInfo.frombuf(block, tarfile.ENCODING,
+        "surrogateescape")
+      begin = time_begin(info.name, info.mtime)
+      entries.append((info.name, begin, max(begin, info.mtime), offset, size))
+      position += tarfile.BLOCKSIZE + \
+        -(-info.size // tarfile.BLOCKSIZE) * tarfile.BLOCKSIZE
+    offset += size
+  return entries
+
+def finalize_archive(archive_filepath, p):
+  """Appends the index and the end-of-archive marker in a last xz stream.
+
+  Returns the number of indexed members.
+  """
+  entries = index_archive(archive_filepath)
+  index = '"name", "time_begin", "time_end", "offset", "size"\n' + "".join(
+    f'"{name}", {begin}, {end}, {offset}, {size}\n'
+    for (name, begin, end, offset, size) in entries)
+  append_stream(archive_filepath,
+    [(index_basename, index.encode(), int(time.time()))], p, True)
+  return len(entries)
+
+def scan_archive(archive_filepath, filepaths, basenames):
+  """Determines which files are reproduced exactly by the archive.
+
+  A file counts as reproduced if there is a member of the same name with the
+  same content, or, in the case of a segment file, if the run chunks archived
+  by `shortly --archive --segment` add up to its content, in order.
+
+  Returns the set of reproduced basenames, the set of basenames of segment
+  files that are covered only partially, and the names of all members.
+  """
+  paths = dict(zip(basenames, filepaths))
+  reproduced, positions, names = set(), {}, []
+  with lzma.open(archive_filepath, "rb") as xz:
+    # NOTE: Stream mode, as the archive is read once from start to end anyway.
+    # A missing end-of-archive marker just ends the iteration.
+    with tarfile.open(None, "r|", xz) as tar:
+      for info in tar:
+        name = os.path.normpath(info.name)
+        names.append(name)
+        if not info.isfile():
+          continue
+        data = tar.extractfile(info).read()
+        if name in paths:
+          with open(paths[name], "rb") as g:
+            if g.read() == data:
+              reproduced.add(name)
+          continue
+        m = segment_chunk_pattern.fullmatch(name)
+        segment_basename = m and f"{m.group(1)}-segment.{m.group(2)}"
+        if segment_basename in paths and segment_basename not in reproduced:
+          position = positions.get(segment_basename, 0)
+          with open(paths[segment_basename], "rb") as g:
+            g.seek(position)
+            okay = g.read(len(data)) == data
+          positions[segment_basename] = position + len(data) if okay else -1
+  partial = set()
+  for (segment_basename, position) in positions.items():
+    if position == os.stat(paths[segment_basename]).st_size:
+      reproduced.add(segment_basename)
+    else:
+      partial.add(segment_basename)
+  return reproduced, partial, names
+
 # "Body" of the script
 # NOTE: Putting this into a function mainly to easily abstract over file
 # descriptors with optional usage of `with` … `as` using a recursive call. Also
@@ -305,9 +496,15 @@ def daily(p, f = None, time_point_startup = time.gmtime(), pathss = None,
       as_toml(filter, 3) for filter in p["lzma_args"]["filters"]]))
 
   # Prepare pattern matcher
-  pattern = ("([0-9]{4})-([0-9]{2})-([0-9]{2})-([0-9]{2})-([0-9]{2})-([0-9]{2}"
-    f")Z-({'|'.join(p['sensors_physical_instance_names'])})."
-    f"{p['file_extension']}")
+  # NOTE: Besides the per-run-per-sensor files, this matches the raw sample
+  # streams written by `shortly --raw` and the per-day segment files written by
+  # `shortly --segment` along with their index files. The literals have to be
+  # kept in sync with `cc::extension_file_raw`,
+  # `cc::basename_suffix_file_segment` and `cc::extension_file_segment_index`.
+  pattern = ("([0-9]{4})-([0-9]{2})-([0-9]{2})-(?:[0-9]{2}-[0-9]{2}-[0-9]{2}"
+    f"Z-(?:{'|'.join(p['sensors_physical_instance_names'])})\\."
+    f"(?:{p['file_extension']}|raw)|"
+    f"segment\\.{p['file_extension']}(?:\\.idx)?)")
   cp = re.compile(pattern)
 
   # Calculate threshold date
@@ -368,14 +565,46 @@ def daily(p, f = None, time_point_startup = time.gmtime(), pathss = None,
       archive_basename = archive_basename_replacement
 
     archive_filepath = os.path.join(data_daily_host_path, archive_basename)
+    archive_part_filepath = os.path.join(data_daily_host_path,
+      date.isoformat() + ".tar.xz.part")
+
+    # If there is a partial archive written incrementally by `shortly
+    # --archive`, only finalize it. Fall back to building the archive from
+    # scratch if it can not be read or does not cover a segment file fully.
+    incremental = os.path.isfile(archive_part_filepath)
+    if incremental and not p["dry_run"]:
+      try:
+        reproduced, partial, _ = scan_archive(archive_part_filepath,
+          filepaths, basenames)
+        if bool(partial):
+          raise ValueError(f"segment files {sorted(partial)} are archived "
+            "only partially")
+      except Exception as e:
+        f.write("\n" +
+          indent(f"# NOTE: Existence of this entry implies the partial "
+            "archive could not be used.\n", 2) +
+          as_toml({"error_archive_part": e}, 2))
+        incremental = False
+    f.write(as_toml({"archive_incremental": incremental}, 2))
 
     if not p["dry_run"]:
       try:
         tic = time.time()
-        with lzma.open(archive_filepath, "wb", **p["lzma_args"]) as xz:
-          with tarfile.open(None, "w", xz, **p["tar_args"]) as tar:
-            for (filepath, basename) in zip(filepaths, basenames):
-              tar.add(filepath, arcname = basename)
+        if incremental:
+          missing = [(filepath, basename)
+            for (filepath, basename) in zip(filepaths, basenames)
+            if not basename in reproduced]
+          if bool(missing):
+            append_stream(archive_part_filepath,
+              [file_member(*m) for m in missing], p)
+          number_indexed_members = finalize_archive(archive_part_filepath, p)
+          os.rename(archive_part_filepath, archive_filepath)
+          f.write(as_toml({"number_appended_files": len(missing)}, 2))
+        else:
+          for members in run_streams(filepaths, basenames, p):
+            append_stream(archive_filepath, members, p)
+          number_indexed_members = finalize_archive(archive_filepath, p)
+        f.write(as_toml({"number_indexed_members": number_indexed_members}, 2))
         toc = time.time()
       except Exception as e:
         f.write("\n" +
@@ -387,17 +616,12 @@ def daily(p, f = None, time_point_startup = time.gmtime(), pathss = None,
           as_toml({"duration_archive_writing_in_seconds": toc - tic}, 2))
         try:
           tic = time.time()
-          with lzma.open(archive_filepath, "rb") as xz:
-            with tarfile.open(None, "r", xz) as tar:
-              # NOTE: `tar.getnames` returns a list of the paths of the
-              # archived files (in the order they are stored in the archive)
-              # relative to the archive root. I don't know if an entry
-              # prefixed with a `./` can happen. Probably not, but let me
-              # still call normpath to be sure.
-              archived_filepaths = tar.getnames()
-              archive_okay = all(basename == os.path.normpath(filepath)
-                for (basename, filepath)
-                in zip(basenames, archived_filepaths))
+          # NOTE: This compares contents instead of only names, because
+          # incrementally written archives store segment files as chunks and
+          # may have members in a different order.
+          reproduced, _, archived_filepaths = scan_archive(archive_filepath,
+            filepaths, basenames)
+          archive_okay = len(reproduced) == len(basenames)
           archive_size_in_bytes = os.stat(archive_filepath).st_size
           toc = time.time()
         except Exception as e:
@@ -422,6 +646,9 @@ def daily(p, f = None, time_point_startup = time.gmtime(), pathss = None,
                   # print(f"os.remove(\"{filepath}\")")
                   os.remove(filepath)
                   pass
+                # A partial archive that could not be used is obsolete now
+                if os.path.isfile(archive_part_filepath):
+                  os.remove(archive_part_filepath)
                 toc = time.time()
               except Exception as e:
                 f.write("\n" +
@@ -147,7 +147,7 @@ def snippet_update_from_lpd433(host_identifier, host_structs):
     if (not lpd433_receiver_opt.has_value()) return {{}};
 
     auto const &lpd433_receiver{{lpd433_receiver_opt.value()}};
-    bool const lpd433_receiver_ready{{_433D_rx_ready(lpd433_receiver) != 0}};
+    auto const lpd433_data_opt{{io::lpd433_receive(lpd433_receiver)}};
 
     '''))
 
@@ -161,9 +161,9 @@ def snippet_update_from_lpd433(host_identifier, host_structs):
       '''))
 
   str += indent(dedent(f'''\
-    if (lpd433_receiver_ready) {{
-      _433D_rx_data_t data;
-      _433D_rx_data(lpd433_receiver, &data);
+    if (lpd433_data_opt.has_value()) {{
+      auto const &data{{lpd433_data_opt.value()}};
+      metrics::lpd433_codes_received.add();
 
     '''), 1)
 
@@ -401,6 +401,34 @@ def snippet_threshold_controller_tick(host_identifier, host_structs):
       f'set_{target}(pi, succ, params, update_{target}.value());\n', 2)
   return str + f'}}\n'
 
+# Calls `f` with the physical instance name of each sensor providing a variable
+# that is within `cc::adaptive_threshold_proximity` threshold gaps of one of its
+# thresholds, so that `shortly --adaptive` samples it as fast as possible
+def snippet_for_each_sensor_near_threshold(host_identifier, host_structs):
+  physical_names = {
+    sensor_input["sensor_physical_instance_name"] + "_" + sensor_input["name"]:
+      sensor_input["sensor_physical_instance_name"]
+    for sensor_input in host_structs["sensor_inputs"]}
+  threshold_specs = [threshold_spec
+    for threshold_spec in host_structs["thresholds"]
+    if threshold_spec["variable"] in physical_names]
+  # NOTE: Parameters are left unnamed if unused, to avoid warnings.
+  names = ["state", "params", "f"] if threshold_specs else ["", "", ""]
+  str = f'void for_each_sensor_near_threshold(\n'
+  str += indent(f'control_state_{host_identifier} const &{names[0]},\n'
+    f'control_params_{host_identifier} const &{names[1]},\n'
+    f'auto const &{names[2]}) {{\n', 2)
+  for threshold_spec in threshold_specs:
+    target, variable = threshold_spec["target"], threshold_spec["variable"]
+    target_by_variable = f'{target}_by_{variable}'
+    str += indent(f'if (std::abs(state.{variable} -\n')
+    str += indent(f'params.{target_by_variable}_threshold) <=\n', 3)
+    str += indent(f'cc::adaptive_threshold_proximity *\n', 2)
+    str += indent(f'params.{target_by_variable}_threshold_gap)\n', 3)
+    str += indent(f'f(std::string_view{{"{physical_names[variable]}"}});\n',
+      2)
+  return str + f'}}\n'
+
 def snippet_maker_type_conditionals(control_structs, name, default):
   str = default
   for host_identifier, _ in reversed(control_structs.items()):
@@ -491,7 +519,8 @@ def control_cpp_include(control_structs, sensors):
       snippet_lpd433_control_variable_parse_per_host,
       snippet_update_from_lpd433, snippet_update_from_sensors,
       snippet_set_lpd433_control_variable_per_host,
-      snippet_threshold_controller_tick]:
+      snippet_threshold_controller_tick,
+      snippet_for_each_sensor_near_threshold]:
     for host_identifier, host_structs in control_structs.items():
       str += indent(snippet(host_identifier, host_structs) + sep)
 
@@ -1,16 +1,30 @@
 import socket
+import sys
 
 from common import indent, write_generated_cpp_file, header_sep
 
+def arg_value(name):
+  for arg in sys.argv[1:]:
+    if arg.startswith(f"--{name}="):
+      return arg[len(f"--{name}="):]
+  return None
+
+# NOTE: `--hostname=<name>` overrides the hostname, for builds that simulate
+# the sensors of another host.
+def hostname():
+  return arg_value("hostname") or socket.gethostname()
+
 def machine_include():
   str, sep = header_sep(__file__)
 
   str += sep + f'namespace cc {{\n' + sep
 
   str += indent(f'std::string_view constexpr ' +
-    f'hostname{{"{socket.gethostname()}"}};\n' + sep)
+    f'hostname{{"{hostname()}"}};\n' + sep)
 
   return str + f'}} // namespace cc\n'
 
-write_generated_cpp_file("machine", machine_include())
+# NOTE: `--output=<path>` writes the file there instead of into `src/`, as the
+# build does, since the file differs between build directories.
+write_generated_cpp_file("machine", machine_include(), arg_value("output"))
 
@@ -1,6 +1,184 @@
 from common import (indent, write_generated_cpp_file, header_sep,
   load_and_expand_jsons, dedent)
 
+# Statistics beyond the `aggregate` of a field, listed in its `statistics` key.
+# Each becomes an extra field `<field>_<statistic>` of the sensor, which is
+# missing in samples and filled in aggregates from its own `_state` member:
+#   `n_samples`: number of samples present
+#   `variance`, `stddev`: sample variance and standard deviation (Welford)
+#   `median`: exact median, missing in aggregates of more than
+#     `median_capacity` (default: 64) samples
+#   `p<nn>`, e.g. `p90`: <nn>th percentile, estimated in constant memory (P²)
+# NOTE: The extra fields go after all others, so that code constructing
+# samples by position is not affected.
+median_capacity_default = 64
+
+def expand_statistics(sensors):
+  for sensor_name, sensor_params in sensors.items():
+    extra_params = {}
+    for field_name, field_params in sensor_params.items():
+      for statistic in field_params.get("statistics", []):
+        if statistic == "n_samples":
+          params = {"type": "int", "width": 3}
+        elif statistic in ["variance", "stddev", "median"] or (
+            statistic[:1] == "p" and statistic[1:].isdigit()
+            and 0 < int(statistic[1:]) < 100):
+          params = {key: field_params[key] for key in ["width", "decimals"]
+            if key in field_params}
+          params["type"] = "float"
+        else:
+          raise ValueError(f'Unknown statistic `{statistic}` of field '
+            f'`{sensor_name}.{field_name}`')
+        params["aggregate"] = statistic
+        params["source"] = field_name
+        if statistic == "median":
+          params["median_capacity"] = field_params.get(
+            "median_capacity", median_capacity_default)
+        extra_params[f'{field_name}_{statistic}'] = params
+    sensor_params.update(extra_params)
+  return sensors
+
+# Fields with a `filter` key get their implausible values removed right after
+# sampling (see `filter.cpp`), by a Hampel filter if `window` and `threshold`
+# are given (with an optional `min_deviation`) and by a rate-of-change limit
+# if `max_rate` (per second) is given. Each such field gets an extra field
+# `<field>_n_rejected`, which is 1 in samples whose value was rejected, 0 in
+# samples whose value was accepted, and summed up in aggregates.
+def expand_filters(sensors):
+  for sensor_name, sensor_params in sensors.items():
+    extra_params = {}
+    for field_name, field_params in sensor_params.items():
+      if "filter" not in field_params:
+        continue
+      spec = field_params["filter"]
+      if ("window" in spec) != ("threshold" in spec) or not (
+          "window" in spec or "max_rate" in spec):
+        raise ValueError(f'Invalid filter of field '
+          f'`{sensor_name}.{field_name}`')
+      extra_params[f'{field_name}_n_rejected'] = {
+        "type": "int", "aggregate": "sum", "width": 2}
+    sensor_params.update(extra_params)
+  return sensors
+
+def has_filter(sensor_params):
+  return any("filter" in field_params
+    for field_params in sensor_params.values())
+
+def snippet_filter(sensor_name, sensor_params):
+  str = f'struct {sensor_name}_filter {{\n'
+  for field_name, field_params in sensor_params.items():
+    spec = field_params.get("filter", {})
+    if "window" in spec:
+      str += indent(f'filter::Hampel<{spec["window"]}> '
+        f'{field_name}_hampel{{}};\n')
+    if "max_rate" in spec:
+      str += indent(f'filter::RateLimit {field_name}_rate_limit{{}};\n')
+  str += f'}};\n\n'
+
+  str += dedent(f'''\
+    auto init_filter({sensor_name} const &) {{
+      return {sensor_name}_filter{{}};
+    }}
+
+    ''')
+
+  # NOTE: Parameters are left unnamed if unused, to avoid warnings.
+  names = ["state", "data"] if has_filter(sensor_params) else ["", ""]
+  str += (f'void filter_step({sensor_name}_filter &{names[0]}, '
+    f'{sensor_name} &{names[1]}) {{\n')
+  for field_name, field_params in sensor_params.items():
+    if "filter" not in field_params:
+      continue
+    spec = field_params["filter"]
+    value = f'static_cast<float>(*data.{field_name})'
+    str += indent(f'if (data.{field_name}.has_value()) {{\n')
+    str += indent(f'bool accepted{{true}};\n', 2)
+    if "window" in spec:
+      str += indent(f'accepted = state.{field_name}_hampel.accept({value},\n',
+        2)
+      str += indent(f'{float(spec["threshold"])}f, '
+        f'{float(spec.get("min_deviation", 0))}f);\n', 4)
+    if "max_rate" in spec:
+      str += indent(f'if (accepted and data.timestamp.has_value())\n', 2)
+      str += indent(f'accepted = state.{field_name}_rate_limit.accept('
+        f'{value},\n', 3)
+      str += indent(f'*data.timestamp, {float(spec["max_rate"])}f);\n', 5)
+    str += indent(f'data.{field_name}_n_rejected = accepted ? 0 : 1;\n', 2)
+    str += indent(f'if (not accepted) data.{field_name}.reset();\n', 2)
+    str += indent(f'}}\n')
+  return str + f'}}\n'
+
+# The type of the `_state` member of a statistic and the member function that
+# computes it in the end, or `None` for fields without such a member
+def statistic_state(field_params):
+  statistic = field_params["aggregate"]
+  if "source" not in field_params or statistic == "n_samples":
+    return None
+  elif statistic in ["variance", "stddev"]:
+    return "statistics::Welford", statistic
+  elif statistic == "median":
+    return (f'statistics::Median<{field_params["median_capacity"]}>',
+      "median")
+  else:
+    return f'statistics::P2Quantile<{int(statistic[1:])}>', "quantile"
+
+# Fields with a `deadband` key are logged change-only by `shortly --deadband`:
+# A value that is within the deadband of the value last written (or equal to
+# it, for a deadband of 0) is written as `cc::csv_unchanged_string` instead,
+# except in keyframes. Missing values only match missing values.
+def has_deadband(sensor_params):
+  return any("deadband" in field_params
+    for field_params in sensor_params.values())
+
+def snippet_deadband_step(sensor_name, sensor_params):
+  # NOTE: Parameters are left unnamed if unused, to avoid warnings.
+  names = ["reference", "data", "keyframe"] \
+    if has_deadband(sensor_params) else ["", "", ""]
+  str = (f'std::array<bool, {len(sensor_params)}> deadband_step('
+    f'{sensor_name} &{names[0]},\n')
+  str += indent(f'{sensor_name} const &{names[1]}, '
+    f'bool const {names[2]}) {{\n', 2)
+  str += indent(f'std::array<bool, {len(sensor_params)}> unchanged{{}};\n')
+  i = 0
+  for field_name, field_params in sensor_params.items():
+    if "deadband" in field_params:
+      deadband = field_params["deadband"]
+      within = (f'data.{field_name} == reference.{field_name}'
+        if deadband == 0 else f'within_deadband(reference.{field_name}, '
+        f'data.{field_name}, {deadband})')
+      str += indent(f'unchanged[{i}] = not keyframe and\n')
+      str += indent(f'{within};\n', 2)
+      str += indent(f'if (not unchanged[{i}]) '
+        f'reference.{field_name} = data.{field_name};\n')
+    i += 1
+  str += indent(f'return unchanged;\n')
+  return str + f'}}\n'
+
+# Fields with an `activity` key drive the sampling rate with `shortly
+# --adaptive`: Their change between two samples, divided by that key, is the
+# activity of the sensor, and an activity above 1 per `cc::sampling_interval`
+# counts as fast (see `adaptive::Schedule`).
+def has_activity(sensor_params):
+  return any("activity" in field_params
+    for field_params in sensor_params.values())
+
+def snippet_activity(sensor_name, sensor_params):
+  # NOTE: Parameters are left unnamed if unused, to avoid warnings.
+  names = ["previous", "data"] if has_activity(sensor_params) else ["", ""]
+  str = (f'std::optional<float> activity({sensor_name} const &{names[0]},\n')
+  str += indent(f'{sensor_name} const &{names[1]}) {{\n', 2)
+  str += indent(f'std::optional<float> a{{}};\n')
+  for field_name, field_params in sensor_params.items():
+    if "activity" in field_params:
+      str += indent(f'if (previous.{field_name}.has_value() and '
+        f'data.{field_name}.has_value())\n')
+      str += indent(f'a = std::max(a.value_or(0.f), std::abs(static_cast<float>('
+        f'\n', 2)
+      str += indent(f'*data.{field_name} - *previous.{field_name})) / '
+        f'{float(field_params["activity"])}f);\n', 3)
+  str += indent(f'return a;\n')
+  return str + f'}}\n'
+
 def snippet_bool_as_csv_string():
   return dedent('''\
     std::string bool_as_csv_string(bool const x) {
@@ -12,6 +190,7 @@ def snippet_aggregation_step_ops():
   return dedent('''\
     auto constexpr aggregation_step_mean{
       [](auto const &x0, auto const &x1){ return x0 + x1; }};
+    auto constexpr aggregation_step_sum{aggregation_step_mean};
     auto constexpr aggregation_step_min{
       [](auto const &x0, auto const &x1){ return std::min(x0, x1); }};
     auto constexpr aggregation_step_max{
@@ -29,6 +208,64 @@ def snippet_struct(sensor_name, sensor_params):
     str += indent(f'std::optional<{field_params["type"]}> {field_name}{{}};\n')
   return str + f'}};\n'
 
+def snippet_columns(sensor_name, sensor_params):
+  str = f'struct {sensor_name}_columns '
+  if sensor_name != "sensor":
+    str += f': public sensor_columns '
+  str += f'{{\n'
+  for field_name, field_params in sensor_params.items():
+    str += indent(
+      f'batch::Column<{field_params["type"]}> {field_name}{{}};\n')
+  return str + f'}};\n'
+
+def snippet_columns_functions(sensor_name, sensor_params):
+  base = sensor_name != "sensor"
+  str = dedent(f'''\
+    auto init_columns({sensor_name} const &) {{
+      return {sensor_name}_columns{{}};
+    }}
+
+    ''')
+  if not base:
+    str += dedent('''\
+      std::size_t n_rows(sensor_columns const &columns) {
+        return columns.timestamp.size();
+      }
+
+      ''')
+
+  str += (f'void append({sensor_name}_columns &columns, '
+    f'{sensor_name} const &row) {{\n')
+  if base:
+    str += indent(f'append(static_cast<sensor_columns &>(columns),\n')
+    str += indent(f'static_cast<sensor const &>(row));\n', 2)
+  for field_name in sensor_params:
+    str += indent(f'columns.{field_name}.push_back(row.{field_name});\n')
+  str += f'}}\n\n'
+
+  str += (f'{sensor_name} row_at({sensor_name}_columns const &columns, '
+    f'std::size_t const i) {{\n')
+  str += indent(f'return {sensor_name}{{\n')
+  if base:
+    str += indent(
+      f'row_at(static_cast<sensor_columns const &>(columns), i),\n', 2)
+  for field_name in sensor_params:
+    str += indent(f'columns.{field_name}[i],\n', 2)
+  str += indent(f'}};\n')
+  str += f'}}\n\n'
+
+  for function, parameters, arguments in [
+      ("reserve", ", std::size_t const n", "n"), ("clear", "", "")]:
+    str += (f'void {function}({sensor_name}_columns &columns'
+      f'{parameters}) {{\n')
+    if base:
+      str += indent(f'{function}(static_cast<sensor_columns &>(columns)'
+        f'{", " + arguments if arguments else ""});\n')
+    for field_name in sensor_params:
+      str += indent(f'columns.{field_name}.{function}({arguments});\n')
+    str += f'}}\n\n'
+  return str.rstrip("\n") + "\n"
+
 def snippet_sensor_state(sensor_name, sensor_params):
   str = f'struct {sensor_name}_state '
   if sensor_name != "sensor":
@@ -37,6 +274,9 @@ def snippet_sensor_state(sensor_name, sensor_params):
   for field_name, field_params in sensor_params.items():
     if field_params["aggregate"] in ["mean"]:
       str += indent(f'unsigned {field_name}_count{{0u}};\n')
+    elif statistic_state(field_params) is not None:
+      str += indent(
+        f'{statistic_state(field_params)[0]} {field_name}_state{{}};\n')
   return str + f'}};\n'
 
 def snippet_init_state(sensor_name, sensor_params):
@@ -77,6 +317,18 @@ def snippet_aggregation_step(sensor_name, sensor_params):
                          static_cast<sensor_state>(state),
                          static_cast<sensor>(sample))}};\n'''))
   for field_name, field_params in sensor_params.items():
+    if "source" in field_params:
+      source = field_params["source"]
+      if field_params["aggregate"] == "n_samples":
+        str += indent(f'auto const {field_name}{{std::optional<int>{{\n')
+        str += indent(f'aggregate.{field_name}.value_or(0) + '
+          f'(sample.{source}.has_value() ? 1 : 0)}}}};\n', 2)
+      else:
+        str += indent(f'auto const {field_name}{{aggregate.{field_name}}};\n')
+        str += indent(f'auto {field_name}_state{{state.{field_name}_state}};\n')
+        str += indent(f'if (sample.{source}.has_value())\n')
+        str += indent(f'{field_name}_state.push(*sample.{source});\n', 2)
+      continue
     str += indent(f'auto const {field_name}{{util::optional_apply('
       f'aggregation_step_{field_params["aggregate"]},\n')
     str += indent(f'aggregate.{field_name}, sample.{field_name})}};\n', 2)
@@ -97,6 +349,64 @@ def snippet_aggregation_step(sensor_name, sensor_params):
   for field_name, field_params in sensor_params.items():
     if field_params["aggregate"] in ["mean"]:
       str += indent(f'{field_name}_count,\n', 3)
+    elif statistic_state(field_params) is not None:
+      str += indent(f'{field_name}_state,\n', 3)
+  str += indent(f'}}\n', 2)
+  str += indent(f'}};\n')
+  return str + f'}}\n'
+
+def snippet_aggregation_step_batch(sensor_name, sensor_params):
+  # NOTE: Same as `aggregation_step`, but folds a whole batch of samples in
+  # columnar layout into the aggregate.
+  str = f'auto aggregation_step(\n'
+  str += indent(f'{sensor_name} const aggregate,\n', 2)
+  str += indent(f'{sensor_name}_state const state,\n', 2)
+  str += indent(f'{sensor_name}_columns const &samples) {{\n', 2)
+  if sensor_name != "sensor":
+    str += indent(dedent(f'''\
+      auto const [base_aggregate, base_state]{{
+        aggregation_step(static_cast<sensor>(aggregate),
+                         static_cast<sensor_state>(state),
+                         static_cast<sensor_columns const &>(samples))}};\n'''))
+  for field_name, field_params in sensor_params.items():
+    if "source" in field_params:
+      source = field_params["source"]
+      if field_params["aggregate"] == "n_samples":
+        str += indent(f'auto const {field_name}{{'
+          f'samples.{source}.size() == 0u ?\n')
+        str += indent(f'aggregate.{field_name} : std::optional<int>{{\n', 2)
+        str += indent(f'aggregate.{field_name}.value_or(0) + static_cast<int>('
+          f'samples.{source}.valid.count())}}}};\n', 3)
+      else:
+        str += indent(f'auto const {field_name}{{aggregate.{field_name}}};\n')
+        str += indent(f'auto {field_name}_state{{state.{field_name}_state}};\n')
+        str += indent(f'samples.{source}.valid.for_each([&](auto const i){{\n')
+        str += indent(f'{field_name}_state.push(samples.{source}.values[i]); '
+          f'}});\n', 2)
+      continue
+    str += indent(f'auto const {field_name}{{batch::step_'
+      f'{field_params["aggregate"]}(\n')
+    str += indent(f'aggregate.{field_name}, samples.{field_name})}};\n', 2)
+    if field_params["aggregate"] in ["mean"]:
+      str += indent(
+        f'auto const {field_name}_count{{state.{field_name}_count +\n')
+      str += indent(f'static_cast<unsigned>('
+        f'samples.{field_name}.valid.count())}};\n', 2)
+
+  str += indent(
+    f'\nreturn std::pair<{sensor_name}, {sensor_name}_state>{{{{\n')
+  if sensor_name != "sensor":
+    str += indent(f'base_aggregate,\n', 3)
+  for field_name, field_params in sensor_params.items():
+    str += indent(f'{field_name},\n', 3)
+  str += indent(f'}}, {{\n', 2)
+  if sensor_name != "sensor":
+    str += indent(f'base_state,\n', 3)
+  for field_name, field_params in sensor_params.items():
+    if field_params["aggregate"] in ["mean"]:
+      str += indent(f'{field_name}_count,\n', 3)
+    elif statistic_state(field_params) is not None:
+      str += indent(f'{field_name}_state,\n', 3)
   str += indent(f'}}\n', 2)
   str += indent(f'}};\n')
   return str + f'}}\n'
@@ -117,6 +427,9 @@ def snippet_aggregation_finish(sensor_name, sensor_params):
       str += indent(f'return x / static_cast<{field_params["type"]}>('
         f'state.{field_name}_count); }},\n', 3)
       str += indent(f'aggregate.{field_name})}};\n', 3)
+    elif statistic_state(field_params) is not None:
+      str += indent(f'auto const {field_name}{{state.{field_name}_state.'
+        f'{statistic_state(field_params)[1]}()}};\n', 2)
     else:
       str += indent(f'auto const {field_name}{{aggregate.{field_name}}};\n', 2)
 
@@ -148,7 +461,9 @@ def snippet_write_fields(sensor_name, sensor_params):
     f'std::ostream &out, {sensor_name} const &data,\n')
   str += indent(f'WriteFormat const wf = WriteFormat::csv,'
     f'std::optional<std::string> const sensor_name_arg = {{}},\n'
-    f'bool const inner = false) {{\n', 2)
+    f'bool const inner = false,\n'
+    f'std::array<bool, {len(sensor_params)}> const &'
+    f'{"unchanged" if has_deadband(sensor_params) else ""} = {{}}) {{\n', 2)
   str += indent(f'auto const original_precision{{out.precision()}};\n')
   str += indent(f'auto const original_width{{out.width()}};\n')
   str += indent(f'auto const original_flags{{out.flags()}};\n')
@@ -181,26 +496,36 @@ def snippet_write_fields(sensor_name, sensor_params):
     if i > 0:
       str += indent(f'if (wf == WriteFormat::csv)\n')
       str += indent(f'out << std::setw(0) << cc::csv_delimiter_string;\n', 2)
+    field = ""
     if "decimals" in field_params:
-      str += indent(f'out << std::setprecision({field_params["decimals"]}) '
+      field += (f'out << std::setprecision({field_params["decimals"]}) '
         f'<< std::fixed;\n')
     else:
-      str += indent(f'out << std::setprecision(cc::field_decimals_default) '
+      field += (f'out << std::setprecision(cc::field_decimals_default) '
         f'<< std::defaultfloat;\n')
     if "width" in field_params:
       width = field_params["width"]
       if "decimals" in field_params:
         width = f'1 + {field_params["decimals"]} + {width}'
-      str += indent(f'out << std::setw({width});\n')
-    str += indent(f'if (wf == WriteFormat::csv)\n')
-    str += indent(f'out << '
-      f'io::csv::CSVWrapper<std::optional<{field_params["type"]}>>{{\n', 2)
-    str += indent(f'data.{field_name}}};\n', 3)
-    str += indent(f'else if  (wf == WriteFormat::toml)\n')
-    str += indent(f'//NOTE: This requires the sensor field names to be proper'
-      f'TOML keys.\n', 2)
-    str += indent(f'out << io::toml::TOMLWrapper{{\n', 2)
-    str += indent(f'std::make_pair(names[{i}], data.{field_name})}};\n', 3)
+      field += f'out << std::setw({width});\n'
+    field += f'if (wf == WriteFormat::csv)\n'
+    field += indent(f'out << '
+      f'io::csv::CSVWrapper<std::optional<{field_params["type"]}>>{{\n')
+    field += indent(f'data.{field_name}}};\n', 2)
+    field += f'else if  (wf == WriteFormat::toml)\n'
+    field += indent(f'//NOTE: This requires the sensor field names to be proper'
+      f'TOML keys.\n')
+    field += indent(f'out << io::toml::TOMLWrapper{{\n')
+    field += indent(f'std::make_pair(names[{i}], data.{field_name})}};\n', 2)
+    if "deadband" in field_params:
+      str += indent(f'if (wf == WriteFormat::csv and unchanged[{i}])\n')
+      str += indent(
+        f'out << std::setw(0) << cc::csv_unchanged_string;\n', 2)
+      str += indent(f'else {{\n')
+      str += indent(field, 2)
+      str += indent(f'}}\n')
+    else:
+      str += indent(field)
     i += 1
   str += indent(f'if (inner) {{\n')
   str += indent(f'if (wf == WriteFormat::csv)\n', 2)
@@ -216,6 +541,54 @@ def snippet_write_fields(sensor_name, sensor_params):
   str += indent(f'}};\n')
   return str + f'}}\n'
 
+def snippet_read_fields(sensor_name, sensor_params):
+  str = f'bool read_fields(auto &in, {sensor_name} &data) {{\n'
+  reads = []
+  if sensor_name != "sensor":
+    reads.append(f'read_fields(in, static_cast<sensor &>(data))')
+  for field_name, field_params in sensor_params.items():
+    reads.append(f'io::csv::read(in, data.{field_name})')
+  str += indent(f'return ' + "\n  and ".join(reads) + ";\n" if bool(reads)
+    else f'return true;\n')
+  return str + f'}}\n'
+
+def codec_column(field_params):
+  if field_params["type"] == "cc::timestamp_duration_t":
+    return "codec::TimestampColumn"
+  elif field_params["type"] in ["float", "double"]:
+    if "decimals" in field_params:
+      return f'codec::QuantizedColumn<{field_params["decimals"]}>'
+    else:
+      return "codec::XORColumn"
+  else:
+    return "codec::IntegerColumn"
+
+def snippet_codec_columns(sensor_name, sensor_params, base_sensor_params):
+  # NOTE: The base fields are listed explicitly instead of delegating to the
+  # base's functions, as the rows are stored by value.
+  fields = dict(base_sensor_params, **sensor_params) \
+    if sensor_name != "sensor" else sensor_params
+  def calls(function, rows):
+    return "\n  and ".join(
+      f'codec::{function}<{codec_column(field_params)}>(\n'
+      f'    {rows}, [](auto &row) -> auto & {{ return row.{field_name}; }})'
+      for field_name, field_params in fields.items())
+
+  str = (f'bool encode_columns(codec::BitWriter &out, '
+    f'std::vector<{sensor_name}> const &rows) {{\n')
+  str += indent(f'return {calls("encode_column", "out, rows")};\n')
+  str += f'}}\n\n'
+  str += (f'bool decode_columns(codec::BitReader &in, '
+    f'std::vector<{sensor_name}> &rows) {{\n')
+  str += indent(f'return {calls("decode_column", "in, rows")};\n')
+  return str + f'}}\n'
+
+def snippet_sensor_types(sensors):
+  str = f'// All sensor types, e.g. for dispatching on data read from files\n'
+  str += f'using sensor_types_t = std::tuple<\n'
+  str += indent(",\n".join(sensors.keys()), 2)
+  return str + f'>;\n'
+
 def snippet_write_field_names():
   def snippet(t, base_call):
     return dedent(f'''\
@@ -290,9 +663,11 @@ def sensors_include(sensors):
     "width": "cc::timestamp_width",
     "decimals": "cc::timestamp_decimals"}}
 
-  for snippet in [snippet_struct, snippet_sensor_state, snippet_init_state,
-      snippet_setup_io, snippet_sample, snippet_aggregation_step,
+  for snippet in [snippet_struct, snippet_columns, snippet_sensor_state,
+      snippet_init_state, snippet_columns_functions, snippet_setup_io,
+      snippet_sample, snippet_aggregation_step, snippet_aggregation_step_batch,
       snippet_aggregation_finish, snippet_name, snippet_field_names,
+      snippet_deadband_step, snippet_activity, snippet_filter,
       snippet_write_fields]:
     str += indent(snippet("sensor", base_sensor_params) + sep)
     for sensor_name, sensor_params in sensors.items():
@@ -300,8 +675,17 @@ def sensors_include(sensors):
 
   str += indent(snippet_write_field_names() + sep)
 
+  str += indent(snippet_read_fields("sensor", base_sensor_params) + sep)
+  for sensor_name, sensor_params in sensors.items():
+    str += indent(snippet_read_fields(sensor_name, sensor_params) + sep)
+  for sensor_name, sensor_params in sensors.items():
+    str += indent(snippet_codec_columns(sensor_name, sensor_params,
+      base_sensor_params) + sep)
+  str += indent(snippet_sensor_types(sensors) + sep)
+
   return str + f'}} // namespace sensors\n'
 
 sensors, _ = load_and_expand_jsons()
-write_generated_cpp_file("sensors", sensors_include(sensors))
+write_generated_cpp_file("sensors",
+  sensors_include(expand_filters(expand_statistics(sensors))))
 
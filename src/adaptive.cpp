@@ -0,0 +1,81 @@
+namespace adaptive {
+  // Adaptive sampling for `shortly --adaptive`, which samples each sensor less
+  // often while its readings are steady and faster when they change quickly,
+  // or when a control threshold depending on it is near.
+  //
+  // Each sampling interval is divided into `cc::adaptive_ticks_per_interval`
+  // ticks, and each sensor is sampled every `interval` ticks, a power of two
+  // between the shortest interval its hardware allows (but no longer than the
+  // regular sampling interval) and `cc::adaptive_max_slowdown` sampling
+  // intervals. Every aggregate starts with a sample of every sensor, so that
+  // aggregates stay aligned to the same time points as without adaptive
+  // sampling and none of them is empty.
+  //
+  // After each sample, the activity of the sensor (see `activity` in the
+  // generated code), scaled to one sampling interval, decides the next
+  // interval:
+  // * Above 1, or near a control threshold: as short as possible.
+  // * Its root mean square, smoothed exponentially, below
+  //   `cc::adaptive_rest_activity`: twice as long.
+  // * Otherwise: back towards the regular sampling interval.
+  // Samples without activity (e.g. failed readings) leave the interval as is.
+
+  template <typename T>
+  class Schedule {
+    unsigned ticks_min;
+    unsigned ticks_regular;
+    unsigned ticks_max;
+    unsigned interval;
+    // Tick within the current aggregate at which the next sample is due
+    unsigned tick_next{0u};
+
+    T previous{};
+    unsigned tick_previous{0u};
+    // Starts out as active, so that the rate only drops after a few samples
+    double activity_squared{1.};
+    unsigned n_samples_{0u};
+
+  public:
+    Schedule(unsigned const ticks_per_interval,
+        std::chrono::milliseconds const min_interval)
+      : ticks_min{std::min(std::bit_ceil(std::max(1u, static_cast<unsigned>(
+          (min_interval * ticks_per_interval + cc::sampling_interval -
+            std::chrono::milliseconds{1}) / cc::sampling_interval))),
+          ticks_per_interval)},
+        ticks_regular{ticks_per_interval},
+        ticks_max{ticks_per_interval * cc::adaptive_max_slowdown},
+        interval{ticks_per_interval} {}
+
+    bool due(unsigned const tick) const {
+      return tick == 0u or tick >= tick_next;
+    }
+
+    // Takes the sample `x` into account, taken at `tick` of the current
+    // aggregate and `tick_run` of the run
+    void update(T const &x, unsigned const tick, unsigned const tick_run,
+        bool const near_threshold) {
+      ++n_samples_;
+      auto const activity_opt{activity(previous, x)};
+      if (near_threshold) interval = ticks_min;
+      else if (activity_opt.has_value() and tick_run > tick_previous) {
+        auto const a{static_cast<double>(*activity_opt) *
+          static_cast<double>(ticks_regular) /
+          static_cast<double>(tick_run - tick_previous)};
+        activity_squared += cc::adaptive_smoothing *
+          (a * a - activity_squared);
+        if (a > 1.) interval = ticks_min;
+        else if (std::sqrt(activity_squared) < cc::adaptive_rest_activity)
+          interval = std::min(interval * 2u, ticks_max);
+        else interval = interval > ticks_regular ?
+          std::max(interval / 2u, ticks_regular) : ticks_regular;
+      }
+      if (activity_opt.has_value() or not previous.timestamp.has_value()) {
+        previous = x;
+        tick_previous = tick_run;
+      }
+      tick_next = tick + interval;
+    }
+
+    unsigned n_samples() const { return n_samples_; }
+  };
+} // namespace adaptive
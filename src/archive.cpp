@@ -0,0 +1,556 @@
+namespace archive {
+  // Incremental archiving: At the end of each `shortly` run, the run's data are
+  // appended to the day's archive as tar members inside a new, independent xz
+  // stream. A sequence of concatenated xz streams is itself a valid xz file,
+  // and as long as the tar end-of-archive marker is left out until the day is
+  // over, the decompressed data is a growing tar archive. The `daily` mode then
+  // only has to append the end-of-archive marker and verify the result,
+  // instead of compressing a whole day's worth of data in one go.
+  //
+  // The partial archive is kept under a `.part` suffix until it is finalized.
+  //
+  // When finalizing, `daily.py` appends one last xz stream, which contains an
+  // index member followed by the end-of-archive marker. For each member, the
+  // index lists the time range it covers as well as the offset and size of the
+  // xz stream holding it. The last stream can be found from the end of the
+  // file via the xz stream footer, so readers can look up the index and then
+  // decompress only the streams that are relevant to them, while the archive
+  // still is a plain `.tar.xz` file for every other tool.
+
+  struct member {
+    std::string name;
+    std::string data;
+    std::int64_t mtime;
+  };
+
+  std::size_t constexpr tar_block_size{512u};
+
+  // Writes `value` as zero-padded octal number into the `n`-byte tar header
+  // field at `field`, terminated by a null byte.
+  bool tar_write_octal(char * const field, std::size_t const n,
+      std::uint64_t value) {
+    field[n - 1u] = '\0';
+    for (std::size_t i{n - 1u}; i > 0u; --i) {
+      field[i - 1u] = static_cast<char>('0' + (value & 7u));
+      value >>= 3u;
+    }
+    return value == 0u;
+  }
+
+  // Creates a POSIX ustar header for a regular file
+  std::optional<std::array<char, tar_block_size>> tar_header(
+      member const &m) {
+    std::array<char, tar_block_size> header{};
+    if (m.name.size() > 100u) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "archiving `" << m.name << "`: name too long for tar header."
+        << std::endl;
+      return {};
+    }
+    std::copy(m.name.cbegin(), m.name.cend(), header.data());
+    bool success{true};
+    success &= tar_write_octal(header.data() + 100u, 8u, 0644u);     // mode
+    success &= tar_write_octal(header.data() + 108u, 8u, 0u);        // uid
+    success &= tar_write_octal(header.data() + 116u, 8u, 0u);        // gid
+    success &= tar_write_octal(header.data() + 124u, 12u, m.data.size());
+    success &= tar_write_octal(header.data() + 136u, 12u,
+      static_cast<std::uint64_t>(std::max(m.mtime, std::int64_t{0})));
+    if (not success) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "archiving `" << m.name << "`: file too large for tar header."
+        << std::endl;
+      return {};
+    }
+    header[156u] = '0'; // typeflag: regular file
+    std::string_view constexpr magic{"ustar\0" "00", 8u};
+    std::copy(magic.cbegin(), magic.cend(), header.data() + 257u);
+
+    // The checksum is computed with the checksum field itself set to spaces
+    std::fill_n(header.data() + 148u, 8u, ' ');
+    unsigned checksum{0u};
+    for (auto const c : header) checksum += static_cast<unsigned char>(c);
+    tar_write_octal(header.data() + 148u, 7u, checksum);
+    header[155u] = ' ';
+    return {header};
+  }
+
+  // Parses a zero-padded octal number from the `n`-byte tar header field at
+  // `field`
+  std::optional<std::uint64_t> tar_read_octal(char const * const field,
+      std::size_t const n) {
+    std::uint64_t value{0u};
+    std::size_t i{0u};
+    while (i < n and field[i] == ' ') ++i;
+    for (; i < n and field[i] >= '0' and field[i] <= '7'; ++i)
+      value = (value << 3u) | static_cast<std::uint64_t>(field[i] - '0');
+    if (i < n and field[i] != '\0' and field[i] != ' ') return {};
+    return {value};
+  }
+
+  // Serializes members into tar blocks, without the end-of-archive marker
+  std::optional<std::string> tar_members(std::vector<member> const &members) {
+    std::string tar{};
+    for (auto const &m : members) {
+      auto const header_opt{tar_header(m)};
+      if (not header_opt.has_value()) return {};
+      tar.append(header_opt->data(), header_opt->size());
+      tar.append(m.data);
+      tar.append((tar_block_size - m.data.size() % tar_block_size) %
+        tar_block_size, '\0');
+    }
+    return {tar};
+  }
+
+  // Parses the regular file members in `tar`, up to the end-of-archive marker
+  // or the end of the data, whichever comes first
+  std::optional<std::vector<member>> tar_parse(std::string_view const tar) {
+    std::vector<member> members{};
+    std::size_t pos{0u};
+    while (pos + tar_block_size <= tar.size()) {
+      char const * const header{tar.data() + pos};
+      if (std::all_of(header, header + tar_block_size,
+          [](char const c){ return c == '\0'; })) break;
+      auto const size_opt{tar_read_octal(header + 124u, 12u)};
+      auto const mtime_opt{tar_read_octal(header + 136u, 12u)};
+      pos += tar_block_size;
+      if (not size_opt.has_value() or not mtime_opt.has_value() or
+          *size_opt > tar.size() - pos) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "parsing tar data: malformed header at byte "
+          << pos - tar_block_size << "." << std::endl;
+        return {};
+      }
+      if (header[156u] == '0' or header[156u] == '\0')
+        members.push_back({
+          std::string{header, std::find(header, header + 100, '\0')},
+          std::string{tar.substr(pos, *size_opt)},
+          static_cast<std::int64_t>(*mtime_opt)});
+      pos += (*size_opt + tar_block_size - 1u) / tar_block_size *
+        tar_block_size;
+    }
+    return {members};
+  }
+
+  // Compresses `data` into a complete, self-contained xz stream
+  std::optional<std::string> xz_stream(std::string_view const data,
+      std::uint32_t const dict_size = cc::archive_lzma_dict_size) {
+    // NOTE: These settings mirror the ones in `daily.py`, except for the
+    // dictionary size. A dictionary larger than a run's data does not improve
+    // compression, it only costs memory, which the Raspberry Pi Zero does not
+    // have much of.
+    lzma_options_lzma options;
+    if (lzma_lzma_preset(&options, 6u)) return {};
+    options.dict_size = dict_size;
+    options.lc = 4u;
+    options.lp = 0u;
+    options.pb = 0u;
+    options.mf = LZMA_MF_HC4;
+    options.mode = LZMA_MODE_NORMAL;
+    options.nice_len = 273u;
+    options.depth = 200u;
+    std::array<lzma_filter, 2> const filters{{
+      {LZMA_FILTER_LZMA2, &options},
+      {LZMA_VLI_UNKNOWN, nullptr}}};
+
+    std::string out(lzma_stream_buffer_bound(data.size()), '\0');
+    std::size_t out_pos{0u};
+    lzma_ret const response{lzma_stream_buffer_encode(
+      const_cast<lzma_filter *>(filters.data()), LZMA_CHECK_CRC64, nullptr,
+      reinterpret_cast<std::uint8_t const *>(data.data()), data.size(),
+      reinterpret_cast<std::uint8_t *>(out.data()), &out_pos, out.size())};
+    if (response != LZMA_OK) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "compressing " << data.size() << " bytes: liblzma returned "
+        << response << "." << std::endl;
+      return {};
+    }
+    out.resize(out_pos);
+    return {out};
+  }
+
+  // Decompresses a single, complete xz stream
+  std::optional<std::string> xz_decode(std::string_view const data) {
+    lzma_stream strm = LZMA_STREAM_INIT;
+    lzma_ret response{lzma_stream_decoder(&strm, UINT64_MAX, 0u)};
+    std::string out{};
+    if (response == LZMA_OK) {
+      strm.next_in = reinterpret_cast<std::uint8_t const *>(data.data());
+      strm.avail_in = data.size();
+      std::array<std::uint8_t, 1u << 16u> buffer;
+      do {
+        strm.next_out = buffer.data();
+        strm.avail_out = buffer.size();
+        response = lzma_code(&strm, LZMA_FINISH);
+        out.append(reinterpret_cast<char const *>(buffer.data()),
+          buffer.size() - strm.avail_out);
+      } while (response == LZMA_OK);
+    }
+    lzma_end(&strm);
+    if (response != LZMA_STREAM_END) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "decompressing " << data.size() << " bytes: liblzma returned "
+        << response << "." << std::endl;
+      return {};
+    }
+    return {out};
+  }
+
+  // Reads a file from `offset` to its end
+  std::optional<std::string> read_file(std::filesystem::path const &path_file,
+      std::uint64_t const offset = 0u) {
+    if (not util::safe_readable(path_file)) return {};
+    std::ifstream f{path_file, std::ios::in | std::ios::binary};
+    f.seekg(static_cast<std::streamoff>(offset));
+    std::ostringstream ss{};
+    ss << f.rdbuf();
+    if (f.bad()) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "reading " << path_file << ": "
+        << util::ios_error_description(f.rdstate()) << "." << std::endl;
+      return {};
+    }
+    return {std::move(ss).str()};
+  }
+
+  // Reads `size` bytes of a file, starting at `offset`
+  std::optional<std::string> read_file_range(
+      std::filesystem::path const &path_file, std::uint64_t const offset,
+      std::uint64_t const size) {
+    if (not util::safe_readable(path_file)) return {};
+    std::ifstream f{path_file, std::ios::in | std::ios::binary};
+    f.seekg(static_cast<std::streamoff>(offset));
+    std::string data(size, '\0');
+    f.read(data.data(), static_cast<std::streamsize>(size));
+    if (not f) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "reading " << size << " bytes at offset " << offset << " of "
+        << path_file << ": " << util::ios_error_description(f.rdstate())
+        << "." << std::endl;
+      return {};
+    }
+    return {data};
+  }
+
+  std::filesystem::path path_file_archive_part_get(
+      std::filesystem::path const &path_dir,
+      std::chrono::system_clock::time_point const &when) {
+    return path_dir / (segment::date_string(when) + ".tar.xz.part");
+  }
+
+  // Appends `members` as one xz stream to the partial archive at `path_file`.
+  // If writing fails, the archive is truncated back to its previous size, so
+  // that it stays a valid sequence of xz streams.
+  bool append(std::filesystem::path const &path_file,
+      std::vector<member> const &members) {
+    auto const tar_opt{tar_members(members)};
+    if (not tar_opt.has_value()) return false;
+    auto const xz_opt{xz_stream(*tar_opt)};
+    if (not xz_opt.has_value()) return false;
+
+    std::uintmax_t size_before{0u};
+    try {
+      if (std::filesystem::exists(path_file))
+        size_before = std::filesystem::file_size(path_file);
+    } catch (std::filesystem::filesystem_error const &e) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix <<
+        e.what() << std::endl;
+      return false;
+    }
+
+    std::ofstream f;
+    if (not util::safe_open(f, path_file,
+        std::ios::out | std::ios::app | std::ios::binary)) return false;
+    f.write(xz_opt->data(), static_cast<std::streamsize>(xz_opt->size()));
+    f.close();
+    if (not f) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "appending to " << path_file << ": "
+        << util::ios_error_description(f.rdstate()) << "." << std::endl;
+      try { std::filesystem::resize_file(path_file, size_before);
+      } catch (std::filesystem::filesystem_error const &e) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix <<
+          e.what() << std::endl;
+      }
+      return false;
+    }
+
+    if constexpr (cc::log_info) std::cerr << log_info_prefix
+      << "Appended " << members.size() << " member(s) with "
+      << tar_opt->size() << " bytes as " << xz_opt->size()
+      << " compressed bytes to " << path_file << "." << std::endl;
+    return true;
+  }
+
+  // Reading of finalized archives
+
+  struct index_entry {
+    std::string name;
+    // Time range covered by the member, in seconds since epoch
+    std::int64_t time_begin;
+    std::int64_t time_end;
+    // Byte range of the xz stream holding the member
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  // Finds the byte range of the last xz stream in the file at `path_file`
+  // NOTE: This does not skip stream padding, as neither `shortly` nor
+  // `daily.py` write any.
+  std::optional<std::pair<std::uint64_t, std::uint64_t>> xz_last_stream(
+      std::filesystem::path const &path_file) {
+    std::uintmax_t file_size;
+    try { file_size = std::filesystem::file_size(path_file);
+    } catch (std::filesystem::filesystem_error const &e) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix <<
+        e.what() << std::endl;
+      return {};
+    }
+    auto const log_error{[&](auto const &what){
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "locating last xz stream of " << path_file << ": " << what << "."
+        << std::endl;
+    }};
+    if (file_size < 2u * LZMA_STREAM_HEADER_SIZE) {
+      log_error("file too small");
+      return {};
+    }
+
+    auto const footer_opt{read_file_range(path_file,
+      file_size - LZMA_STREAM_HEADER_SIZE, LZMA_STREAM_HEADER_SIZE)};
+    if (not footer_opt.has_value()) return {};
+    lzma_stream_flags flags;
+    if (lzma_stream_footer_decode(&flags,
+        reinterpret_cast<std::uint8_t const *>(footer_opt->data())) !=
+        LZMA_OK) {
+      log_error("no valid stream footer");
+      return {};
+    }
+    if (flags.backward_size > file_size - 2u * LZMA_STREAM_HEADER_SIZE) {
+      log_error("index size out of range");
+      return {};
+    }
+
+    auto const index_data_opt{read_file_range(path_file,
+      file_size - LZMA_STREAM_HEADER_SIZE - flags.backward_size,
+      flags.backward_size)};
+    if (not index_data_opt.has_value()) return {};
+    lzma_index *index{nullptr};
+    std::uint64_t memlimit{UINT64_MAX};
+    std::size_t in_pos{0u};
+    if (lzma_index_buffer_decode(&index, &memlimit, nullptr,
+        reinterpret_cast<std::uint8_t const *>(index_data_opt->data()),
+        &in_pos, index_data_opt->size()) != LZMA_OK) {
+      log_error("no valid stream index");
+      return {};
+    }
+    std::uint64_t const stream_size{lzma_index_stream_size(index)};
+    lzma_index_end(index, nullptr);
+    if (stream_size > file_size) {
+      log_error("stream size out of range");
+      return {};
+    }
+    return {{file_size - stream_size, stream_size}};
+  }
+
+  // Reads the index of a finalized archive from its last xz stream
+  std::optional<std::vector<index_entry>> read_index(
+      std::filesystem::path const &path_file) {
+    auto const range_opt{xz_last_stream(path_file)};
+    if (not range_opt.has_value()) return {};
+    auto const data_opt{
+      read_file_range(path_file, range_opt->first, range_opt->second)};
+    if (not data_opt.has_value()) return {};
+    auto const tar_opt{xz_decode(*data_opt)};
+    if (not tar_opt.has_value()) return {};
+    auto const members_opt{tar_parse(*tar_opt)};
+    if (not members_opt.has_value()) return {};
+    if (members_opt->empty() or
+        members_opt->front().name != cc::basename_file_archive_index) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << path_file << " has no index (not finalized by `daily.py`?)."
+        << std::endl;
+      return {};
+    }
+
+    // NOTE: The index is a CSV file with a header line and one line per member
+    // of the form `"<name>", <time_begin>, <time_end>, <offset>, <size>`.
+    std::vector<index_entry> entries{};
+    std::istringstream lines{members_opt->front().data};
+    std::string line;
+    std::getline(lines, line);
+    while (std::getline(lines, line)) {
+      if (line.empty()) continue;
+      std::istringstream ss{line};
+      index_entry entry;
+      char delimiter;
+      ss >> std::quoted(entry.name) >> delimiter >> entry.time_begin
+        >> delimiter >> entry.time_end >> delimiter >> entry.offset
+        >> delimiter >> entry.size;
+      if (not ss) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "parsing index of " << path_file << ": malformed line `"
+          << line << "`." << std::endl;
+        return {};
+      }
+      entries.push_back(std::move(entry));
+    }
+    return {entries};
+  }
+
+  // Selects the entries whose time range overlaps with `[time_begin,
+  // time_end]` and whose name satisfies `predicate`
+  template <typename Predicate>
+  std::vector<index_entry> select(std::vector<index_entry> const &entries,
+      std::int64_t const time_begin, std::int64_t const time_end,
+      Predicate const &predicate) {
+    std::vector<index_entry> selected{};
+    std::copy_if(entries.cbegin(), entries.cend(),
+      std::back_inserter(selected), [&](index_entry const &entry){
+        return entry.time_begin <= time_end and
+          entry.time_end >= time_begin and predicate(entry.name); });
+    return selected;
+  }
+
+  // Extracts the members listed in `entries` from the archive at `path_file`.
+  // Only the xz streams holding these members are read and decompressed, each
+  // one once. Members are returned in archive order.
+  std::optional<std::vector<member>> read_members(
+      std::filesystem::path const &path_file,
+      std::vector<index_entry> const &entries) {
+    std::map<std::uint64_t, std::pair<std::uint64_t, std::set<std::string>>>
+      streams{};
+    for (auto const &entry : entries) {
+      auto &stream{streams[entry.offset]};
+      stream.first = entry.size;
+      stream.second.insert(entry.name);
+    }
+
+    std::vector<member> members{};
+    for (auto const &[offset, stream] : streams) {
+      auto const data_opt{read_file_range(path_file, offset, stream.first)};
+      if (not data_opt.has_value()) return {};
+      auto const tar_opt{xz_decode(*data_opt)};
+      if (not tar_opt.has_value()) return {};
+      auto members_opt{tar_parse(*tar_opt)};
+      if (not members_opt.has_value()) return {};
+      for (auto &m : *members_opt)
+        if (stream.second.count(m.name) > 0u) members.push_back(std::move(m));
+    }
+    return {members};
+  }
+
+  // Extracts the members whose name satisfies `predicate` from the archive at
+  // `path_file`, which may be partial or lack an index. The whole file is
+  // decompressed, but chunk by chunk, with the tar data being parsed on the fly,
+  // so that only the selected members are ever held in memory.
+  template <typename Predicate>
+  std::optional<std::vector<member>> read_members_streaming(
+      std::filesystem::path const &path_file, Predicate const &predicate) {
+    if (not util::safe_readable(path_file)) return {};
+    std::ifstream f{path_file, std::ios::in | std::ios::binary};
+
+    std::vector<member> members{};
+    // Decompressed data that has not been parsed yet
+    std::string buffer{};
+    // Bytes of the current member's data that are still missing, if it is kept
+    std::optional<member> current{};
+    std::uint64_t to_read{0u};
+    // Bytes of data of unselected members and of padding to be skipped
+    std::uint64_t to_skip{0u};
+    bool end_of_archive{false};
+
+    auto const parse{[&](){
+      std::size_t pos{0u};
+      while (not end_of_archive) {
+        if (current.has_value()) {
+          auto const n{std::min<std::uint64_t>(to_read, buffer.size() - pos)};
+          current->data.append(buffer, pos, n);
+          pos += n;
+          to_read -= n;
+          if (to_read > 0u) break;
+          members.push_back(std::move(*current));
+          current.reset();
+        } else if (to_skip > 0u) {
+          auto const n{std::min<std::uint64_t>(to_skip, buffer.size() - pos)};
+          pos += n;
+          to_skip -= n;
+          if (to_skip > 0u) break;
+        } else {
+          if (buffer.size() - pos < tar_block_size) break;
+          char const * const header{buffer.data() + pos};
+          if (std::all_of(header, header + tar_block_size,
+              [](char const c){ return c == '\0'; })) {
+            end_of_archive = true;
+            break;
+          }
+          auto const size_opt{tar_read_octal(header + 124u, 12u)};
+          auto const mtime_opt{tar_read_octal(header + 136u, 12u)};
+          if (not size_opt.has_value() or not mtime_opt.has_value()) {
+            if constexpr (cc::log_errors) std::cerr << log_error_prefix
+              << "parsing tar data of " << path_file << ": malformed header."
+              << std::endl;
+            return false;
+          }
+          std::string name{header, std::find(header, header + 100, '\0')};
+          pos += tar_block_size;
+          auto const padding{
+            (tar_block_size - *size_opt % tar_block_size) % tar_block_size};
+          if ((header[156u] == '0' or header[156u] == '\0') and
+              predicate(name)) {
+            current = member{std::move(name), {},
+              static_cast<std::int64_t>(*mtime_opt)};
+            current->data.reserve(*size_opt);
+            to_read = *size_opt;
+            to_skip = padding;
+          } else to_skip = *size_opt + padding;
+        }
+      }
+      buffer.erase(0u, pos);
+      return true;
+    }};
+
+    lzma_stream strm = LZMA_STREAM_INIT;
+    lzma_ret response{
+      lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED)};
+    std::array<char, 1u << 16u> in;
+    std::array<std::uint8_t, 1u << 16u> out;
+    lzma_action action{LZMA_RUN};
+    bool success{true};
+    while (response == LZMA_OK and not end_of_archive) {
+      if (strm.avail_in == 0u and action == LZMA_RUN) {
+        f.read(in.data(), in.size());
+        if (f.bad()) {
+          if constexpr (cc::log_errors) std::cerr << log_error_prefix
+            << "reading " << path_file << ": "
+            << util::ios_error_description(f.rdstate()) << "." << std::endl;
+          success = false;
+          break;
+        }
+        strm.next_in = reinterpret_cast<std::uint8_t const *>(in.data());
+        strm.avail_in = static_cast<std::size_t>(f.gcount());
+        if (f.eof()) action = LZMA_FINISH;
+      }
+      strm.next_out = out.data();
+      strm.avail_out = out.size();
+      response = lzma_code(&strm, action);
+      buffer.append(reinterpret_cast<char const *>(out.data()),
+        out.size() - strm.avail_out);
+      if (not parse()) { success = false; break; }
+    }
+    lzma_end(&strm);
+    if (not success) return {};
+    if (not end_of_archive and response != LZMA_STREAM_END) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "decompressing " << path_file << ": liblzma returned " << response
+        << "." << std::endl;
+      return {};
+    }
+    if (current.has_value() or to_skip > 0u) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "parsing tar data of " << path_file << ": truncated member."
+        << std::endl;
+      return {};
+    }
+    return {members};
+  }
+} // namespace archive
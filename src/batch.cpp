@@ -0,0 +1,279 @@
+namespace batch {
+  // Columnar storage of many samples of a sensor, as opposed to one struct of
+  // `std::optional`s per sample. Each field gets one contiguous array of values
+  // and a packed validity bitmap, with one bit per sample telling whether the
+  // value is present. Values of missing samples are left default-initialized,
+  // so that loops over a whole column do not have to branch on each sample.
+  //
+  // The code generator emits a `<sensor>_columns` struct of these for each
+  // sensor, along with functions to append and retrieve samples and to
+  // aggregate a whole batch at once with the kernels below.
+
+  class Validity {
+    std::vector<std::uint64_t> words_{};
+    std::size_t size_{0u};
+
+  public:
+    static std::size_t constexpr bits_per_word{64u};
+
+    std::size_t size() const { return size_; }
+
+    bool test(std::size_t const i) const {
+      return (words_[i / bits_per_word] >> (i % bits_per_word)) & 1u;
+    }
+
+    void push_back(bool const x) {
+      if (size_ % bits_per_word == 0u) words_.push_back(0u);
+      words_.back() |= std::uint64_t{x} << (size_ % bits_per_word);
+      ++size_;
+    }
+
+    // Number of samples present
+    std::size_t count() const {
+      std::size_t n{0u};
+      for (auto const word : words_)
+        n += static_cast<std::size_t>(std::popcount(word));
+      return n;
+    }
+
+    // Calls `f` with the index of each sample present, in order
+    template <class F>
+    void for_each(F &&f) const {
+      for (std::size_t w{0u}; w < words_.size(); ++w)
+        for (auto word{words_[w]}; word != 0u; word &= word - 1u)
+          f(w * bits_per_word + static_cast<std::size_t>(
+            std::countr_zero(word)));
+    }
+
+    std::vector<std::uint64_t> const &words() const { return words_; }
+
+    void reserve(std::size_t const n) {
+      words_.reserve((n + bits_per_word - 1u) / bits_per_word);
+    }
+
+    void clear() {
+      words_.clear();
+      size_ = 0u;
+    }
+  };
+
+  // NOTE: Booleans are stored as bytes, as `std::vector<bool>` packs them into
+  // bits, which would make them awkward to process in bulk.
+  template <typename T>
+  using storage_t = std::conditional_t<std::is_same_v<T, bool>,
+    std::uint8_t, T>;
+
+  template <typename T>
+  struct Column {
+    using value_type = T;
+
+    std::vector<storage_t<T>> values{};
+    Validity valid{};
+
+    std::size_t size() const { return values.size(); }
+
+    std::optional<T> operator[](std::size_t const i) const {
+      if (not valid.test(i)) return {};
+      return {static_cast<T>(values[i])};
+    }
+
+    void push_back(std::optional<T> const &x) {
+      values.push_back(static_cast<storage_t<T>>(x.value_or(T{})));
+      valid.push_back(x.has_value());
+    }
+
+    void reserve(std::size_t const n) {
+      values.reserve(n);
+      valid.reserve(n);
+    }
+
+    void clear() {
+      values.clear();
+      valid.clear();
+    }
+  };
+
+  // Reductions over contiguous values, without regard to validity. Floats,
+  // which make up most of the data, get explicitly vectorized versions, as the
+  // compiler may not reorder floating point additions or comparisons by itself.
+  // The generic versions are simple enough for it to vectorize on its own.
+  namespace kernels {
+    template <typename T>
+    T sum(T const * const p, std::size_t const n) {
+      T s{};
+      for (std::size_t i{0u}; i < n; ++i) s += p[i];
+      return s;
+    }
+
+    // NOTE: These require `n > 0`.
+    template <typename T>
+    T min(T const * const p, std::size_t const n) {
+      T m{p[0]};
+      for (std::size_t i{1u}; i < n; ++i) m = std::min(m, p[i]);
+      return m;
+    }
+
+    template <typename T>
+    T max(T const * const p, std::size_t const n) {
+      T m{p[0]};
+      for (std::size_t i{1u}; i < n; ++i) m = std::max(m, p[i]);
+      return m;
+    }
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(__ARM_NEON)
+  #if defined(__AVX__)
+    std::string_view constexpr instruction_set{"avx"};
+    using float_vector_t = __m256;
+    std::size_t constexpr float_vector_size{8u};
+    float_vector_t float_load(float const * const p) {
+      return _mm256_loadu_ps(p); }
+    float_vector_t float_set1(float const x) { return _mm256_set1_ps(x); }
+    float_vector_t float_add(float_vector_t const a, float_vector_t const b) {
+      return _mm256_add_ps(a, b); }
+    float_vector_t float_min(float_vector_t const a, float_vector_t const b) {
+      return _mm256_min_ps(a, b); }
+    float_vector_t float_max(float_vector_t const a, float_vector_t const b) {
+      return _mm256_max_ps(a, b); }
+    void float_store(float * const p, float_vector_t const a) {
+      _mm256_storeu_ps(p, a); }
+  #elif defined(__SSE2__)
+    std::string_view constexpr instruction_set{"sse2"};
+    using float_vector_t = __m128;
+    std::size_t constexpr float_vector_size{4u};
+    float_vector_t float_load(float const * const p) { return _mm_loadu_ps(p); }
+    float_vector_t float_set1(float const x) { return _mm_set1_ps(x); }
+    float_vector_t float_add(float_vector_t const a, float_vector_t const b) {
+      return _mm_add_ps(a, b); }
+    float_vector_t float_min(float_vector_t const a, float_vector_t const b) {
+      return _mm_min_ps(a, b); }
+    float_vector_t float_max(float_vector_t const a, float_vector_t const b) {
+      return _mm_max_ps(a, b); }
+    void float_store(float * const p, float_vector_t const a) {
+      _mm_storeu_ps(p, a); }
+  #else
+    std::string_view constexpr instruction_set{"neon"};
+    using float_vector_t = float32x4_t;
+    std::size_t constexpr float_vector_size{4u};
+    float_vector_t float_load(float const * const p) { return vld1q_f32(p); }
+    float_vector_t float_set1(float const x) { return vdupq_n_f32(x); }
+    float_vector_t float_add(float_vector_t const a, float_vector_t const b) {
+      return vaddq_f32(a, b); }
+    float_vector_t float_min(float_vector_t const a, float_vector_t const b) {
+      return vminq_f32(a, b); }
+    float_vector_t float_max(float_vector_t const a, float_vector_t const b) {
+      return vmaxq_f32(a, b); }
+    void float_store(float * const p, float_vector_t const a) {
+      vst1q_f32(p, a); }
+  #endif
+
+    // Reduces whole vectors with `op` and folds the lanes and the remaining
+    // values with `scalar_op`
+    template <class Op, class ScalarOp>
+    float float_reduce(float const * const p, std::size_t const n,
+        float const init, Op const &op, ScalarOp const &scalar_op) {
+      auto acc{float_set1(init)};
+      std::size_t i{0u};
+      for (; i + float_vector_size <= n; i += float_vector_size)
+        acc = op(acc, float_load(p + i));
+      std::array<float, float_vector_size> lanes;
+      float_store(lanes.data(), acc);
+      float result{init};
+      for (auto const lane : lanes) result = scalar_op(result, lane);
+      for (; i < n; ++i) result = scalar_op(result, p[i]);
+      return result;
+    }
+
+    float sum(float const * const p, std::size_t const n) {
+      return float_reduce(p, n, 0.f, float_add,
+        [](float const a, float const b){ return a + b; });
+    }
+
+    float min(float const * const p, std::size_t const n) {
+      return float_reduce(p, n, p[0], float_min,
+        [](float const a, float const b){ return std::min(a, b); });
+    }
+
+    float max(float const * const p, std::size_t const n) {
+      return float_reduce(p, n, p[0], float_max,
+        [](float const a, float const b){ return std::max(a, b); });
+    }
+#else
+    std::string_view constexpr instruction_set{"none"};
+#endif
+  }
+
+  // Batch versions of the `aggregation_step_<aggregate>` operations, which fold
+  // the values present in `column` into `x`. The code generator picks one of
+  // these for each field, according to its `aggregate` key in `sensors.json`.
+
+  // NOTE: Values of missing samples are zero, so they do not change the sum.
+  // Since the order of additions differs from folding one sample at a time,
+  // the result for floats may differ in the last bits, though.
+  template <typename T>
+  std::optional<T> step_mean(std::optional<T> const &x,
+      Column<T> const &column) {
+    if (column.valid.count() == 0u) return x;
+    auto const s{static_cast<T>(
+      kernels::sum(column.values.data(), column.size()))};
+    return {x.has_value() ? *x + s : s};
+  }
+
+  // NOTE: A mean is a sum until `aggregation_finish` divides it.
+  template <typename T>
+  std::optional<T> step_sum(std::optional<T> const &x,
+      Column<T> const &column) {
+    return step_mean(x, column);
+  }
+
+  // Reduces each block of 64 samples that are all present with `reduce` and
+  // folds the samples of the others one by one with `op`
+  template <typename T, class Reduce, class Op>
+  std::optional<T> step_extremum(std::optional<T> x, Column<T> const &column,
+      Reduce const &reduce, Op const &op) {
+    auto const &words{column.valid.words()};
+    for (std::size_t w{0u}; w < words.size(); ++w) {
+      auto const begin{w * Validity::bits_per_word};
+      auto const n{std::min(Validity::bits_per_word, column.size() - begin)};
+      auto const full{n == Validity::bits_per_word ? ~std::uint64_t{0u} :
+        (std::uint64_t{1u} << n) - 1u};
+      if (words[w] == full) {
+        auto const m{static_cast<T>(reduce(column.values.data() + begin, n))};
+        x = x.has_value() ? op(*x, m) : m;
+      } else for (auto word{words[w]}; word != 0u; word &= word - 1u) {
+        auto const value{static_cast<T>(column.values[
+          begin + static_cast<std::size_t>(std::countr_zero(word))])};
+        x = x.has_value() ? op(*x, value) : value;
+      }
+    }
+    return x;
+  }
+
+  template <typename T>
+  std::optional<T> step_min(std::optional<T> const &x,
+      Column<T> const &column) {
+    return step_extremum(x, column,
+      [](auto const * const p, std::size_t const n){
+        return kernels::min(p, n); },
+      [](T const &a, T const &b){ return std::min(a, b); });
+  }
+
+  template <typename T>
+  std::optional<T> step_max(std::optional<T> const &x,
+      Column<T> const &column) {
+    return step_extremum(x, column,
+      [](auto const * const p, std::size_t const n){
+        return kernels::max(p, n); },
+      [](T const &a, T const &b){ return std::max(a, b); });
+  }
+
+  template <typename T>
+  std::optional<T> step_first(std::optional<T> const &x,
+      Column<T> const &column) {
+    if (x.has_value()) return x;
+    auto const &words{column.valid.words()};
+    for (std::size_t w{0u}; w < words.size(); ++w)
+      if (words[w] != 0u) return column[w * Validity::bits_per_word +
+        static_cast<std::size_t>(std::countr_zero(words[w]))];
+    return x;
+  }
+} // namespace batch
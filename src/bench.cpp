@@ -0,0 +1,162 @@
+namespace bench {
+  // Resource usage for the `bench-shortly` executable (see `CMakeLists.txt`),
+  // which runs `shortly` on simulated sensors without waiting between ticks
+  // and reports what the sampling costs per sample: wall time, CPU time (of
+  // all threads) and heap allocations, as well as the peak resident set size
+  // of the process.
+
+  // NOTE: Allocations are only counted in `bench-shortly`, which replaces the
+  // global `operator new` below.
+  std::atomic<std::uint64_t> n_allocations{0u};
+
+  struct Usage {
+    std::chrono::steady_clock::time_point time_point{};
+    double cpu_time_in_seconds{};
+    std::int64_t max_rss_in_kib{};
+    std::uint64_t n_allocations{};
+  };
+
+  Usage usage() {
+    Usage u{std::chrono::steady_clock::now(), 0., 0,
+      n_allocations.load(std::memory_order_relaxed)};
+    rusage r{};
+    if (getrusage(RUSAGE_SELF, &r) == 0) {
+      auto const seconds{[](timeval const &t){
+        return static_cast<double>(t.tv_sec) +
+          static_cast<double>(t.tv_usec) * 1e-6; }};
+      u.cpu_time_in_seconds = seconds(r.ru_utime) + seconds(r.ru_stime);
+      u.max_rss_in_kib = r.ru_maxrss;
+    }
+    return u;
+  }
+
+  // Writes the usage between `begin` and `end` per sample in TOML
+  void report(std::ostream &out, Usage const &begin, Usage const &end,
+      std::size_t const n_sensors, std::size_t const n_samples) {
+    using io::toml::TOMLWrapper;
+    auto const duration_in_seconds{std::chrono::duration<double>{
+      end.time_point - begin.time_point}.count()};
+    auto const per_sample{[&](double const x){
+      return n_samples == 0u ? 0. : x / static_cast<double>(n_samples); }};
+    // NOTE: Unsigned integers would be written in hexadecimal
+    out
+      << TOMLWrapper{std::make_pair("number_sensors",
+          static_cast<std::int64_t>(n_sensors))}
+      << TOMLWrapper{std::make_pair("number_samples",
+          static_cast<std::int64_t>(n_samples))}
+      << TOMLWrapper{std::make_pair("duration_in_seconds",
+          duration_in_seconds)}
+      << TOMLWrapper{std::make_pair("samples_per_second",
+          duration_in_seconds > 0. ?
+            static_cast<double>(n_samples) / duration_in_seconds : 0.)}
+      << TOMLWrapper{std::make_pair("cpu_time_per_sample_in_seconds",
+          per_sample(end.cpu_time_in_seconds - begin.cpu_time_in_seconds))}
+      << TOMLWrapper{std::make_pair("allocations_per_sample",
+          per_sample(static_cast<double>(
+            end.n_allocations - begin.n_allocations)))}
+      << TOMLWrapper{std::make_pair("peak_rss_in_kib", end.max_rss_in_kib)};
+  }
+
+  // Micro-benchmarks for `bench-micro`. Each benchmark runs its function in
+  // samples of as many iterations as fit into `sample_duration` (found by
+  // doubling), after `warmup` samples that are thrown away, and reports the
+  // time per iteration over the samples. Results are written as JSON lines, so
+  // that the output of two commits can be compared with `diff` or `jq`.
+
+  // Keeps the compiler from optimizing away the computation of `x`
+  template <typename T>
+  void do_not_optimize(T const &x) {
+    asm volatile("" : : "r"(&x) : "memory");
+  }
+
+  // Restricts this thread (and threads created by it) to CPU `cpu`, returning
+  // whether that succeeded
+  bool pin_to_cpu(int const cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == 0) return true;
+    if constexpr (cc::log_errors) std::cerr << log_error_prefix
+      << "pinning to CPU " << cpu << ": " << std::strerror(errno) << "."
+      << std::endl;
+    return false;
+  }
+
+  // NOTE: `n_samples` must be positive.
+  struct Options {
+    std::size_t n_samples{20u};
+    std::size_t n_warmup{3u};
+    std::chrono::nanoseconds sample_duration{std::chrono::milliseconds{10}};
+  };
+
+  // Statistics of the time per iteration over the samples, in nanoseconds
+  struct Stats {
+    double min, median, mean, stddev, max;
+  };
+
+  Stats stats(std::vector<double> xs) {
+    std::sort(xs.begin(), xs.end());
+    auto const n{static_cast<double>(xs.size())};
+    auto const mean{std::accumulate(xs.begin(), xs.end(), 0.) / n};
+    double variance{0.};
+    for (auto const x : xs) variance += (x - mean) * (x - mean);
+    variance /= std::max(n - 1., 1.);
+    auto const middle{xs.size() / 2u};
+    auto const median{xs.size() % 2u == 0u ?
+      (xs[middle - 1u] + xs[middle]) / 2. : xs[middle]};
+    return {xs.front(), median, mean, std::sqrt(variance), xs.back()};
+  }
+
+  class Suite {
+    std::ostream &out;
+    Options options;
+    std::optional<std::regex> filter;
+
+  public:
+    Suite(std::ostream &out, Options const &options,
+        std::optional<std::regex> filter = {})
+      : out{out}, options{options}, filter{std::move(filter)} {}
+
+    // Measures `f` as the benchmark `name`, unless the filter excludes it
+    template <class F>
+    void run(std::string const &name, F &&f) {
+      if (filter.has_value() and not std::regex_search(name, *filter)) return;
+
+      using clock_t = std::chrono::steady_clock;
+      auto const time{[&](std::size_t const n_iterations){
+          auto const tic{clock_t::now()};
+          for (std::size_t i{0u}; i < n_iterations; ++i) f();
+          return std::chrono::duration<double, std::nano>{
+            clock_t::now() - tic}.count();
+        }};
+
+      std::size_t n_iterations{1u};
+      while (time(n_iterations) < static_cast<double>(
+          options.sample_duration.count()) and n_iterations < (1u << 30u))
+        n_iterations *= 2u;
+      for (std::size_t i{0u}; i < options.n_warmup; ++i) time(n_iterations);
+      std::vector<double> xs(options.n_samples);
+      for (auto &x : xs)
+        x = time(n_iterations) / static_cast<double>(n_iterations);
+      auto const s{stats(std::move(xs))};
+
+      out << "{\"name\": \"" << name << "\", \"iterations\": "
+        << n_iterations << ", \"samples\": " << options.n_samples
+        << ", \"ns_per_iteration\": {\"min\": " << s.min
+        << ", \"median\": " << s.median << ", \"mean\": " << s.mean
+        << ", \"stddev\": " << s.stddev << ", \"max\": " << s.max << "}}"
+        << std::endl;
+    }
+  };
+} // namespace bench
+
+#ifdef BENCH_SHORTLY
+  void *operator new(std::size_t const size) {
+    bench::n_allocations.fetch_add(1u, std::memory_order_relaxed);
+    if (auto * const p{std::malloc(size == 0u ? 1u : size)}) return p;
+    throw std::bad_alloc{};
+  }
+
+  void operator delete(void * const p) noexcept { std::free(p); }
+  void operator delete(void * const p, std::size_t) noexcept { std::free(p); }
+#endif
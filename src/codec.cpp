@@ -0,0 +1,591 @@
+namespace codec {
+  // A native encoding for the data of `shortly` CSV files, column by column.
+  // Every field column consists of a run-length encoded validity bitmap,
+  // followed by the values that are present:
+  // * Timestamps are quantized to the resolution written to the CSV files and
+  //   stored as deltas of deltas, which are almost always tiny, as samples are
+  //   taken at fixed intervals.
+  // * Floats with configured `decimals` are quantized to integers, exactly as
+  //   the CSV writer rounds them, and stored as deltas.
+  // * Floats without `decimals` are stored Gorilla-style, i.e. each value's bit
+  //   pattern is XORed with the previous one and only the meaningful bits are
+  //   written.
+  // * Integers and booleans are stored as deltas.
+  // Deltas are written with a variable-length prefix code, so that small deltas
+  // (which dominate slowly-varying sensor readings) take only a few bits.
+  //
+  // NOTE: The encoding is lossless with respect to the CSV files, not with
+  // respect to the in-memory values, which may have more precision than what
+  // is written out. The CSV files are what is archived, after all. Files
+  // written with `shortly --deadband` are the exception, as the values marked
+  // as unchanged are decoded as the values they stand for.
+  //
+  // Which encoding is used for which field is decided by the code generator,
+  // which emits `encode_columns` and `decode_columns` for each sensor.
+
+  class BitWriter {
+    std::string bytes_{};
+    std::uint64_t buffer_{0u};
+    unsigned n_{0u};
+
+  public:
+    // Writes the `bits` lowest bits of `value`, most significant bit first
+    void write(std::uint64_t const value, unsigned bits) {
+      while (bits > 0u) {
+        unsigned const k{std::min(bits, 8u - n_)};
+        bits -= k;
+        buffer_ = (buffer_ << k) | ((value >> bits) & ((1u << k) - 1u));
+        n_ += k;
+        if (n_ == 8u) {
+          bytes_.push_back(static_cast<char>(buffer_));
+          buffer_ = 0u;
+          n_ = 0u;
+        }
+      }
+    }
+
+    // Pads to a full byte with zeros and returns the bytes written so far
+    std::string const &finish() {
+      if (n_ > 0u) write(0u, 8u - n_);
+      return bytes_;
+    }
+  };
+
+  class BitReader {
+    std::string_view bytes_;
+    std::size_t pos_{0u};
+    std::uint64_t buffer_{0u};
+    unsigned n_{0u};
+
+  public:
+    BitReader(std::string_view const bytes) : bytes_{bytes} {}
+
+    std::optional<std::uint64_t> read(unsigned bits) {
+      std::uint64_t value{0u};
+      while (bits > 0u) {
+        if (n_ == 0u) {
+          if (pos_ == bytes_.size()) return {};
+          buffer_ = static_cast<unsigned char>(bytes_[pos_++]);
+          n_ = 8u;
+        }
+        unsigned const k{std::min(bits, n_)};
+        n_ -= k;
+        bits -= k;
+        value = (value << k) | ((buffer_ >> n_) & ((1u << k) - 1u));
+      }
+      return {value};
+    }
+
+    std::string_view rest() const { return bytes_.substr(pos_); }
+  };
+
+  std::uint64_t zigzag(std::int64_t const x) {
+    return (static_cast<std::uint64_t>(x) << 1u) ^
+      static_cast<std::uint64_t>(x >> 63);
+  }
+
+  std::int64_t unzigzag(std::uint64_t const z) {
+    return static_cast<std::int64_t>(z >> 1u) ^
+      -static_cast<std::int64_t>(z & 1u);
+  }
+
+  void write_varint(BitWriter &out, std::uint64_t x) {
+    while (x >= 0x80u) {
+      out.write((x & 0x7fu) | 0x80u, 8u);
+      x >>= 7u;
+    }
+    out.write(x, 8u);
+  }
+
+  std::optional<std::uint64_t> read_varint(BitReader &in) {
+    std::uint64_t x{0u};
+    for (unsigned shift{0u}; shift < 64u; shift += 7u) {
+      auto const byte_opt{in.read(8u)};
+      if (not byte_opt.has_value()) return {};
+      x |= (*byte_opt & 0x7fu) << shift;
+      if ((*byte_opt & 0x80u) == 0u) return {x};
+    }
+    return {};
+  }
+
+  // Prefix code for zigzagged integers, as in Facebook's Gorilla paper. Zero
+  // takes a single bit.
+  struct IntegerBucket {
+    std::uint64_t prefix;
+    unsigned prefix_bits;
+    unsigned value_bits;
+  };
+  std::array<IntegerBucket, 4> constexpr integer_buckets{{
+    {0b10u, 2u, 7u}, {0b110u, 3u, 9u}, {0b1110u, 4u, 12u},
+    {0b1111u, 4u, 64u}}};
+
+  void write_integer(BitWriter &out, std::int64_t const x) {
+    auto const z{zigzag(x)};
+    if (z == 0u) return out.write(0u, 1u);
+    for (auto const &bucket : integer_buckets)
+      if (bucket.value_bits == 64u or
+          z < (std::uint64_t{1u} << bucket.value_bits)) {
+        out.write(bucket.prefix, bucket.prefix_bits);
+        return out.write(z, bucket.value_bits);
+      }
+  }
+
+  std::optional<std::int64_t> read_integer(BitReader &in) {
+    for (auto const &bucket : integer_buckets) {
+      auto const bit_opt{in.read(1u)};
+      if (not bit_opt.has_value()) return {};
+      if (*bit_opt == 0u) {
+        if (&bucket == &integer_buckets.front()) return {0};
+        auto const z_opt{in.read((&bucket - 1)->value_bits)};
+        if (not z_opt.has_value()) return {};
+        return {unzigzag(*z_opt)};
+      }
+    }
+    auto const z_opt{in.read(integer_buckets.back().value_bits)};
+    if (not z_opt.has_value()) return {};
+    return {unzigzag(*z_opt)};
+  }
+
+  // Writes `order`-th differences (1: deltas, 2: deltas of deltas)
+  // NOTE: The arithmetic is done on unsigned integers, so that it wraps around
+  // instead of overflowing, e.g. for `std::uint64_t` fields.
+  template <unsigned order>
+  void write_differences(BitWriter &out,
+      std::vector<std::int64_t> const &values) {
+    std::array<std::uint64_t, order> previous{};
+    for (auto const value : values) {
+      std::uint64_t difference{static_cast<std::uint64_t>(value)};
+      for (auto &p : previous) {
+        auto const d{difference - p};
+        p = difference;
+        difference = d;
+      }
+      write_integer(out, static_cast<std::int64_t>(difference));
+    }
+  }
+
+  template <unsigned order>
+  std::optional<std::vector<std::int64_t>> read_differences(BitReader &in,
+      std::size_t const n) {
+    std::vector<std::int64_t> values{};
+    values.reserve(n);
+    std::array<std::uint64_t, order> previous{};
+    for (std::size_t i{0u}; i < n; ++i) {
+      auto const difference_opt{read_integer(in)};
+      if (not difference_opt.has_value()) return {};
+      std::uint64_t value{static_cast<std::uint64_t>(*difference_opt)};
+      for (auto p{previous.rbegin()}; p != previous.rend(); ++p)
+        value = *p += value;
+      values.push_back(static_cast<std::int64_t>(value));
+    }
+    return {values};
+  }
+
+  // Gorilla-style XOR encoding of bit patterns
+  void write_xor(BitWriter &out, std::vector<std::int64_t> const &values) {
+    std::uint64_t previous{0u};
+    unsigned leading_previous{64u}, trailing_previous{64u};
+    for (auto const value : values) {
+      auto const x{static_cast<std::uint64_t>(value) ^ previous};
+      previous = static_cast<std::uint64_t>(value);
+      if (x == 0u) {
+        out.write(0u, 1u);
+        continue;
+      }
+      auto const leading{static_cast<unsigned>(std::countl_zero(x))};
+      auto const trailing{static_cast<unsigned>(std::countr_zero(x))};
+      if (leading_previous + trailing_previous < 64u and
+          leading >= leading_previous and trailing >= trailing_previous) {
+        // Meaningful bits fit into the previous window
+        out.write(0b10u, 2u);
+        out.write(x >> trailing_previous,
+          64u - leading_previous - trailing_previous);
+      } else {
+        out.write(0b11u, 2u);
+        out.write(leading, 6u);
+        out.write(63u - leading - trailing, 6u);
+        out.write(x >> trailing, 64u - leading - trailing);
+        leading_previous = leading;
+        trailing_previous = trailing;
+      }
+    }
+  }
+
+  std::optional<std::vector<std::int64_t>> read_xor(BitReader &in,
+      std::size_t const n) {
+    std::vector<std::int64_t> values{};
+    values.reserve(n);
+    std::uint64_t previous{0u};
+    unsigned leading_previous{64u}, trailing_previous{64u};
+    for (std::size_t i{0u}; i < n; ++i) {
+      auto const control_opt{in.read(1u)};
+      if (not control_opt.has_value()) return {};
+      if (*control_opt == 1u) {
+        auto const window_opt{in.read(1u)};
+        if (not window_opt.has_value()) return {};
+        if (*window_opt == 1u) {
+          auto const leading_opt{in.read(6u)};
+          auto const length_opt{in.read(6u)};
+          if (not leading_opt.has_value() or not length_opt.has_value() or
+              *leading_opt + *length_opt > 63u) return {};
+          leading_previous = static_cast<unsigned>(*leading_opt);
+          trailing_previous =
+            static_cast<unsigned>(63u - *leading_opt - *length_opt);
+        } else if (leading_previous + trailing_previous >= 64u) return {};
+        auto const x_opt{in.read(64u - leading_previous - trailing_previous)};
+        if (not x_opt.has_value()) return {};
+        previous ^= *x_opt << trailing_previous;
+      }
+      values.push_back(static_cast<std::int64_t>(previous));
+    }
+    return {values};
+  }
+
+  // Validity bitmaps as alternating run lengths, starting with a run of
+  // present values (which may be empty)
+  void write_validity(BitWriter &out, std::vector<bool> const &validity) {
+    bool state{true};
+    std::uint64_t run{0u};
+    for (bool const valid : validity) {
+      if (valid != state) {
+        write_varint(out, run);
+        state = valid;
+        run = 0u;
+      }
+      ++run;
+    }
+    write_varint(out, run);
+  }
+
+  std::optional<std::vector<bool>> read_validity(BitReader &in,
+      std::size_t const n) {
+    std::vector<bool> validity{};
+    validity.reserve(n);
+    bool state{true};
+    do {
+      auto const run_opt{read_varint(in)};
+      if (not run_opt.has_value() or *run_opt > n - validity.size()) return {};
+      validity.insert(validity.end(), *run_opt, state);
+      state = not state;
+    } while (validity.size() < n);
+    return {validity};
+  }
+
+  // Column encodings, selected for each field by the code generator. Each one
+  // maps values to 64-bit integers and back and decides how the integers are
+  // written.
+
+  struct IntegerColumn {
+    template <typename T>
+    static std::optional<std::int64_t> to_integer(T const x) {
+      return {static_cast<std::int64_t>(x)};
+    }
+    template <typename T>
+    static T from_integer(std::int64_t const x) { return static_cast<T>(x); }
+    static void write(BitWriter &out, std::vector<std::int64_t> const &xs) {
+      write_differences<1u>(out, xs);
+    }
+    static auto read(BitReader &in, std::size_t const n) {
+      return read_differences<1u>(in, n);
+    }
+  };
+
+  template <int decimals>
+  struct QuantizedColumn : IntegerColumn {
+    static double constexpr scale{util::power(10., decimals)};
+
+    // NOTE: For `float` values and few decimals, the product is exact in
+    // `double`, so that `std::nearbyint` (rounding ties to even, like
+    // `printf`) gives the same digits as the CSV writer.
+    template <typename T>
+    static std::optional<std::int64_t> to_integer(T const x) {
+      auto const q{std::nearbyint(static_cast<double>(x) * scale)};
+      if (not std::isfinite(q) or std::abs(q) > 0x1p62) return {};
+      return {static_cast<std::int64_t>(q)};
+    }
+    template <typename T>
+    static T from_integer(std::int64_t const x) {
+      return static_cast<T>(static_cast<double>(x) / scale);
+    }
+  };
+
+  struct TimestampColumn {
+    using quantum_t = std::chrono::duration<std::int64_t, std::ratio<1,
+      util::power(std::intmax_t{10}, cc::timestamp_decimals)>>;
+
+    // NOTE: Truncating, like the CSV writer
+    template <typename T>
+    static std::optional<std::int64_t> to_integer(T const x) {
+      return {std::chrono::duration_cast<quantum_t>(x).count()};
+    }
+    template <typename T>
+    static T from_integer(std::int64_t const x) {
+      return std::chrono::duration_cast<T>(quantum_t{x});
+    }
+    static void write(BitWriter &out, std::vector<std::int64_t> const &xs) {
+      write_differences<2u>(out, xs);
+    }
+    static auto read(BitReader &in, std::size_t const n) {
+      return read_differences<2u>(in, n);
+    }
+  };
+
+  struct XORColumn {
+    template <typename T>
+    static std::optional<std::int64_t> to_integer(T const x) {
+      if constexpr (sizeof(T) == 4u)
+        return {static_cast<std::int64_t>(std::bit_cast<std::uint32_t>(x))};
+      else return {std::bit_cast<std::int64_t>(x)};
+    }
+    template <typename T>
+    static T from_integer(std::int64_t const x) {
+      if constexpr (sizeof(T) == 4u)
+        return std::bit_cast<T>(static_cast<std::uint32_t>(x));
+      else return std::bit_cast<T>(x);
+    }
+    static void write(BitWriter &out, std::vector<std::int64_t> const &xs) {
+      write_xor(out, xs);
+    }
+    static auto read(BitReader &in, std::size_t const n) {
+      return read_xor(in, n);
+    }
+  };
+
+  // Encodes the field of `rows` that `get` projects to (an `std::optional`)
+  template <typename Column, typename Row, typename Get>
+  bool encode_column(BitWriter &out, std::vector<Row> const &rows,
+      Get const &get) {
+    std::vector<bool> validity{};
+    std::vector<std::int64_t> values{};
+    validity.reserve(rows.size());
+    values.reserve(rows.size());
+    for (auto const &row : rows) {
+      auto const &x{get(row)};
+      validity.push_back(x.has_value());
+      if (not x.has_value()) continue;
+      auto const value_opt{Column::to_integer(*x)};
+      if (not value_opt.has_value()) return false;
+      values.push_back(*value_opt);
+    }
+    write_validity(out, validity);
+    Column::write(out, values);
+    return true;
+  }
+
+  template <typename Column, typename Row, typename Get>
+  bool decode_column(BitReader &in, std::vector<Row> &rows, Get const &get) {
+    auto const validity_opt{read_validity(in, rows.size())};
+    if (not validity_opt.has_value()) return false;
+    auto const values_opt{Column::read(in,
+      static_cast<std::size_t>(std::ranges::count(*validity_opt, true)))};
+    if (not values_opt.has_value()) return false;
+    auto value{values_opt->cbegin()};
+    for (std::size_t i{0u}; i < rows.size(); ++i) {
+      auto &x{get(rows[i])};
+      using T = typename std::remove_reference_t<decltype(x)>::value_type;
+      if ((*validity_opt)[i]) x = Column::template from_integer<T>(*value++);
+      else x.reset();
+    }
+    return true;
+  }
+
+  // Whole `shortly` CSV files of one sensor type `T` are encoded as a magic
+  // string, the header line (verbatim, as it contains the physical instance
+  // name), the number of rows and then the columns.
+  //
+  // NOTE: This file is included before the generated sensor code, so the
+  // functions below are templates and call the generated functions
+  // unqualified, to have them found via ADL once `T` is known.
+
+  std::string_view constexpr magic{"slc1"};
+
+  // Returns the physical instance name from a CSV header line, e.g. `dht22_0`
+  // for `"dht22_0_timestamp", "dht22_0_temperature", …`
+  std::optional<std::string> instance_name(std::string_view const header) {
+    std::string_view constexpr suffix{"_timestamp\""};
+    auto const end{header.find(suffix)};
+    if (header.empty() or header.front() != '"' or end == header.npos)
+      return {};
+    return {std::string{header.substr(1u, end - 1u)}};
+  }
+
+  std::string header_line(auto const &data, std::string const &instance) {
+    std::ostringstream ss{};
+    write_field_names(ss, data, sensors::WriteFormat::csv, instance);
+    return std::move(ss).str();
+  }
+
+  void write_bytes(BitWriter &out, std::string_view const bytes) {
+    for (char const c : bytes) out.write(static_cast<unsigned char>(c), 8u);
+  }
+
+  // Writes `magic` and the header line (without its newline)
+  void write_header(BitWriter &out, std::string_view const magic,
+      std::string_view const header) {
+    write_bytes(out, magic);
+    write_varint(out, header.size());
+    write_bytes(out, header);
+  }
+
+  // Reads what `write_header` writes and returns the physical instance name,
+  // or nothing if the header is not one of sensor type `T`
+  template <typename T>
+  std::optional<std::string> read_header(BitReader &in,
+      std::string_view const magic) {
+    if (not in.rest().starts_with(magic)) return {};
+    in = BitReader{in.rest().substr(magic.size())};
+    auto const header_size_opt{read_varint(in)};
+    if (not header_size_opt.has_value() or
+        *header_size_opt > in.rest().size()) return {};
+    std::string const header{in.rest().substr(0u, *header_size_opt)};
+    in = BitReader{in.rest().substr(*header_size_opt)};
+    auto const instance_opt{instance_name(header)};
+    if (not instance_opt.has_value() or
+        header_line(T{}, *instance_opt) != header + "\n") return {};
+    return instance_opt;
+  }
+
+  // Returns whether `n` rows can follow in `in`, which is left as it is. The
+  // validity bitmap of the first column, that of the timestamps, has to add up
+  // to exactly `n`, and each timestamp present takes at least a bit.
+  // NOTE: Rows without a timestamp, i.e. failed samples, take no space of their
+  // own, as they come in runs, so the bytes left do not bound `n` by
+  // themselves. That is what `cc::codec_rows_max` is for.
+  bool rows_fit(BitReader in, std::uint64_t const n) {
+    if (n > cc::codec_rows_max) return false;
+    std::uint64_t n_validity{0u}, n_present{0u};
+    bool state{true};
+    do {
+      auto const run_opt{read_varint(in)};
+      if (not run_opt.has_value() or *run_opt > n - n_validity) return false;
+      n_validity += *run_opt;
+      if (state) n_present += *run_opt;
+      state = not state;
+    } while (n_validity < n);
+    return n_present <= in.rest().size() * 8u;
+  }
+
+  // Returns nothing if `csv` is not a file of sensor type `T`, or if it can
+  // not be encoded losslessly
+  template <typename T>
+  std::optional<std::string> encode_csv(std::string_view const csv) {
+    auto const header_end{csv.find('\n')};
+    if (header_end == csv.npos) return {};
+    auto const header{csv.substr(0u, header_end)};
+    auto const instance_opt{instance_name(header)};
+    if (not instance_opt.has_value() or
+        header_line(T{}, *instance_opt) != csv.substr(0u, header_end + 1u))
+      return {};
+
+    // NOTE: The decoded file always ends with a newline.
+    if (csv.back() != '\n') return {};
+    std::vector<T> rows{};
+    io::csv::FieldScanner in{csv.substr(header_end + 1u)};
+    if (not io::csv::read_rows(in, rows) or rows.size() > cc::codec_rows_max)
+      return {};
+
+    BitWriter out{};
+    write_header(out, magic, header);
+    write_varint(out, rows.size());
+    if (not encode_columns(out, rows)) return {};
+    return {out.finish()};
+  }
+
+  // Returns nothing if `encoded` is not an encoded file of sensor type `T`
+  template <typename T>
+  std::optional<std::string> decode_csv(std::string_view const encoded) {
+    BitReader in{encoded};
+    auto const instance_opt{read_header<T>(in, magic)};
+    if (not instance_opt.has_value()) return {};
+    auto csv{header_line(T{}, *instance_opt)};
+
+    auto const n_opt{read_varint(in)};
+    if (not n_opt.has_value()) return {};
+    if (not rows_fit(in, *n_opt)) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "Encoded file of " << *instance_opt << " claims " << *n_opt
+        << " rows, which it can not hold." << std::endl;
+      return {};
+    }
+    std::vector<T> rows(*n_opt);
+    if (not decode_columns(in, rows)) return {};
+    std::ostringstream ss{};
+    for (auto const &row : rows)
+      write_fields(ss, row, sensors::WriteFormat::csv, *instance_opt);
+    return {csv += std::move(ss).str()};
+  }
+
+  // Raw streams hold the individual samples of a `shortly` run, as opposed to
+  // its aggregates (see `shortly --raw`). They start like the encoded files
+  // above, with their own magic string, and continue with one block per
+  // aggregate, which is appended as soon as the aggregate is complete. Each
+  // block consists of its size in bytes, the number of samples and their
+  // columns, so that a block cut short by a crash can be told apart.
+  //
+  // NOTE: As with the encoded files, the samples are stored with the precision
+  // written to the CSV files.
+
+  std::string_view constexpr magic_raw{"slr1"};
+
+  std::string raw_header(auto const &data, std::string const &instance) {
+    auto const header{header_line(data, instance)};
+    BitWriter out{};
+    write_header(out, magic_raw,
+      std::string_view{header}.substr(0u, header.size() - 1u));
+    return out.finish();
+  }
+
+  // Returns nothing if the samples of `columns` can not be encoded losslessly
+  std::optional<std::string> raw_block(auto const &columns) {
+    if (n_rows(columns) > cc::codec_rows_max) return {};
+    std::vector<decltype(row_at(columns, 0u))> rows{};
+    rows.reserve(n_rows(columns));
+    for (std::size_t i{0u}; i < n_rows(columns); ++i)
+      rows.push_back(row_at(columns, i));
+    BitWriter payload{};
+    write_varint(payload, rows.size());
+    if (not encode_columns(payload, rows)) return {};
+    auto const &bytes{payload.finish()};
+    BitWriter out{};
+    write_varint(out, bytes.size());
+    write_bytes(out, bytes);
+    return {out.finish()};
+  }
+
+  // Decodes a raw stream into a CSV file, as `shortly` would write it without
+  // aggregating. Returns nothing if `encoded` is not a raw stream of sensor
+  // type `T`. A last block that is cut short is left out.
+  template <typename T>
+  std::optional<std::string> decode_raw(std::string_view const encoded) {
+    BitReader in{encoded};
+    auto const instance_opt{read_header<T>(in, magic_raw)};
+    if (not instance_opt.has_value()) return {};
+    std::ostringstream ss{};
+    ss << header_line(T{}, *instance_opt);
+
+    while (not in.rest().empty()) {
+      auto const size_opt{read_varint(in)};
+      if (not size_opt.has_value() or *size_opt > in.rest().size()) {
+        if constexpr (cc::log_info) std::cerr << log_info_prefix
+          << "Ignoring incomplete last block of raw stream of "
+          << *instance_opt << "." << std::endl;
+        break;
+      }
+      BitReader block{in.rest().substr(0u, *size_opt)};
+      in = BitReader{in.rest().substr(*size_opt)};
+      auto const n_opt{read_varint(block)};
+      if (not n_opt.has_value()) return {};
+      if (not rows_fit(block, *n_opt)) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "Block of raw stream of " << *instance_opt << " claims "
+          << *n_opt << " samples, which it can not hold." << std::endl;
+        return {};
+      }
+      std::vector<T> rows(*n_opt);
+      if (not decode_columns(block, rows)) return {};
+      for (auto const &row : rows)
+        write_fields(ss, row, sensors::WriteFormat::csv, *instance_opt);
+    }
+    return {std::move(ss).str()};
+  }
+} // namespace codec
@@ -458,6 +458,9 @@ namespace control {
   // hard-coding and compiling.
   // Edit: Well, in the end I ended up with a bunch of generated code after all.
 
+  void for_each_sensor_near_threshold(auto const &, auto const &,
+      auto const &) {}
+
   auto control_tick(auto const &state, auto const &params, auto const &,
       auto const &pi, std::optional<io::LPD433Receiver> const &,
       auto &overrides) {
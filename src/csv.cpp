@@ -44,4 +44,226 @@ namespace io::csv {
     return out;
   }
 
+  // Reading of fields as written above, e.g. for re-encoding archived files.
+  // Padding spaces are ignored, and an empty field means a missing value.
+  class FieldReader {
+    std::string_view line_;
+    bool done_{false};
+
+  public:
+    FieldReader(std::string_view const line) : line_{line} {}
+
+    // Returns the next field, or nothing if all fields have been read
+    std::optional<std::string_view> next() {
+      if (done_) return {};
+      auto const end{line_.find(cc::csv_delimiter_string.front())};
+      auto field{line_.substr(0u, end)};
+      if (end == line_.npos) done_ = true;
+      else line_.remove_prefix(end + 1u);
+      auto const begin{field.find_first_not_of(' ')};
+      if (begin == field.npos) return {std::string_view{}};
+      field.remove_prefix(begin);
+      field.remove_suffix(field.size() - 1u - field.find_last_not_of(' '));
+      return {field};
+    }
+
+    bool done() const { return done_; }
+  };
+
+  // Locating field and line boundaries is what dominates reading whole files
+  // with `FieldReader`, so for that, this scans blocks of bytes at once with
+  // the vector instructions available, yielding a mask with `bits_per_byte`
+  // bits set for each delimiter or newline. Which instructions are used depends
+  // on the compiler flags (e.g. `-march=native`), and there's a scalar fallback.
+  namespace simd {
+#if defined(__AVX2__)
+    std::string_view constexpr instruction_set{"avx2"};
+    std::size_t constexpr block_size{64u};
+    unsigned constexpr bits_per_byte{1u};
+
+    std::uint64_t boundaries_block(char const * const p) {
+      auto const delimiter{_mm256_set1_epi8(cc::csv_delimiter_string.front())};
+      auto const newline{_mm256_set1_epi8('\n')};
+      auto const half{[&](char const * const q){
+        auto const v{_mm256_loadu_si256(reinterpret_cast<__m256i const *>(q))};
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(
+          _mm256_cmpeq_epi8(v, delimiter), _mm256_cmpeq_epi8(v, newline))));
+      }};
+      return half(p) | std::uint64_t{half(p + 32)} << 32u;
+    }
+#elif defined(__SSE2__)
+    std::string_view constexpr instruction_set{"sse2"};
+    std::size_t constexpr block_size{64u};
+    unsigned constexpr bits_per_byte{1u};
+
+    std::uint64_t boundaries_block(char const * const p) {
+      auto const delimiter{_mm_set1_epi8(cc::csv_delimiter_string.front())};
+      auto const newline{_mm_set1_epi8('\n')};
+      std::uint64_t mask{0u};
+      for (unsigned i{0u}; i < 4u; ++i) {
+        auto const v{_mm_loadu_si128(reinterpret_cast<__m128i const *>(p) + i)};
+        mask |= std::uint64_t{static_cast<std::uint16_t>(_mm_movemask_epi8(
+          _mm_or_si128(_mm_cmpeq_epi8(v, delimiter),
+            _mm_cmpeq_epi8(v, newline))))} << (16u * i);
+      }
+      return mask;
+    }
+#elif defined(__ARM_NEON)
+    // NOTE: NEON has no equivalent of `movemask`. Narrowing the comparison
+    // result with a shift by 4 leaves a nibble per byte instead, of which only
+    // one bit is kept, so that clearing the lowest set bit works as usual. This
+    // works on both AArch32 and AArch64.
+    std::string_view constexpr instruction_set{"neon"};
+    std::size_t constexpr block_size{16u};
+    unsigned constexpr bits_per_byte{4u};
+
+    std::uint64_t boundaries_block(char const * const p) {
+      uint8x16_t const v{vld1q_u8(reinterpret_cast<std::uint8_t const *>(p))};
+      uint8x16_t const eq{vorrq_u8(
+        vceqq_u8(v, vdupq_n_u8(static_cast<std::uint8_t>(
+          cc::csv_delimiter_string.front()))),
+        vceqq_u8(v, vdupq_n_u8('\n')))};
+      uint8x8_t const nibbles{vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)};
+      return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+        std::uint64_t{0x8888888888888888u};
+    }
+#else
+    std::string_view constexpr instruction_set{"none"};
+    std::size_t constexpr block_size{64u};
+    unsigned constexpr bits_per_byte{1u};
+
+    std::uint64_t boundaries_block(char const * const p) {
+      std::uint64_t mask{0u};
+      for (std::size_t i{0u}; i < block_size; ++i)
+        mask |= std::uint64_t{p[i] == cc::csv_delimiter_string.front() or
+          p[i] == '\n'} << i;
+      return mask;
+    }
+#endif
+
+    // Like `boundaries_block`, but for the last `n` bytes before the end of the
+    // data, which may be less than a block
+    std::uint64_t boundaries(char const * const p, std::size_t const n) {
+      if (n >= block_size) return boundaries_block(p);
+      std::array<char, block_size> block{};
+      std::copy_n(p, n, block.data());
+      return boundaries_block(block.data());
+    }
+  }
+
+  // Reads the fields of many lines in a row, as `FieldReader` does for a single
+  // line, but using `simd::boundaries` to find the ends of the fields
+  class FieldScanner {
+    std::string_view data_;
+    // Start of the next field
+    std::size_t pos_{0u};
+    // Start of the block of data covered by `mask_`
+    std::size_t block_{0u};
+    // Boundaries in the block that have not been passed yet
+    std::uint64_t mask_;
+    bool line_done_{false};
+
+    std::size_t next_boundary() {
+      while (mask_ == 0u) {
+        block_ += simd::block_size;
+        if (block_ >= data_.size()) return data_.size();
+        mask_ = simd::boundaries(data_.data() + block_, data_.size() - block_);
+      }
+      auto const i{block_ + static_cast<std::size_t>(
+        std::countr_zero(mask_)) / simd::bits_per_byte};
+      mask_ &= mask_ - 1u;
+      return i;
+    }
+
+  public:
+    FieldScanner(std::string_view const data) : data_{data},
+      mask_{data.empty() ? 0u : simd::boundaries(data.data(), data.size())} {}
+
+    // Returns the next field of the current line, or nothing if all of them
+    // have been read
+    std::optional<std::string_view> next() {
+      if (line_done_) return {};
+      auto const end{next_boundary()};
+      auto field{data_.substr(pos_, end - pos_)};
+      line_done_ = end == data_.size() or data_[end] == '\n';
+      pos_ = std::min(end + 1u, data_.size());
+      auto const begin{field.find_first_not_of(' ')};
+      if (begin == field.npos) return {std::string_view{}};
+      field.remove_prefix(begin);
+      field.remove_suffix(field.size() - 1u - field.find_last_not_of(' '));
+      return {field};
+    }
+
+    // Proceeds to the next line, if all fields of the current one have been
+    // read
+    bool next_line() {
+      if (not line_done_) return false;
+      line_done_ = false;
+      return true;
+    }
+
+    // Whether the end of the data has been reached
+    bool done() const { return pos_ >= data_.size(); }
+  };
+
+  template <typename T>
+  bool parse(std::string_view const s, T &x) {
+    auto const [end, ec]{std::from_chars(s.data(), s.data() + s.size(), x)};
+    return ec == std::errc{} and end == s.data() + s.size();
+  }
+
+  bool parse(std::string_view const s, bool &x) {
+    if (s == cc::csv_true_string) x = true;
+    else if (s == cc::csv_false_string) x = false;
+    else return false;
+    return true;
+  }
+
+  // NOTE: The inverse of the duration output operator above, i.e. this parses
+  // seconds since epoch with an optional fractional part.
+  template <class Rep, std::intmax_t Num, std::intmax_t Denom>
+  bool parse(std::string_view const s,
+      std::chrono::duration<Rep, std::ratio<Num, Denom>> &x) {
+    auto const point{s.find('.')};
+    std::intmax_t seconds, fractional{0};
+    if (not parse(s.substr(0u, point), seconds)) return false;
+    std::intmax_t fractional_den{1};
+    if (point != s.npos) {
+      auto const digits{s.substr(point + 1u)};
+      if (digits.empty() or not parse(digits, fractional)) return false;
+      fractional_den = util::power(std::intmax_t{10}, digits.size());
+    }
+    x = std::chrono::duration<Rep, std::ratio<Num, Denom>>{static_cast<Rep>(
+      (seconds * Denom + fractional * Denom / fractional_den) / Num)};
+    return true;
+  }
+
+  template <typename T>
+  bool read(auto &in, std::optional<T> &x) {
+    auto const field_opt{in.next()};
+    if (not field_opt.has_value()) return false;
+    if (field_opt->empty()) {
+      x.reset();
+      return true;
+    }
+    // NOTE: Unchanged values (see `shortly --deadband`) are left as they are,
+    // so that they keep the value of the row read before into `x`.
+    if (*field_opt == cc::csv_unchanged_string) return true;
+    T value;
+    if (not parse(*field_opt, value)) return false;
+    x = value;
+    return true;
+  }
+
+  // Reads lines of fields of type `T` (as written by `write_fields`) up to the
+  // end of the data. Returns false if a line does not match.
+  template <typename T>
+  bool read_rows(FieldScanner &in, std::vector<T> &rows) {
+    T row{};
+    while (not in.done()) {
+      if (not read_fields(in, row) or not in.next_line()) return false;
+      rows.push_back(row);
+    }
+    return true;
+  }
 }
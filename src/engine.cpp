@@ -0,0 +1,188 @@
+namespace engine {
+  // Coroutine-based sampling for `shortly --coroutines`, which samples all
+  // sensors that are due on one event loop in the main thread instead of
+  // starting a thread per sensor and sample, as a Pi Zero has a single core
+  // and little memory for thread stacks.
+  //
+  // A sensor protocol is a coroutine returning a `Task`, which `co_await`s
+  // `sleep_for` (or `sleep_until`) wherever it would otherwise block to wait
+  // for a device, e.g. while an MH-Z19 prepares its answer or a DHT22 sends
+  // its reading. `Loop::run` starts the tasks of a tick and then sleeps until
+  // the earliest of their sleeps is over, resuming each task in turn, until
+  // all of them are done. Sleeps are all the loop serves: it does not wait
+  // for file descriptors.
+  //
+  // NOTE: pigpio calls still block until the daemon has answered over its
+  // socket, which `pigpiod_if2` does not expose, so there is no descriptor to
+  // wait for, and devices are polled with sleeps in between instead. These
+  // round trips take about a millisecond, unlike the waits above. Tasks are
+  // lazy, i.e. only run when awaited or run, and must outlive that.
+
+  using clock_t = std::chrono::steady_clock;
+
+  template <typename T>
+  class Task {
+  public:
+    struct promise_type;
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+      std::optional<T> value{};
+      // What to resume when done, i.e. the awaiting coroutine, or nothing for
+      // the tasks run by the loop
+      std::coroutine_handle<> continuation{std::noop_coroutine()};
+
+      struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        std::coroutine_handle<> await_suspend(handle_t const h) noexcept {
+          return h.promise().continuation;
+        }
+        void await_resume() const noexcept {}
+      };
+
+      Task get_return_object() { return Task{handle_t::from_promise(*this)}; }
+      std::suspend_always initial_suspend() const noexcept { return {}; }
+      FinalAwaiter final_suspend() const noexcept { return {}; }
+      template <typename U>
+      void return_value(U &&x) { value.emplace(std::forward<U>(x)); }
+      // NOTE: Exceptions are not used for errors in the sampling code.
+      void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+  private:
+    handle_t handle{};
+
+    explicit Task(handle_t const handle) : handle{handle} {}
+
+  public:
+    Task(Task &&that) noexcept : handle{std::exchange(that.handle, {})} {}
+    Task(Task const &) = delete;
+    Task &operator=(Task const &) = delete;
+    Task &operator=(Task &&) = delete;
+
+    ~Task() { if (handle) handle.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+
+    // Runs the task, which resumes `awaiting` when done
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<> const awaiting) noexcept {
+      handle.promise().continuation = awaiting;
+      return handle;
+    }
+
+    T await_resume() { return std::move(*handle.promise().value); }
+
+    std::coroutine_handle<> coroutine() const { return handle; }
+
+    // The result of a task run by the loop, or an empty one if it did not
+    // finish
+    T result() { return handle.done() ? await_resume() : T{}; }
+  };
+
+  class Loop;
+
+  // The loop running on this thread, if any
+  thread_local Loop *loop_current{nullptr};
+
+  class Loop {
+    struct Timer {
+      clock_t::time_point time_point;
+      std::coroutine_handle<> handle;
+      // That of the task the handle belongs to
+      timeline::Buffer *track;
+
+      bool operator>(Timer const &that) const {
+        return time_point > that.time_point;
+      }
+    };
+
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> timers{};
+
+    // Resumes `handle`, with the events recorded to the timeline while it
+    // runs going to `track`
+    static void resume(std::coroutine_handle<> const handle,
+        timeline::Buffer * const track) {
+      auto * const track_outer{timeline::switch_track(track)};
+      handle.resume();
+      timeline::switch_track(track_outer);
+    }
+
+    void resume_timers_due() {
+      auto const now{clock_t::now()};
+      while (not timers.empty() and timers.top().time_point <= now) {
+        auto const [_, handle, track]{timers.top()};
+        timers.pop();
+        resume(handle, track);
+      }
+    }
+
+  public:
+    Loop() = default;
+    Loop(Loop const &) = delete;
+    Loop &operator=(Loop const &) = delete;
+
+    void resume_at(clock_t::time_point const time_point,
+        std::coroutine_handle<> const handle) {
+      timers.push({time_point, handle, timeline::track_current});
+    }
+
+    // Starts the `tasks` that are there and runs the loop until all of them
+    // are done, returning whether they are, which they are unless a task
+    // waits for something other than a sleep. Each task records to the track
+    // of the timeline with its name in `names`.
+    template <typename... Ts>
+    bool run(std::tuple<std::optional<Task<Ts>>...> &tasks,
+        std::array<char const *, sizeof...(Ts)> const &names) {
+      auto * const loop_outer{std::exchange(loop_current, this)};
+      std::vector<std::coroutine_handle<>> handles{};
+      std::vector<timeline::Buffer *> tracks{};
+      util::for_constexpr([&](auto &task, auto const &name){
+          if (not task.has_value()) return;
+          handles.push_back(task->coroutine());
+          tracks.push_back(timeline::track(name));
+        }, tasks, names);
+      auto const done{[&](){ return std::all_of(handles.begin(),
+        handles.end(), [](auto const h){ return h.done(); }); }};
+
+      for (std::size_t i{0u}; i < handles.size(); ++i)
+        resume(handles[i], tracks[i]);
+      while (true) {
+        resume_timers_due();
+        if (done()) break;
+        if (timers.empty()) {
+          // NOTE: Would only happen if a task awaited something else.
+          if constexpr (cc::log_errors) logging::error("engine")
+            << "tasks wait for nothing that the event loop knows of";
+          break;
+        }
+        std::this_thread::sleep_until(timers.top().time_point);
+      }
+      loop_current = loop_outer;
+      return done();
+    }
+  };
+
+  // Suspends the awaiting task until `time_point`, or blocks the thread if
+  // no loop runs on it
+  struct sleep_until {
+    clock_t::time_point time_point;
+
+    bool await_ready() const { return clock_t::now() >= time_point; }
+
+    bool await_suspend(std::coroutine_handle<> const handle) const {
+      if (loop_current == nullptr) {
+        std::this_thread::sleep_until(time_point);
+        return false;
+      }
+      loop_current->resume_at(time_point, handle);
+      return true;
+    }
+
+    void await_resume() const {}
+  };
+
+  sleep_until sleep_for(clock_t::duration const duration) {
+    return {clock_t::now() + duration};
+  }
+} // namespace engine
@@ -0,0 +1,76 @@
+namespace filter {
+  // Rejection of implausible samples before they reach the aggregation and the
+  // control, e.g. the occasional spike of a DHT sensor that passes its
+  // checksum. Fields get a filter through the `filter` key in `sensors.json`,
+  // and the generated `filter_step` function runs it on each sample, removing
+  // rejected values and counting them in the `<field>_n_rejected` field.
+  // Like the statistics, these live per sensor and work in constant time and
+  // memory per sample.
+
+  // Hampel filter: A value is rejected if it deviates from the median of the
+  // last `window` values by more than `threshold` times their median absolute
+  // deviation, scaled to estimate the standard deviation of normally
+  // distributed values. The deviation is at least `min_deviation`, as the
+  // median absolute deviation of quantized readings is often zero.
+  // NOTE: The window holds the values as sampled, including rejected ones, so
+  // that the filter follows a step change once it makes up half the window.
+  template <std::size_t window>
+  class Hampel {
+    static_assert(window >= 3u);
+    std::array<float, window> values{};
+    std::size_t n{0u};
+
+  public:
+    bool accept(float const x, float const threshold,
+        float const min_deviation) {
+      bool accepted{true};
+      if (n >= window) {
+        auto sorted{values};
+        auto const middle{sorted.begin() + window / 2u};
+        std::nth_element(sorted.begin(), middle, sorted.end());
+        auto const median{*middle};
+        for (auto &value : sorted) value = std::abs(value - median);
+        std::nth_element(sorted.begin(), middle, sorted.end());
+        auto const deviation{std::max(1.4826f * *middle, min_deviation)};
+        accepted = std::abs(x - median) <= threshold * deviation;
+      }
+      values[n++ % window] = x;
+      if (n == 2u * window) n = window;
+      return accepted;
+    }
+  };
+
+  // Rate-of-change limit: A value is rejected if it differs from the last
+  // accepted value by more than `max_rate` per second, counting at least one
+  // sampling interval between the two, as samples taken without waiting
+  // (`bench-shortly`, replaying at full speed) are only microseconds apart.
+  // NOTE: After `max_rejected` rejections in a row, the next value is accepted
+  // regardless, so that a real jump does not lock the field out for good.
+  class RateLimit {
+    std::optional<float> previous{};
+    cc::timestamp_duration_t timestamp_previous{};
+    unsigned n_rejected{0u};
+
+    static std::chrono::duration<float> constexpr interval_min{
+      cc::sampling_interval};
+
+  public:
+    static unsigned constexpr max_rejected{3u};
+
+    bool accept(float const x, cc::timestamp_duration_t const timestamp,
+        float const max_rate) {
+      if (previous.has_value() and n_rejected < max_rejected) {
+        auto const dt{std::max(std::chrono::duration<float>{
+          timestamp - timestamp_previous}, interval_min).count()};
+        if (std::abs(x - *previous) > max_rate * dt) {
+          ++n_rejected;
+          return false;
+        }
+      }
+      previous = x;
+      timestamp_previous = timestamp;
+      n_rejected = 0u;
+      return true;
+    }
+  };
+} // namespace filter
@@ -8,30 +8,47 @@
 #include <sstream>
 #include <regex>
 #include <utility>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <variant>
 #include <tuple>
 #include <array>
 #include <vector>
+#include <deque>
+#include <queue>
 #include <ranges>
 #include <unordered_map>
+#include <map>
+#include <set>
+#include <bitset>
+#include <iterator>
 #include <algorithm>
+#include <numeric>
 #include <cmath>
+#include <bit>
+#include <charconv>
 #include <cstdint>
 #include <cinttypes>
 #include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <limits>
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <future>
+#include <coroutine>
 #include <ctime>
 #include <chrono>
 #include <ratio>
 #include <type_traits>
 #include <stdexcept>
+#include <new>
+#include <random>
+#include <numbers>
 
 // NOTE: Since this code is supposed to run on a Raspberry Pi Zero, it must
 // support the GCC or Clang version of Raspberry Pi OS Bullseye, unless I want
@@ -39,8 +56,31 @@
 // compiler versions. Thus, I won't be able to use modules instead of `#include`
 // directives here.
 
+#include <lzma.h>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+  #include <immintrin.h>
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+
 extern "C" {
-  #include <pigpiod_if2.h>
+  #ifndef SIMULATE_SENSORS
+    #include <pigpiod_if2.h>
+  #endif
   #include "DHTXXD.h"
   #include "_433D.h"
 }
@@ -12,14 +12,14 @@ struct Pi {
   Pi & operator=(Pi const &) = delete;
 
   Pi(char const *addr = nullptr, char const *port = nullptr) :
-      handle{pigpio_start(addr, port)} {
+      handle{trace::call("pigpio_start", 0, [&](){
+        return pigpio_start(addr, port); })} {
     if constexpr (cc::log_errors) if (this->handle < 0) {
         char const *port_env{std::getenv("PIGPIO_PORT")};
-        std::cerr << log_error_prefix
+        logging::error("pigpio", this->handle)
           << "connecting to pigpio daemon at "
           << "address " << (addr ? addr : "localhost")
-          << ", port " << (port ? port : (port_env ? port_env : "8888"))
-          << ": " << pigpio_error(this->handle) << std::endl;
+          << ", port " << (port ? port : (port_env ? port_env : "8888"));
     }
     //std::cout << "Pi constructed at " << this << std::endl;
   }
@@ -30,7 +30,8 @@ struct Pi {
   }
 
   ~Pi() {
-    if (this->handle >= 0) pigpio_stop(this->handle);
+    if (this->handle >= 0 and not trace::replaying())
+      pigpio_stop(this->handle);
     //std::cout << "Pi destructed at " << this << std::endl;
   }
 };
@@ -45,19 +46,17 @@ struct I2C {
 
   I2C(int const pi_handle, unsigned const bus,
       unsigned const addr, unsigned const flags = 0u) : 
-      handle{i2c_open(pi_handle, bus, addr, flags)}, pi_handle{pi_handle} {
-    if constexpr (cc::log_errors) if (this->handle < 0) {
-      auto const original_flags{std::cerr.flags()};
-      std::cerr << log_error_prefix
+      handle{trace::call("i2c_open", addr, [&](){
+        return i2c_open(pi_handle, bus, addr, flags); })},
+      pi_handle{pi_handle} {
+    if constexpr (cc::log_errors) if (this->handle < 0)
+      logging::error("i2c", this->handle)
         << "opening I2C device on "
         << "Pi " << pi_handle
         << std::hex << std::showbase
         << ", bus " << bus
         << ", address " << addr
-        << ", flags " << flags
-        << ": " << pigpio_error(this->handle) << std::endl;
-      std::cerr.flags(original_flags);
-    }
+        << ", flags " << flags;
     //std::cout << "I2C constructed at " << this << std::endl;
   }
 
@@ -68,11 +67,11 @@ struct I2C {
 
   ~I2C() {
     if (this->handle >= 0) {
-      int const response{i2c_close(this->pi_handle, this->handle)};
-      if constexpr (cc::log_errors) if (response < 0) std::cerr
-        << log_error_prefix << "closing I2C device on "
-        << "Pi " << pi_handle
-        << ": " << pigpio_error(response) << std::endl;
+      int const response{trace::call("i2c_close", this->handle, [&](){
+        return i2c_close(this->pi_handle, this->handle); })};
+      if constexpr (cc::log_errors) if (response < 0)
+        logging::error("i2c", response) << "closing I2C device on "
+        << "Pi " << pi_handle;
     }
     //std::cout << "I2C destructed at " << this << std::endl;
   }
@@ -89,16 +88,15 @@ struct Serial {
 
   Serial(int const pi_handle, char * const tty, unsigned const baud_rate,
       unsigned const flags = 0u) :
-      handle{serial_open(pi_handle, tty, baud_rate, flags)},
+      handle{trace::call("serial_open", 0, [&](){
+        return serial_open(pi_handle, tty, baud_rate, flags); })},
       pi_handle{pi_handle}, tty{tty} {
-    if constexpr (cc::log_errors) if (this->handle < 0) {
-      std::cerr << log_error_prefix
+    if constexpr (cc::log_errors) if (this->handle < 0)
+      logging::error("serial", this->handle)
         << "opening " << tty
         << " on Pi " << pi_handle
         << ", baud rate " << baud_rate
-        << ", flags " << flags
-        << ": " << pigpio_error(this->handle) << std::endl;
-    }
+        << ", flags " << flags;
     //std::cout << "Serial constructed at " << this << std::endl;
   }
 
@@ -110,12 +108,12 @@ struct Serial {
 
   ~Serial() {
     if (this->handle >= 0) {
-      int const response{serial_close(this->pi_handle, this->handle)};
-      if constexpr (cc::log_errors) if (response < 0) std::cerr
-        << log_error_prefix
+      int const response{trace::call("serial_close", this->handle, [&](){
+        return serial_close(this->pi_handle, this->handle); })};
+      if constexpr (cc::log_errors) if (response < 0)
+        logging::error("serial", response)
         << "closing " << this->tty
-        << " on Pi " << this->pi_handle
-        << ": " << pigpio_error(response) << std::endl;
+        << " on Pi " << this->pi_handle;
     }
     //std::cout << "Serial destructed at " << this << std::endl;
   }
@@ -123,6 +121,7 @@ struct Serial {
 
 struct DHT {
   DHTXXD_t * dht;
+  int gpio_index;
   operator DHTXXD_t * () const { return this->dht; }
 
   DHT(DHT const &) = delete;
@@ -130,11 +129,13 @@ struct DHT {
 
   DHT(int const pi_handle, int const gpio_index, int const dht_model = DHTAUTO,
       DHTXXD_CB_t callback = nullptr) :
-      dht{DHTXXD(pi_handle, gpio_index, dht_model, callback)} {
+      dht{trace::replaying() ? nullptr :
+        DHTXXD(pi_handle, gpio_index, dht_model, callback)},
+      gpio_index{gpio_index} {
     //std::cout << "DHT constructed at " << this << std::endl;
   }
 
-  DHT(DHT&& that) : dht{that.dht} {
+  DHT(DHT&& that) : dht{that.dht}, gpio_index{that.gpio_index} {
     that.dht = nullptr;
     //std::cout << "DHT moved from " << &that << " to " << this << std::endl;
   }
@@ -147,8 +148,58 @@ struct DHT {
 
 bool errored(DHT const &) { return false; }
 
+// Triggers a reading of `dht` and returns it
+// NOTE: See `sensors::sample_dht22` on how often this may be done.
+DHTXXD_data_t dht_read(DHT const &dht) {
+  DHTXXD_data_t data{};
+  std::array<char, 2u * sizeof(float)> buf{};
+  data.status = trace::call_read("dht_read", dht.gpio_index, [&](){
+      DHTXXD_manual_read(dht);
+      data = DHTXXD_data(dht);
+      std::memcpy(buf.data(), &data.temperature, sizeof(float));
+      std::memcpy(buf.data() + sizeof(float), &data.humidity, sizeof(float));
+      return std::pair{data.status, buf.size()};
+    }, buf.data(), buf.size());
+  std::memcpy(&data.temperature, buf.data(), sizeof(float));
+  std::memcpy(&data.humidity, buf.data() + sizeof(float), sizeof(float));
+  if (data.status == DHT_TIMEOUT) metrics::dht_timeouts.add();
+  return data;
+}
+
+// Triggers a reading of `dht` and waits for it on the event loop of `engine`,
+// polling as often and as long as `DHTXXD_manual_read` does
+engine::Task<std::pair<int, std::size_t>> dht_wait_read(DHT const &dht,
+    DHTXXD_data_t &data, std::array<char, 2u * sizeof(float)> &buf) {
+  std::chrono::milliseconds constexpr interval{50};
+  std::size_t constexpr n_intervals{5u};
+
+  DHTXXD_manual_trigger(dht);
+  for (std::size_t i{0u}; i < n_intervals; ++i) {
+    co_await engine::sleep_for(interval);
+    if (DHTXXD_manual_done(dht, 0)) break;
+  }
+  DHTXXD_manual_done(dht, 1);
+  data = DHTXXD_data(dht);
+  std::memcpy(buf.data(), &data.temperature, sizeof(float));
+  std::memcpy(buf.data() + sizeof(float), &data.humidity, sizeof(float));
+  co_return std::pair{data.status, buf.size()};
+}
+
+// Same as `dht_read`, but waits on the event loop of `engine`
+engine::Task<DHTXXD_data_t> dht_read_async(DHT const &dht) {
+  DHTXXD_data_t data{};
+  std::array<char, 2u * sizeof(float)> buf{};
+  data.status = co_await trace::call_read_async("dht_read", dht.gpio_index,
+    dht_wait_read(dht, data, buf), buf.data(), buf.size());
+  std::memcpy(&data.temperature, buf.data(), sizeof(float));
+  std::memcpy(&data.humidity, buf.data() + sizeof(float), sizeof(float));
+  if (data.status == DHT_TIMEOUT) metrics::dht_timeouts.add();
+  co_return data;
+}
+
 struct LPD433Receiver {
   _433D_rx_t * lpd433_receiver;
+  int gpio_index;
   operator _433D_rx_t * () const { return this->lpd433_receiver; }
 
   LPD433Receiver(LPD433Receiver const &) = delete;
@@ -156,12 +207,14 @@ struct LPD433Receiver {
 
   LPD433Receiver(int const pi_handle, int const gpio_index,
       _433D_rx_CB_t callback = nullptr) :
-      lpd433_receiver{_433D_rx(pi_handle, gpio_index, callback)} {
+      lpd433_receiver{trace::replaying() ? nullptr :
+        _433D_rx(pi_handle, gpio_index, callback)},
+      gpio_index{gpio_index} {
     //std::cout << "LPD433Receiver constructed at " << this << std::endl;
   }
 
   LPD433Receiver(LPD433Receiver&& that) :
-      lpd433_receiver{that.lpd433_receiver} {
+      lpd433_receiver{that.lpd433_receiver}, gpio_index{that.gpio_index} {
     that.lpd433_receiver = nullptr;
     //std::cout << "LPD433Receiver moved from " << &that << " to " << this
     //  << std::endl;
@@ -175,6 +228,24 @@ struct LPD433Receiver {
 
 bool errored(LPD433Receiver const &) { return false; }
 
+// The code `receiver` has picked up since the last call, if any
+// NOTE: Only the codes decoded by the _433D library are traced, not the edges
+// they were decoded from.
+std::optional<_433D_rx_data_t> lpd433_receive(LPD433Receiver const &receiver) {
+  _433D_rx_data_t data{};
+  std::array<char, sizeof(_433D_rx_data_t)> buf{};
+  int const ready{trace::call_read("lpd433_receive", receiver.gpio_index,
+    [&](){
+      if (_433D_rx_ready(receiver) == 0) return std::pair{0, std::size_t{0u}};
+      _433D_rx_data(receiver, &data);
+      std::memcpy(buf.data(), &data, sizeof(data));
+      return std::pair{1, buf.size()};
+    }, buf.data(), buf.size())};
+  if (ready <= 0) return {};
+  std::memcpy(&data, buf.data(), sizeof(data));
+  return {data};
+}
+
 struct LPD433Transmitter {
   _433D_tx_t * lpd433_transmitter;
   operator _433D_tx_t * () const { return this->lpd433_transmitter; }
@@ -204,14 +275,14 @@ bool errored(LPD433Transmitter const &) { return false; }
 
 auto create_i2c_reader(int const pi_handle, int const i2c_handle) {
   return [=](unsigned const reg){
-    int const response{i2c_read_byte_data(pi_handle, i2c_handle, reg)};
+    int const response{trace::call("i2c_read", i2c_handle, [&](){
+      return i2c_read_byte_data(pi_handle, i2c_handle, reg); })};
     if (response < 0) {
-      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+      if constexpr (cc::log_errors) logging::error("i2c", response)
         << "reading from "
         << "Pi " << pi_handle
         << ", I2C " << i2c_handle
-        << ", register " << reg
-        << ": " << pigpio_error(response) << std::endl;
+        << ", register " << reg;
       return std::optional<std::uint8_t>{};
     } else {
       return std::optional<std::uint8_t>{response & std::uint8_t{0xffu}};
@@ -233,42 +304,49 @@ std::optional<bool> get_flag(
 
 // Wrapper for the pigpio function of the same name (without leading underscore)
 int _serial_data_available(Serial const &serial) {
-  int const response{serial_data_available(serial.pi_handle, serial)};
-  if constexpr (cc::log_errors) if (response < 0) std::cerr << log_error_prefix
+  int const response{trace::call("serial_data_available", serial, [&](){
+    return serial_data_available(serial.pi_handle, serial); })};
+  if constexpr (cc::log_errors) if (response < 0)
+    logging::error("serial", response)
     << "querying " << serial.tty
-    << " on Pi " << serial.pi_handle
-    << ": " << pigpio_error(response) << std::endl;
+    << " on Pi " << serial.pi_handle;
   return response;
 }
 
 // Wrapper for the pigpio function of the same name (without leading underscore)
 int _serial_read_byte(Serial const &serial) {
-  int const response{serial_read_byte(serial.pi_handle, serial)};
-  if constexpr (cc::log_errors) if (response < 0) std::cerr << log_error_prefix
+  int const response{trace::call("serial_read_byte", serial, [&](){
+    return serial_read_byte(serial.pi_handle, serial); })};
+  if constexpr (cc::log_errors) if (response < 0)
+    logging::error("serial", response)
     << "reading byte from " << serial.tty
-    << " on Pi " << serial.pi_handle
-    << ": " << pigpio_error(response) << std::endl;
+    << " on Pi " << serial.pi_handle;
   return response;
 }
 
 // Wrapper for the pigpio function of the same name (without leading underscore)
 int _serial_read(Serial const &serial, char * const buf, unsigned const count) {
-  int const response{serial_read(serial.pi_handle, serial, buf, count)};
-  if constexpr (cc::log_errors) if (response < 0) std::cerr << log_error_prefix
+  int const response{trace::call_read("serial_read", serial, [&](){
+      int const response{serial_read(serial.pi_handle, serial, buf, count)};
+      return std::pair{response,
+        static_cast<std::size_t>(std::max(response, 0))};
+    }, buf, count)};
+  if constexpr (cc::log_errors) if (response < 0)
+    logging::error("serial", response)
     << "reading from " << serial.tty
-    << " on Pi " << serial.pi_handle
-    << ": " << pigpio_error(response) << std::endl;
+    << " on Pi " << serial.pi_handle;
   return response;
 }
 
 // Wrapper for the pigpio function of the same name (without leading underscore)
 int _serial_write(Serial const &serial, char * const buf,
     unsigned const count) {
-  int const response{serial_write(serial.pi_handle, serial, buf, count)};
-  if constexpr (cc::log_errors) if (response < 0) std::cerr << log_error_prefix
+  int const response{trace::call("serial_write", serial, [&](){
+    return serial_write(serial.pi_handle, serial, buf, count); })};
+  if constexpr (cc::log_errors) if (response < 0)
+    logging::error("serial", response)
     << "writing to " << serial.tty
-    << " on Pi " << serial.pi_handle
-    << ": " << pigpio_error(response) << std::endl;
+    << " on Pi " << serial.pi_handle;
   return response;
 }
 
@@ -280,12 +358,28 @@ int serial_flush(Serial const &serial) {
     int const response{_serial_read_byte(serial)};
     if (response < 0) success = false;
   }
-  if constexpr (cc::log_info) if (response > 0 and success) std::cerr
-    << log_info_prefix << "successfully flushed " << response << " bytes from "
-    << serial.tty << std::endl;
+  if constexpr (cc::log_info) if (response > 0 and success)
+    logging::info("serial") << "successfully flushed " << response
+    << " bytes from " << serial.tty;
   return response;
 }
 
+template <class Rep0, class Period0>
+void log_serial_timeout(Serial const &serial,
+    std::chrono::duration<Rep0, Period0> const &timeout,
+    std::size_t const max_intervals_to_wait) {
+  if constexpr (cc::log_errors) {
+    using T = double;
+    T const timeout_in_seconds{static_cast<T>(timeout.count()) *
+      static_cast<T>(Period0::num) / static_cast<T>(Period0::den)};
+    logging::error("serial")
+      << "reading from " << serial.tty
+      << " on Pi " << serial.pi_handle
+      << ": " << "timeout after " << max_intervals_to_wait
+      << " retries in " << timeout_in_seconds << "s";
+  }
+}
+
 // Checks periodically until requested byte count is available and then reads
 template <class Rep0, class Period0, class Rep1, class Period1>
 std::optional<int> serial_wait_read(Serial const &serial, char * const buf,
@@ -300,19 +394,31 @@ std::optional<int> serial_wait_read(Serial const &serial, char * const buf,
     std::this_thread::sleep_for(interval);
   }
 
-  if constexpr (cc::log_errors) {
-    using T = double;
-    T const timeout_in_seconds{static_cast<T>(timeout.count()) *
-      static_cast<T>(Period0::num) / static_cast<T>(Period0::den)};
-    std::cerr << log_error_prefix
-      << "reading from " << serial.tty
-      << " on Pi " << serial.pi_handle
-      << ": " << "timeout after " << max_intervals_to_wait
-      << " retries in " << timeout_in_seconds << "s" << std::endl;
-  }
+  log_serial_timeout(serial, timeout, max_intervals_to_wait);
   return {};
 }
 
+// Same, but waits between the checks on the event loop of `engine`
+// NOTE: The data are fetched from `pigpiod`, which buffers them, so there is
+// no tty to wait for here.
+template <class Rep0, class Period0, class Rep1, class Period1>
+engine::Task<std::optional<int>> serial_wait_read_async(Serial const &serial,
+    char * const buf, unsigned const count,
+    std::chrono::duration<Rep0, Period0> const timeout,
+    std::chrono::duration<Rep1, Period1> const interval) {
+  std::size_t const
+    max_intervals_to_wait{static_cast<std::size_t>(timeout / interval)};
+  for (std::size_t i{0}; i < max_intervals_to_wait; ++i) {
+    int const response{_serial_data_available(serial)};
+    if (response >= static_cast<int>(count))
+      co_return _serial_read(serial, buf, count);
+    co_await engine::sleep_for(interval);
+  }
+
+  log_serial_timeout(serial, timeout, max_intervals_to_wait);
+  co_return std::optional<int>{};
+}
+
 char mhz19_checksum(auto const packet) {
   char checksum{0x00};
   for(std::size_t i{1}; i < 8; ++i) checksum += packet[i];
@@ -325,54 +431,74 @@ int mhz19_send(Serial const &serial, auto const packet) {
   return _serial_write(serial, buf.data(), buf.size());
 }
 
-template <typename Rep0 = decltype(cc::mhz19_receive_timeout_default)::rep,
-  typename Period0 = decltype(cc::mhz19_receive_timeout_default)::period,
-  typename Rep1 = decltype(cc::mhz19_receive_interval_default)::rep,
-  typename Period1 = decltype(cc::mhz19_receive_interval_default)::period>
-std::optional<std::array<std::uint8_t, 8>> mhz19_receive(Serial const &serial,
-    std::chrono::duration<Rep0, Period0> const &timeout =
-      cc::mhz19_receive_timeout_default,
-    std::chrono::duration<Rep1, Period1> const &interval =
-      cc::mhz19_receive_interval_default) {
-  std::array<char, 9> buf{};
-  auto const response_opt{
-    serial_wait_read(serial, buf.data(), buf.size(), timeout, interval)};
-
+// Checks the answer of an MH-Z19 read into `buf` and returns its payload
+std::optional<std::array<std::uint8_t, 8>> mhz19_unpack(Serial const &serial,
+    std::optional<int> const &response_opt, std::array<char, 9> const &buf) {
   if (not response_opt.has_value()) return {};
   auto const response{response_opt.value()};
 
   if (response < 0) return {};
 
   if (response >= 0 and response < static_cast<int>(buf.size())) {
-    if constexpr (cc::log_errors) std::cerr << log_error_prefix
+    if constexpr (cc::log_errors) logging::error("mhz19")
       << "receiving packet from MH-Z19 via " << serial.tty
       << " on Pi " << serial.pi_handle
-      << ": expected to read 9 bytes, got " << response << std::endl;
+      << ": expected to read 9 bytes, got " << response;
     return {};
   }
 
   if (buf[8] != mhz19_checksum(buf)) {
-    if constexpr (cc::log_info) std::cerr << log_info_prefix
+    metrics::serial_checksum_failures.add();
+    if constexpr (cc::log_info) logging::info("mhz19")
       << "wrong checksum in packet from MH-Z19 via " << serial.tty
-      << " on Pi " << serial.pi_handle << std::endl;
+      << " on Pi " << serial.pi_handle;
     return {};
   }
 
   return {{{buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7]}}};
 }
 
+template <typename Rep0 = decltype(cc::mhz19_receive_timeout_default)::rep,
+  typename Period0 = decltype(cc::mhz19_receive_timeout_default)::period,
+  typename Rep1 = decltype(cc::mhz19_receive_interval_default)::rep,
+  typename Period1 = decltype(cc::mhz19_receive_interval_default)::period>
+std::optional<std::array<std::uint8_t, 8>> mhz19_receive(Serial const &serial,
+    std::chrono::duration<Rep0, Period0> const &timeout =
+      cc::mhz19_receive_timeout_default,
+    std::chrono::duration<Rep1, Period1> const &interval =
+      cc::mhz19_receive_interval_default) {
+  std::array<char, 9> buf{};
+  auto const response_opt{
+    serial_wait_read(serial, buf.data(), buf.size(), timeout, interval)};
+  return mhz19_unpack(serial, response_opt, buf);
+}
+
+// Same, but waits on the event loop of `engine`
+engine::Task<std::optional<std::array<std::uint8_t, 8>>> mhz19_receive_async(
+    Serial const &serial) {
+  std::array<char, 9> buf{};
+  auto const response_opt{co_await serial_wait_read_async(serial, buf.data(),
+    buf.size(), cc::mhz19_receive_timeout_default,
+    cc::mhz19_receive_interval_default)};
+  co_return mhz19_unpack(serial, response_opt, buf);
+}
+
 std::thread lpd433_send_oneshot(auto const &pi, int const gpio_index,
     std::vector<std::uint64_t> const &codes, int const n_bits,
     int const n_repeats, int const intercode_gap, int const pulse_length_short,
     int const pulse_length_long, bool const wait = true) {
   auto const lpd433_send_oneshotter_body{[&](){
+    realtime::reset_thread();
+    timeline::Scope const scope{"io", "lpd433_send", gpio_index};
     io::LPD433Transmitter const lpd433_transmitter{pi, gpio_index};
     _433D_tx_set_bits(lpd433_transmitter, n_bits);
     _433D_tx_set_repeats(lpd433_transmitter, n_repeats);
     _433D_tx_set_timings(lpd433_transmitter, intercode_gap,
       pulse_length_short, pulse_length_long);
-    for (auto const &code : codes)
+    for (auto const &code : codes) {
       _433D_tx_send(lpd433_transmitter, code);
+      metrics::lpd433_codes_sent.add();
+    }
   }};
 
   auto const lpd433_send_oneshotter{[&](){
@@ -383,11 +509,11 @@ std::thread lpd433_send_oneshot(auto const &pi, int const gpio_index,
     auto toc{clock.now()};
     auto const t{
       std::chrono::duration_cast<std::chrono::milliseconds>(toc - tic).count()};
-    std::cerr << log_info_prefix << "Sending " << codes.size()
+    logging::info("lpd433") << "Sending " << codes.size()
       << " LPD433 code(s) with " << n_bits << " bit(s), " << n_repeats
       << " repetition(s), and timings (gap, short, " "long) of "
       << intercode_gap << "µs, " << pulse_length_short << "µs, and "
-      << pulse_length_long << "µs took " << t << "ms." << std::endl;
+      << pulse_length_long << "µs took " << t << "ms.";
     } else lpd433_send_oneshotter_body();
   }};
 
@@ -407,39 +533,40 @@ std::thread buzz_oneshot(auto const &pi, int const gpio_index,
   std::chrono::duration<float> duration{t_seconds};
 
   auto const buzz_oneshotter{[&](){
+    realtime::reset_thread();
+    timeline::Scope const scope{"io", "buzz", gpio_index};
     int response;
 
-    response = set_PWM_range(pi, gpio_index, range);
+    response = metrics::pigpio_result(set_PWM_range(pi, gpio_index, range));
     if (response < 0) {
-      if (cc::log_errors) std::cerr << log_error_prefix
-        << "setting PWM range: "
-        << pigpio_error(response) << std::endl;
+      if constexpr (cc::log_errors)
+        logging::error("pwm", response) << "setting PWM range";
       return;
     }
 
-    response = set_PWM_frequency(pi, gpio_index, frequency);
+    response = metrics::pigpio_result(
+      set_PWM_frequency(pi, gpio_index, frequency));
     if (response < 0) {
-      if (cc::log_errors) std::cerr << log_error_prefix
-        << "setting PWM frequency: "
-        << pigpio_error(response) << std::endl;
+      if constexpr (cc::log_errors)
+        logging::error("pwm", response) << "setting PWM frequency";
       return;
     }
 
-    response = set_PWM_dutycycle(pi, gpio_index, dutycycle);
+    response = metrics::pigpio_result(
+      set_PWM_dutycycle(pi, gpio_index, dutycycle));
     if (response < 0) {
-      if (cc::log_errors) std::cerr << log_error_prefix
-        << "starting PWM: "
-        << pigpio_error(response) << std::endl;
+      if constexpr (cc::log_errors)
+        logging::error("pwm", response) << "starting PWM";
       return;
     }
 
     std::this_thread::sleep_for(duration);
 
-    response = set_PWM_dutycycle(pi, gpio_index, 0u);
+    response = metrics::pigpio_result(
+      set_PWM_dutycycle(pi, gpio_index, 0u));
     if (response < 0) {
-      if (cc::log_errors) std::cerr << log_error_prefix
-        << "stopping PWM: "
-        << pigpio_error(response) << std::endl;
+      if constexpr (cc::log_errors)
+        logging::error("pwm", response) << "stopping PWM";
       return;
     }
   }};
@@ -0,0 +1,302 @@
+namespace logging {
+  // Asynchronous logging for code that runs on the sampling threads, where
+  // writing to the (synchronous, flushed) stderr on every failed read of a
+  // failing sensor would hold up the sampling and flood the log.
+  //
+  // A `Line` formats its message into a record in a buffer of the calling
+  // thread, which only it writes to, so logging needs neither locks nor
+  // allocations except when a thread logs for the first time. A `Drain`
+  // thread collects the records of all threads every `drain_interval`, in
+  // the order of their timestamps, and writes them to stderr. Identical
+  // records (same subsystem, pigpio error code and message) beyond
+  // `cc::log_rate_limit_burst` within `cc::log_rate_limit_window` are
+  // suppressed and only counted. If a buffer is full, records are dropped and
+  // counted rather than waited for.
+  //
+  // Levels are filtered at compile time as elsewhere: guarded by
+  // `if constexpr (cc::log_errors)` at the call site, a line costs nothing
+  // when the level is disabled, and `Line` itself does nothing either way.
+  //
+  // Without a running `Drain` (e.g. before it is started), lines are written
+  // to stderr right away.
+  //
+  // Code that does not run on the sampling threads, e.g. the setup, writing
+  // and control of `shortly` on the main thread, still writes its lines to
+  // stderr directly (see `log_error_prefix`), as that is not held up by them.
+  // Those lines carry no timestamp and may appear up to `drain_interval`
+  // ahead of records of the sampling threads logged before them.
+  //
+  // NOTE: Subsystems must outlive the records, e.g. be string literals.
+
+  enum struct Level { error, info };
+
+  bool constexpr enabled(Level const level) {
+    return level == Level::error ? cc::log_errors : cc::log_info;
+  }
+
+  std::size_t constexpr message_capacity{256u};
+
+  struct Record {
+    std::chrono::system_clock::time_point timestamp{};
+    Level level{};
+    std::string_view subsystem{};
+    // A pigpio error code, whose description is appended to the message
+    std::optional<int> code{};
+    std::array<char, message_capacity> message{};
+    std::size_t size{0u};
+
+    std::string_view text() const { return {message.data(), size}; }
+  };
+
+  // Records of one thread, in a ring that it appends to and the drain thread
+  // consumes from
+  class Buffer {
+    static std::size_t constexpr capacity{32u};
+
+    std::array<Record, capacity> records{};
+    std::atomic<std::size_t> head{0u};
+    std::atomic<std::size_t> tail{0u};
+
+  public:
+    // Returns the record to write next, or none if the ring is full
+    Record *reserve() {
+      auto const h{head.load(std::memory_order_relaxed)};
+      if (h - tail.load(std::memory_order_acquire) == capacity) return nullptr;
+      return &records[h % capacity];
+    }
+
+    void publish() {
+      head.store(head.load(std::memory_order_relaxed) + 1u,
+        std::memory_order_release);
+    }
+
+    template <class F>
+    void consume(F &&f) {
+      auto t{tail.load(std::memory_order_relaxed)};
+      auto const h{head.load(std::memory_order_acquire)};
+      for (; t != h; ++t) f(records[t % capacity]);
+      tail.store(t, std::memory_order_release);
+    }
+  };
+
+  std::atomic_bool draining{false};
+  // Lines being written into a buffer, which the final drain waits for
+  std::atomic<std::size_t> n_lines_buffering{0u};
+  std::atomic<std::uint64_t> n_dropped{0u};
+  // NOTE: Only taken when a thread logs for the first time and when draining.
+  std::mutex mutex{};
+  std::deque<Buffer> buffers{};
+  std::vector<Buffer *> buffers_free{};
+
+  // Writes into the message of a record, cutting off what does not fit
+  class MessageBuffer : public std::streambuf {
+  public:
+    void reset(Record &record) {
+      setp(record.message.data(), record.message.data() + message_capacity);
+    }
+
+    std::size_t size() const {
+      return static_cast<std::size_t>(pptr() - pbase());
+    }
+  };
+
+  // Thread-local state, whose buffer is handed on to the next new thread when
+  // the thread exits, as the sampling threads are many and short-lived
+  struct ThreadState {
+    Buffer *buffer{nullptr};
+    MessageBuffer message_buffer{};
+    std::ostream out{&message_buffer};
+    std::ios_base::fmtflags const flags_default{out.flags()};
+    // For lines that are written right away or dropped
+    Record record_scratch{};
+
+    ~ThreadState() {
+      if (buffer == nullptr) return;
+      std::lock_guard const lock{mutex};
+      buffers_free.push_back(buffer);
+    }
+
+    Buffer &thread_buffer() {
+      if (buffer == nullptr) {
+        std::lock_guard const lock{mutex};
+        if (buffers_free.empty()) buffer = &buffers.emplace_back();
+        else { buffer = buffers_free.back(); buffers_free.pop_back(); }
+      }
+      return *buffer;
+    }
+  };
+  thread_local ThreadState thread_state{};
+
+  std::ostream &write_record(std::ostream &out, Record const &record) {
+    auto const time{std::chrono::system_clock::to_time_t(record.timestamp)};
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    auto const milliseconds{std::chrono::duration_cast<
+      std::chrono::milliseconds>(record.timestamp.time_since_epoch()).count() %
+      1000};
+    out << (record.level == Level::error ? log_error_prefix : log_info_prefix)
+      << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << "."
+      << std::setfill('0') << std::setw(3) << milliseconds << std::setfill(' ')
+      << "Z " << record.subsystem << ": " << record.text();
+    if (record.code.has_value())
+      out << ": " << pigpio_error(*record.code) << " (" << *record.code << ")";
+    return out;
+  }
+
+  // A log line of `level`, which is written when it is destroyed, i.e. at the
+  // end of the statement
+  template <Level level>
+  class Line {
+    Record *record{nullptr};
+    bool buffered{false};
+
+  public:
+    Line(std::string_view const subsystem, std::optional<int> const code) {
+      if constexpr (enabled(level)) {
+        auto &state{thread_state};
+        // NOTE: Announced before `draining` is checked, so that `~Drain`,
+        // which clears it before it waits for lines in progress, either sees
+        // this one or makes it go to stderr.
+        n_lines_buffering.fetch_add(1u);
+        if (draining.load()) {
+          record = state.thread_buffer().reserve();
+          buffered = record != nullptr;
+        }
+        if (not buffered) n_lines_buffering.fetch_sub(1u);
+        if (record == nullptr) record = &state.record_scratch;
+        *record = {std::chrono::system_clock::now(), level, subsystem, code};
+        state.message_buffer.reset(*record);
+        state.out.clear();
+        state.out.flags(state.flags_default);
+      }
+    }
+
+    ~Line() {
+      if constexpr (enabled(level)) {
+        auto &state{thread_state};
+        record->size = state.message_buffer.size();
+        if (buffered) {
+          state.buffer->publish();
+          n_lines_buffering.fetch_sub(1u, std::memory_order_release);
+        } else if (draining.load(std::memory_order_acquire))
+          n_dropped.fetch_add(1u, std::memory_order_relaxed);
+        else write_record(std::cerr, *record) << std::endl;
+      }
+    }
+
+    Line(Line const &) = delete;
+    Line &operator=(Line const &) = delete;
+
+    template <typename T>
+    Line &operator<<(T const &x) {
+      if constexpr (enabled(level)) thread_state.out << x;
+      return *this;
+    }
+
+    Line &operator<<(std::ios_base &(* const manipulator)(std::ios_base &)) {
+      if constexpr (enabled(level)) thread_state.out << manipulator;
+      return *this;
+    }
+  };
+
+  Line<Level::error> error(std::string_view const subsystem,
+      std::optional<int> const code = {}) {
+    return {subsystem, code};
+  }
+
+  Line<Level::info> info(std::string_view const subsystem,
+      std::optional<int> const code = {}) {
+    return {subsystem, code};
+  }
+
+  // Writes the records of all threads to stderr from a thread of its own,
+  // while it exists
+  class Drain {
+    using clock_t = std::chrono::steady_clock;
+
+    static std::chrono::milliseconds constexpr drain_interval{50};
+
+    struct Repetitions {
+      clock_t::time_point time_point_window{};
+      std::size_t n{0u};
+      Record record{};
+    };
+
+    std::atomic_bool stopping{false};
+    std::thread thread{};
+    std::vector<Record> records{};
+    std::unordered_map<std::string, Repetitions> repetitions{};
+
+    void write_suppressed(Repetitions const &r) {
+      if (r.n <= cc::log_rate_limit_burst) return;
+      write_record(std::cerr, r.record) << " (suppressed "
+        << r.n - cc::log_rate_limit_burst << " more time(s))\n";
+    }
+
+    void drain(bool const final = false) {
+      records.clear();
+      {
+        std::lock_guard const lock{mutex};
+        for (auto &b : buffers)
+          b.consume([&](Record const &r){ records.push_back(r); });
+      }
+      std::stable_sort(records.begin(), records.end(),
+        [](Record const &a, Record const &b){
+          return a.timestamp < b.timestamp; });
+
+      auto const now{clock_t::now()};
+      for (auto it{repetitions.begin()}; it != repetitions.end();)
+        if (final or now - it->second.time_point_window >=
+            cc::log_rate_limit_window) {
+          write_suppressed(it->second);
+          it = repetitions.erase(it);
+        } else ++it;
+
+      for (auto const &record : records) {
+        auto key{std::string{record.subsystem}};
+        key += '\0';
+        key += std::to_string(record.code.value_or(0));
+        key += '\0';
+        key += record.text();
+        auto &r{repetitions[key]};
+        if (r.n == 0u) r.time_point_window = now;
+        r.record = record;
+        if (++r.n <= cc::log_rate_limit_burst)
+          write_record(std::cerr, record) << "\n";
+      }
+      if (final) for (auto const &[_, r] : repetitions) write_suppressed(r);
+
+      if (auto const n{n_dropped.exchange(0u, std::memory_order_relaxed)};
+          n > 0u and cc::log_errors) std::cerr << log_error_prefix
+        << "dropped " << n << " log record(s), as their buffer was full."
+        << "\n";
+      std::cerr.flush();
+    }
+
+  public:
+    Drain() {
+      draining.store(true, std::memory_order_release);
+      thread = std::thread{[this](){
+          while (not stopping.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(drain_interval);
+            drain();
+          }
+        }};
+    }
+
+    // Lines started on other threads after this are written to stderr right
+    // away, and those in progress are waited for, so that the final drain
+    // collects every record
+    ~Drain() {
+      draining.store(false);
+      while (n_lines_buffering.load(std::memory_order_acquire) > 0u)
+        std::this_thread::yield();
+      stopping.store(true, std::memory_order_relaxed);
+      thread.join();
+      drain(true);
+    }
+
+    Drain(Drain const &) = delete;
+    Drain &operator=(Drain const &) = delete;
+  };
+} // namespace logging
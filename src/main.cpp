@@ -1,6 +1,6 @@
 // #include "includes.h" // Commented out, because CMake handles this
 
-#include "machine.generated.cpp"
+#include "generated/machine.generated.cpp"
 
 namespace cc { // `cc` stands for compile-time constants
   // NOTE: I splitted this namespace into several blocks for organizational
@@ -12,6 +12,22 @@ namespace cc { // `cc` stands for compile-time constants
     bool constexpr ndebug{false};
   #endif
 
+  #ifdef SIMULATE_SENSORS
+    bool constexpr simulate_sensors{true};
+  #else
+    bool constexpr simulate_sensors{false};
+  #endif
+
+  // The `bench-shortly` executable (see `CMakeLists.txt`) is built with
+  // `BENCH_SHORTLY` defined to the number of (virtual) sensors to sample
+  #ifdef BENCH_SHORTLY
+    bool constexpr bench_shortly{true};
+    std::size_t constexpr bench_shortly_n_sensors{BENCH_SHORTLY};
+  #else
+    bool constexpr bench_shortly{false};
+    std::size_t constexpr bench_shortly_n_sensors{0u};
+  #endif
+
   enum struct Host { lasse_raspberrypi_0, lasse_raspberrypi_1, other };
 
   auto constexpr host{
@@ -27,6 +43,10 @@ namespace cc {
   bool constexpr log_info{not ndebug};
   std::string_view constexpr log_info_string{"INFO"};
   std::string_view constexpr log_error_string{"ERROR"};
+  // Identical log records of the sampling threads beyond the burst within the
+  // window are suppressed (see `logging.cpp`)
+  std::size_t constexpr log_rate_limit_burst{3u};
+  std::chrono::seconds constexpr log_rate_limit_window{60};
 
   std::chrono::milliseconds constexpr sampling_interval{3000};
   unsigned constexpr samples_per_aggregate{5u};
@@ -41,12 +61,31 @@ namespace cc {
   std::string_view constexpr csv_delimiter_string{", "};
   std::string_view constexpr csv_false_string{"0"};
   std::string_view constexpr csv_true_string{"1"};
+  // Written instead of a value within its deadband with `shortly --deadband`
+  std::string_view constexpr csv_unchanged_string{"="};
+  // Every this many rows of a sensor, all of its values are written
+  unsigned constexpr deadband_keyframe_interval{20u};
+
+  // Adaptive sampling with `shortly --adaptive` (see `adaptive.cpp`)
+  unsigned constexpr adaptive_ticks_per_interval{2u};
+  unsigned constexpr adaptive_max_slowdown{4u};
+  double constexpr adaptive_rest_activity{.25};
+  double constexpr adaptive_smoothing{.25};
+  // A threshold counts as near within this many times its gap
+  float constexpr adaptive_threshold_proximity{2.f};
 
   int constexpr exit_code_success{0};
   int constexpr exit_code_error{1};
   int constexpr exit_code_interrupt{130};
 
   std::chrono::milliseconds constexpr wait_interval_min{100};
+
+  // Real-time scheduling with `shortly --realtime` (see `realtime.cpp`). The
+  // default priority is below that of the threaded interrupt handlers (50).
+  int constexpr realtime_priority_default{40};
+  std::size_t constexpr realtime_thread_stack_size{std::size_t{512u} << 10u};
+  std::size_t constexpr realtime_prefault_stack_size{std::size_t{256u} << 10u};
+  std::size_t constexpr realtime_prefault_heap_size{std::size_t{4u} << 20u};
   std::chrono::milliseconds constexpr trigger_time_safety_offset{
     sampling_interval / 2};
 
@@ -69,12 +108,26 @@ namespace cc {
 
   std::string_view constexpr basename_dir_data{"data"};
   std::string_view constexpr basename_dir_shortly{"shortly"};
+  std::string_view constexpr basename_dir_daily{"daily"};
+  std::string_view constexpr basename_dir_rollup{"rollup"};
   std::string_view constexpr
     basename_prefix_file_control_state{".control-state"};
   std::string_view constexpr
     basename_prefix_file_control_params{".control-params"};
   std::string_view constexpr
     basename_prefix_dir_control_triggers{".control-triggers"};
+  std::string_view constexpr basename_suffix_file_segment{"segment"};
+  std::string_view constexpr extension_file_segment_index{"idx"};
+  // NOTE: Has to be kept in sync with the pattern in `daily.py`.
+  std::string_view constexpr extension_file_raw{"raw"};
+  std::string_view constexpr basename_file_archive_index{"index.csv"};
+  // Encoded files and raw blocks with more rows are taken as corrupt, which is
+  // far more than those of a run hold (see `codec::rows_fit`)
+  std::uint64_t constexpr codec_rows_max{std::uint64_t{1u} << 16u};
+
+  std::uint32_t constexpr archive_lzma_dict_size{1u << 20u};
+  // NOTE: Has to be kept in sync with the settings in `daily.py`.
+  std::uint32_t constexpr daily_lzma_dict_size{1u << 24u};
 }
 
 std::string log_info_prefix;
@@ -83,8 +136,25 @@ std::string log_error_prefix;
 #include "util.cpp"
 #include "csv.cpp"
 #include "toml.cpp"
+#include "bench.cpp"
+#include "timeline.cpp"
+#include "perf.cpp"
+#include "metrics.cpp"
+#include "realtime.cpp"
+#ifdef SIMULATE_SENSORS
+  #include "simulation.cpp"
+#endif
+#include "logging.cpp"
+#include "engine.cpp"
+#include "trace.cpp"
 #include "io.cpp"
 #include "sensors.cpp"
+#include "segment.cpp"
+#include "archive.cpp"
+#include "query.cpp"
+#include "rollup.cpp"
+#include "adaptive.cpp"
+#include "test.cpp"
 
 enum struct MainMode {
   help,
@@ -95,7 +165,15 @@ enum struct MainMode {
   buzz_oneshot,
   control,
   shortly,
-  daily};
+  codec,
+  bench_csv,
+  bench_aggregation,
+  bench_micro,
+  decode_raw,
+  reconstruct,
+  query,
+  daily,
+  test};
 std::string main_mode_name(MainMode const &mode) {
   if (mode == MainMode::help          ) return "help";
   if (mode == MainMode::error         ) return "error";
@@ -105,7 +183,15 @@ std::string main_mode_name(MainMode const &mode) {
   if (mode == MainMode::buzz_oneshot  ) return "buzz-oneshot";
   if (mode == MainMode::control       ) return "control";
   if (mode == MainMode::shortly       ) return "shortly";
+  if (mode == MainMode::codec         ) return "codec";
+  if (mode == MainMode::bench_csv     ) return "bench-csv";
+  if (mode == MainMode::bench_aggregation) return "bench-aggregation";
+  if (mode == MainMode::bench_micro   ) return "bench-micro";
+  if (mode == MainMode::decode_raw    ) return "decode-raw";
+  if (mode == MainMode::reconstruct   ) return "reconstruct";
+  if (mode == MainMode::query         ) return "query";
   if (mode == MainMode::daily         ) return "daily";
+  if (mode == MainMode::test          ) return "test";
   return "";
 }
 
@@ -123,7 +209,15 @@ namespace cc {
       {MainMode::buzz_oneshot  , sensors::WriteFormat::csv },
       {MainMode::control       , sensors::WriteFormat::toml},
       {MainMode::shortly       , sensors::WriteFormat::csv },
-      {MainMode::daily         , sensors::WriteFormat::csv }};
+      {MainMode::codec         , sensors::WriteFormat::toml},
+      {MainMode::bench_csv     , sensors::WriteFormat::toml},
+      {MainMode::bench_aggregation, sensors::WriteFormat::toml},
+      {MainMode::bench_micro   , sensors::WriteFormat::csv },
+      {MainMode::decode_raw    , sensors::WriteFormat::csv },
+      {MainMode::reconstruct   , sensors::WriteFormat::csv },
+      {MainMode::query         , sensors::WriteFormat::csv },
+      {MainMode::daily         , sensors::WriteFormat::csv },
+      {MainMode::test          , sensors::WriteFormat::csv }};
 
   // Configuration of setup of physical sensors depending on machine
 
@@ -163,14 +257,13 @@ namespace cc {
 
   //
 
-  using sensors_tuple_t =
+  using sensors_tuple_t_host =
     std::conditional<host == Host::lasse_raspberrypi_0,
       sensors_tuple_t_lasse_raspberrypi_0,
     std::conditional<host == Host::lasse_raspberrypi_1,
       sensors_tuple_t_lasse_raspberrypi_1,
       std::tuple<>>::type>::type;
-  auto constexpr n_sensors{std::tuple_size_v<cc::sensors_tuple_t>};
-  sensors_tuple_t constexpr blueprint{};
+  auto constexpr n_sensors_host{std::tuple_size_v<sensors_tuple_t_host>};
 
   auto constexpr get_names(
       std::integral_constant<Host, Host::lasse_raspberrypi_0>) {
@@ -182,8 +275,6 @@ namespace cc {
   auto constexpr get_names() {
     return get_names(std::integral_constant<Host, host>{}); }
 
-  auto constexpr sensors_physical_instance_names{get_names()};
-
   auto constexpr get_args(
       std::integral_constant<Host, Host::lasse_raspberrypi_0>) {
     return sensors_io_setup_args_lasse_raspberrypi_0; }
@@ -194,7 +285,57 @@ namespace cc {
   auto constexpr get_args() {
     return get_args(std::integral_constant<Host, host>{}); }
 
-  auto constexpr sensors_io_setup_args{get_args()};
+  // For `bench-shortly`, the physical sensors are followed by virtual copies
+  // of them, cycling through them, up to `bench_shortly_n_sensors` in total.
+  // The copies are named like `dht22_0_copy1`, so that the control only sees
+  // the physical ones.
+  auto constexpr n_sensors{std::max(n_sensors_host, bench_shortly_n_sensors)};
+
+  template <std::size_t... i>
+  auto constexpr replicate(auto const &xs, std::index_sequence<i...>) {
+    return std::make_tuple(std::get<i % n_sensors_host>(xs)...);
+  }
+
+  struct bench_shortly_names_t {
+    std::array<std::array<char, 32>, n_sensors> buffers{};
+
+    constexpr bench_shortly_names_t() {
+      std::string_view constexpr suffix{"_copy"};
+      for (std::size_t i{0u}; i < n_sensors; ++i) {
+        std::string_view const name{get_names()[i % n_sensors_host]};
+        auto it{std::copy(name.begin(), name.end(), buffers[i].begin())};
+        if (i < n_sensors_host) continue;
+        it = std::copy(suffix.begin(), suffix.end(), it);
+        char digits[8]{};
+        std::size_t n_digits{0u};
+        for (auto k{i / n_sensors_host}; k > 0u; k /= 10u)
+          digits[n_digits++] = static_cast<char>('0' + k % 10u);
+        std::reverse_copy(digits, digits + n_digits, it);
+      }
+    }
+  };
+  bench_shortly_names_t constexpr bench_shortly_names{};
+
+  using sensors_tuple_t = std::conditional<bench_shortly,
+    decltype(replicate(sensors_tuple_t_host{},
+      std::make_index_sequence<n_sensors>{})),
+    sensors_tuple_t_host>::type;
+  sensors_tuple_t constexpr blueprint{};
+
+  auto constexpr sensors_physical_instance_names{[](){
+      if constexpr (bench_shortly) {
+        std::array<char const *, n_sensors> names{};
+        for (std::size_t i{0u}; i < n_sensors; ++i)
+          names[i] = bench_shortly_names.buffers[i].data();
+        return names;
+      } else return get_names();
+    }()};
+
+  auto constexpr sensors_io_setup_args{[](){
+      if constexpr (bench_shortly)
+        return replicate(get_args(), std::make_index_sequence<n_sensors>{});
+      else return get_args();
+    }()};
 
   std::optional<int> constexpr
     lpd433_receiver_gpio_index{host == Host::lasse_raspberrypi_0
@@ -250,6 +391,19 @@ namespace {
     return true;
   }
 
+  // A sample of `s` on the event loop of `shortly --coroutines`, counted in
+  // the metrics of its sensor as with the sampling threads
+  template <class T>
+  engine::Task<T> sample_task(T const &s, auto const &clock,
+      auto const &sensor_io, auto const &name,
+      metrics::Sensor &sensor_metrics) {
+    timeline::Scope const scope{"sample", name};
+    sensor_metrics.samples_attempted.add();
+    auto x{co_await sensors::sample_async(s, clock, sensor_io)};
+    if (not x.timestamp.has_value()) sensor_metrics.samples_failed.add();
+    co_return x;
+  }
+
   bool interruptible_wait_until(auto const &clock, auto time_point) {
     while (true) {
       auto const now{clock.now()};
@@ -291,6 +445,7 @@ int main(int const argc, char const * const argv[]) {
   }
   if constexpr (cc::log_errors) log_error_prefix =
     "# " + args.front() + ": " + cc::log_error_string.data() + ": ";
+  logging::Drain const log_drain{};
 
   using key_t = std::string;
   using flag_t = bool;
@@ -298,8 +453,10 @@ int main(int const argc, char const * const argv[]) {
   using flags_t = std::unordered_map<key_t, flag_t>;
   using opts_t = std::unordered_map<key_t, opt_t>;
 
-  flags_t main_flags{};
-  opts_t main_opts{{"base-path", {}}, {"format", {}}};
+  flags_t main_flags{{"replay-real-time", false}};
+  opts_t main_opts{{"base-path", {}}, {"format", {}}, {"record", {}},
+    {"replay", {}}, {"timeline", {}}};
+  if constexpr (cc::simulate_sensors) main_opts["simulation"] = {};
   auto arg_itr{
     util::get_cmd_args(main_flags, main_opts, ++(args.begin()), args.end())};
 
@@ -311,7 +468,7 @@ int main(int const argc, char const * const argv[]) {
   else {
     using U = std::underlying_type_t<MainMode>;
     for (MainMode mode{MainMode::help};
-        static_cast<U>(mode) <= static_cast<U>(MainMode::daily);
+        static_cast<U>(mode) <= static_cast<U>(MainMode::test);
         mode = static_cast<MainMode>(static_cast<U>(mode) + U{1}))
       if (*arg_itr == main_mode_name(mode)) main_mode = mode;
     if constexpr (cc::log_errors) if (main_mode == MainMode::error) std::cerr
@@ -320,6 +477,27 @@ int main(int const argc, char const * const argv[]) {
     ++arg_itr;
   }
 
+  #ifdef SIMULATE_SENSORS
+    if (main_opts["simulation"].has_value() and
+        not simulation::configure(*main_opts["simulation"]))
+      main_mode = MainMode::error;
+  #endif
+
+  if (main_opts["record"].has_value() and main_opts["replay"].has_value()) {
+    if constexpr (cc::log_errors) std::cerr << log_error_prefix
+      << "`--record` and `--replay` are mutually exclusive." << std::endl;
+    main_mode = MainMode::error;
+  } else if (main_opts["record"].has_value()) {
+    if (not trace::record(*main_opts["record"])) main_mode = MainMode::error;
+  } else if (main_opts["replay"].has_value()) {
+    if (not trace::replay(*main_opts["replay"],
+        main_flags["replay-real-time"])) main_mode = MainMode::error;
+  }
+
+  if (main_opts["timeline"].has_value() and
+      not timeline::start(*main_opts["timeline"]))
+    main_mode = MainMode::error;
+
   sensors::WriteFormat const write_format{[&](){
       auto const &opt_format{main_opts["format"]};
       if (opt_format.has_value()) {
@@ -350,7 +528,9 @@ int main(int const argc, char const * const argv[]) {
   if (main_mode == MainMode::help or main_mode == MainMode::error) {
     std::cout << "Usage:\n"
       << "  " << args.front() << " \\\n"
-        "  [--base-path=<base path>] [--format=<format>] [--] \\\n"
+        "  [--base-path=<base path>] [--format=<format>] \\\n"
+        "  [--record=<file> | --replay=<file> [--replay-real-time]] \\\n"
+        "  [--timeline=<file>] [--] \\\n"
         "  mode [opts...] [--] [args...]\n"
         "\n"
         "  Each mode can be safely interrupted by pressing Ctrl+C or sending a "
@@ -372,6 +552,33 @@ int main(int const argc, char const * const argv[]) {
           "`toml`. The\n"
         "  default format depends on the `mode`.\n"
         "\n"
+        "  `--record` writes all I/O with the sensors, and the LPD433 codes "
+          "received by\n"
+        "  `shortly`, to a trace file, and `--replay` reads them from such a "
+          "file instead\n"
+        "  of the hardware, as fast as possible or, with `--replay-real-time`, "
+          "with the\n"
+        "  original timing of each call. `lpd433-listen` cannot be replayed.\n"
+        "\n"
+        "  `--timeline` records when `shortly` samples, aggregates, writes, "
+          "controls and\n"
+        "  waits, and each call to the hardware, and writes it to <file> at "
+          "the end of\n"
+        "  the run, in the Chrome trace event format (e.g. for\n"
+        "  `https://ui.perfetto.dev`).\n"
+        "\n"
+        "  If this binary was built with `SIMULATE_SENSORS`, all hardware is "
+          "simulated,\n"
+        "  and `--simulation=<key>=<value>,...` sets the parameters of the "
+          "simulation:\n"
+        "  `noise` (scale, default 1), `latency` (per transaction, default "
+          "1ms),\n"
+        "  `failure-rate` (default .01), `checksum-error-rate` (default .01), "
+          "`seed` and\n"
+        "  `lpd433-rate` (how often the LPD433 receiver has picked up a random "
+          "code when\n"
+        "  polled, default 0).\n"
+        "\n"
         "Modes:\n"
         "  help\n"
         "    Print this usage message.\n"
@@ -461,13 +668,98 @@ int main(int const argc, char const * const argv[]) {
         "\n"
         "    If no flags are given, show all.\n"
         "\n"
-        "  shortly [--now] [--write-control[=<file path>]]\n"
+        "  shortly [--now] [--write-control[=<file path>]] [--segment] "
+          "[--archive] \\\n"
+        "  [--rollup] [--raw] [--deadband] [--adaptive] [--perf-counters] \\\n"
+        "  [--metrics-file=<file>] [--metrics-port=<port>] \\\n"
+        "  [--realtime[=<priority>]] [--realtime-cpu=<cpu>] [--coroutines]\n"
         "    The main mode which samples sensors at periodic time points and "
              "writes the\n"
         "    data into CSV files.\n"
         "\n"
         "    Writes to stdout if `--base-path` is not passed.\n"
         "\n"
+        "    `--segment` appends the data of all sensors to a single "
+            "per-day segment file\n"
+        "    (`<date>-segment.csv`) instead of creating one file per sensor "
+            "and run. The\n"
+        "    start time and byte offset of each run are recorded in the "
+            "sidecar index\n"
+        "    file `<date>-segment.csv.idx`.\n"
+        "\n"
+        "    `--archive` compresses the data of the run as soon as it is "
+            "finished and\n"
+        "    appends it to the day's partial archive\n"
+        "    `data/daily/<host>/<date>.tar.xz.part`, so that the `daily` mode "
+            "only has to\n"
+        "    finalize and verify it.\n"
+        "\n"
+        "    `--rollup` also folds the aggregates into per-minute, hourly and "
+            "daily\n"
+        "    summaries, written as their periods close to\n"
+        "    `data/rollup/<host>/{minutely,hourly,daily}/<prefix>-<name>.csv` "
+            "with one\n"
+        "    file per day, month and year, respectively.\n"
+        "\n"
+        "    `--raw` also keeps the individual samples, which are written "
+            "per sensor and\n"
+        "    run in a compact binary encoding to `<prefix>-<name>.raw` next "
+            "to the CSV\n"
+        "    files, one block per aggregate (see `decode-raw`).\n"
+        "\n"
+        "    `--deadband` writes the fields that have a `deadband` in "
+            "`sensors.json` only\n"
+        "    when they change by more than it since they were last written, "
+            "and `=`\n"
+        "    otherwise. Every " << cc::deadband_keyframe_interval << "th row "
+            "of a sensor and file is written in full (see\n"
+        "    `reconstruct`).\n"
+        "\n"
+        "    `--adaptive` samples each sensor less often while its readings "
+            "are steady,\n"
+        "    and up to twice as often (as far as its hardware allows) while "
+            "they change\n"
+        "    quickly or a control threshold depending on it is near. "
+            "Aggregates start at\n"
+        "    the same time points as without it.\n"
+        "\n"
+        "    `--perf-counters` counts cycles, instructions, cache misses, "
+            "context\n"
+        "    switches and page faults of the process (where the kernel allows "
+            "it) per\n"
+        "    phase of the ticks (sample, aggregate, control, wait) and writes "
+            "them to\n"
+        "    `<prefix>-perf-counters.toml` next to the data files, or to "
+            "stderr if\n"
+        "    `--base-path` is not passed.\n"
+        "\n"
+        "    `--metrics-file` and `--metrics-port` export counters and gauges "
+            "of the run\n"
+        "    (samples attempted and failed per sensor, pigpio errors by code, "
+            "checksum\n"
+        "    failures, DHT timeouts, LPD433 codes, tick overruns, bytes "
+            "written, flush\n"
+        "    times) in the OpenMetrics text format, by replacing <file> "
+            "every sampling\n"
+        "    interval and/or over HTTP on <port> of the loopback interface, "
+            "while the run\n"
+        "    lasts.\n"
+        "\n"
+        "    `--realtime` samples on `SCHED_FIFO` with <priority> (default: "
+            << cc::realtime_priority_default << "),\n"
+        "    pinned to <cpu> (default: the last one, if there are several, "
+            "negative for\n"
+        "    none), with the memory locked and faulted in. The log and "
+            "metrics threads\n"
+        "    stay at normal priority. How late the ticks start is exported as "
+            "metrics.\n"
+        "\n"
+        "    `--coroutines` samples the sensors on an event loop in the main "
+            "thread, as\n"
+        "    coroutines that wait for their devices without blocking each "
+            "other, instead\n"
+        "    of starting a thread per sensor and sample.\n"
+        "\n"
         "    `--now` disables the default behaviour of waiting for the next "
             "full sampling\n"
         "    duration (counting from previous midnight) to finish before "
@@ -477,6 +769,100 @@ int main(int const argc, char const * const argv[]) {
             "environment\n"
         "    control circuit are written to stdout, or <file path>, if given.\n"
         "\n"
+        "  codec [--repeats=<n>] [--no-xz] [--write-encoded=<file path>] "
+          "files...\n"
+        "    Encode `shortly` CSV files (one sensor per file) with the native "
+            "column\n"
+        "    codec, decode them again and check that this reproduces the files "
+            "exactly\n"
+        "    (or, for files written with `shortly --deadband`, as "
+            "`reconstruct` writes\n"
+        "    them). Reports sizes and timings, averaged over <n> repetitions, "
+            "in\n"
+        "    comparison to a tar.xz archive of the same files with the "
+            "settings of\n"
+        "    `daily.py`.\n"
+        "\n"
+        "    `--no-xz` skips the xz comparison, e.g. to measure the memory "
+            "usage of the\n"
+        "    codec alone. `--write-encoded` writes the concatenated encoded "
+            "files to\n"
+        "    <file path>.\n"
+        "\n"
+        "  bench-csv [--repeats=<n>] files...\n"
+        "    Read `shortly` CSV files (one sensor per file) into rows of the "
+            "sensor's\n"
+        "    type, once with the vectorized reader and once line by line, "
+            "write them\n"
+        "    again and check that this reproduces the files exactly. Reports "
+            "the\n"
+        "    throughput of each, averaged over <n> repetitions.\n"
+        "\n"
+        "  bench-aggregation [--repeats=<n>] [--window=<window>] files...\n"
+        "    Read `shortly` CSV files (one sensor per file) and aggregate "
+            "their rows anew\n"
+        "    in windows of <window> rows (default: 64), once sample by sample "
+            "and once\n"
+        "    per column with the batch kernels. Reports the throughput of "
+            "each, averaged\n"
+        "    over <n> repetitions, and how many aggregates both write "
+            "differently. Means\n"
+        "    of floats may differ in the last digit, as the kernels sum in a "
+            "different\n"
+        "    order.\n"
+        "\n"
+        "  bench-micro [--cpu=<n>] [--samples=<n>] [--warmup=<n>] \\\n"
+        "  [--sample-time=<ms>] [--filter=<regex>] [--output=<file path>]\n"
+        "    Time the generated code on the hot path of `shortly` on "
+            "synthetic samples of\n"
+        "    each sensor: writing field names and fields in each format, "
+            "aggregation,\n"
+        "    TOML output, the threshold controller and (de-)serialization of "
+            "the control\n"
+        "    state and parameters. Each benchmark is run in <n> samples "
+            "(default: 20) of\n"
+        "    about <ms> milliseconds (default: 10) each, after <n> warmup "
+            "samples\n"
+        "    (default: 3). Writes one JSON line describing the build and one "
+            "per\n"
+        "    benchmark with statistics of the time per iteration to stdout, "
+            "or\n"
+        "    <file path>, if given.\n"
+        "\n"
+        "    `--cpu` pins the process to CPU <n>. `--filter` only runs the "
+            "benchmarks\n"
+        "    whose name matches <regex>.\n"
+        "\n"
+        "  decode-raw files...\n"
+        "    Decode the raw sample streams written by `shortly --raw` and "
+            "write them to\n"
+        "    stdout as CSV, one table per file.\n"
+        "\n"
+        "  reconstruct files...\n"
+        "    Read `shortly` CSV files (one sensor per file) written with "
+            "`--deadband` and\n"
+        "    write them to stdout with all values filled in, one table per "
+            "file.\n"
+        "\n"
+        "  query [--start=<time>] [--end=<time>] [--fields=<list>] "
+          "[--jobs=<n>] \\\n"
+        "  [names...]\n"
+        "    Select the data of the physical sensors <names...> (default: "
+            "all) between\n"
+        "    <time>s from the `shortly` files and the daily archives below "
+            "`--base-path`\n"
+        "    and write it to stdout as one CSV table ordered by time. Each "
+            "line holds the\n"
+        "    fields of one sensor. Times are UTC, given as `YYYY-MM-DD`,\n"
+        "    `YYYY-MM-DD HH:MM:SS` or seconds since epoch, and both ends are "
+            "inclusive.\n"
+        "\n"
+        "    `--fields` restricts the output to a comma-separated list of "
+            "fields (e.g.\n"
+        "    `temperature,humidity`), next to the timestamps. Files are "
+            "scanned on <n>\n"
+        "    threads (default: the number of cores).\n"
+        "\n"
         "  daily [opts...]\n"
         "    Calls a Python interpreter running the `daily.py` script with "
             "the\n"
@@ -485,6 +871,18 @@ int main(int const argc, char const * const argv[]) {
         "    according to the configuration of the present binary (as output "
             "by the\n"
         "    `print-config` subcommand).\n"
+        "\n"
+        "  test [suites...]\n"
+        "    Run the self-tests of <suites...> (default: all), which check "
+            "reading back\n"
+        "    what was written, including files cut short, queries and the "
+            "statistics\n"
+        "    against the expected results. The suites are `segment-index`, "
+            "`codec`,\n"
+        "    `query`, `statistics`, `batch`, `filter`, `rollup` and "
+            "`adaptive`. Each\n"
+        "    failed check is logged as an error and makes the exit status "
+            "nonzero.\n"
       << std::flush;
     if (main_mode == MainMode::error) return cc::exit_code_error;
   } else if (main_mode == MainMode::print_config) {
@@ -525,6 +923,8 @@ int main(int const argc, char const * const argv[]) {
         << io::toml::TOMLWrapper{std::make_pair("ndebug", cc::ndebug)}
         << io::toml::TOMLWrapper{std::make_pair("log_info", cc::log_info)}
         << io::toml::TOMLWrapper{std::make_pair("log_errors", cc::log_errors)}
+        << io::toml::TOMLWrapper{std::make_pair("simulate_sensors",
+            cc::simulate_sensors)}
         << "\n"
         << io::toml::TOMLWrapper{std::make_pair("process", args.front())};
       if (main_opts["base-path"].has_value()) out
@@ -631,6 +1031,12 @@ int main(int const argc, char const * const argv[]) {
         << "No LPD433 receiver configured in the present binary." << std::endl;
       return cc::exit_code_error;
     }
+    // NOTE: Its codes arrive through callbacks, which are not traced.
+    if (trace::replaying()) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`lpd433-listen` cannot be replayed." << std::endl;
+      return cc::exit_code_error;
+    }
 
     flags_t flags{};
     opts_t opts{{"n-bits-min", {}}, {"n-bits-max", {}}, {"glitch", {}}};
@@ -918,33 +1324,81 @@ int main(int const argc, char const * const argv[]) {
       return cc::exit_code_error;
     }
   } else if (main_mode == MainMode::shortly) {
-    flags_t flags{{"now", false}, {"write-control", false}};
-    opts_t opts{{"write-control", {}}};
+    flags_t flags{{"now", false}, {"write-control", false}, {"segment", false},
+      {"archive", false}, {"rollup", false}, {"raw", false},
+      {"deadband", false}, {"adaptive", false}, {"perf-counters", false},
+      {"realtime", false}, {"coroutines", false}};
+    opts_t opts{{"write-control", {}}, {"metrics-file", {}},
+      {"metrics-port", {}}, {"realtime", {}}, {"realtime-cpu", {}}};
     arg_itr = util::get_cmd_args(flags, opts, arg_itr, args.end());
 
     bool const write_control{
       flags["write-control"] or opts["write-control"].has_value()};
+    bool const write_segment{
+      flags["segment"] and main_opts["base-path"].has_value()};
+    bool const write_archive{
+      flags["archive"] and main_opts["base-path"].has_value()};
+    bool write_rollup{
+      flags["rollup"] and main_opts["base-path"].has_value()};
+    bool write_raw{flags["raw"] and main_opts["base-path"].has_value()};
+    bool const write_deadband{flags["deadband"]};
+    bool const sample_adaptive{flags["adaptive"]};
+    bool const sample_realtime{
+      flags["realtime"] or opts["realtime"].has_value()};
+    bool const sample_coroutines{flags["coroutines"]};
+
+    if (write_segment and write_format != sensors::WriteFormat::csv) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`--segment` is only supported (implemented) for `csv` output."
+        << std::endl;
+      return cc::exit_code_error;
+    }
+    if (write_rollup and write_format != sensors::WriteFormat::csv) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`--rollup` is only supported (implemented) for `csv` output."
+        << std::endl;
+      return cc::exit_code_error;
+    }
+    if (write_deadband and write_format != sensors::WriteFormat::csv) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`--deadband` is only supported (implemented) for `csv` output."
+        << std::endl;
+      return cc::exit_code_error;
+    }
+
+    // The event loop of the sampling with `--coroutines`
+    std::optional<engine::Loop> loop{};
+    if (sample_coroutines) loop.emplace();
 
-    if (not flags["now"])
+    // NOTE: Replaying at full speed and `bench-shortly` do not wait for the
+    // sampling interval.
+    bool const wait{not cc::bench_shortly and not trace::full_speed()};
+
+    if (not flags["now"] and wait)
       if (interruptible_wait_until(clock, time_point_next_shortly_run))
         return cc::exit_code_interrupt;
 
+    timeline::name_thread("main");
+
     std::chrono::high_resolution_clock const sampling_clock{};
     auto const time_point_system_reference{clock.now()};
     auto const time_point_reference{sampling_clock.now()};
 
     std::array<std::ofstream, cc::n_sensors> file_streams;
+    std::array<std::ofstream, cc::n_sensors> raw_streams;
+    std::ofstream segment_stream;
     auto const print_newlines{[&](){
         std::array<bool, cc::n_sensors> a;
-        for (auto &x : a) x = main_opts["base-path"].has_value() or
-          write_format != sensors::WriteFormat::csv;
+        for (auto &x : a) x = (main_opts["base-path"].has_value() and
+          not write_segment) or write_format != sensors::WriteFormat::csv;
         a[cc::n_sensors - 1] = true;
         return a;
       }()};
     auto const outs{[&](){
         std::array<std::ostream *, cc::n_sensors> a;
         std::transform(file_streams.begin(), file_streams.end(), a.begin(),
-          [&](auto &fs){
+          [&](auto &fs) -> std::ostream * {
+            if (write_segment) return &segment_stream;
             return main_opts["base-path"].has_value() ? &fs : &(std::cout) ; });
         return a;
       }()};
@@ -953,30 +1407,48 @@ int main(int const argc, char const * const argv[]) {
     std::ostream * const control_out{opts["write-control"].has_value() ?
       &control_file_stream : &(std::cout)};
 
+    perf::Counters perf_counters{};
+    metrics::Exporter metrics_exporter{};
+
+    // NOTE: Declared before the loop, so that the scopes of the last tick are
+    // recorded even when it is interrupted.
+    timeline::WriteOnExit const timeline_write_on_exit{};
+
     // NOTE: I am not sure if this is even needed. I think all file streams will
     // be closed anyway when they go out of scope.
     auto const close_files{[&](){
         if (main_opts["base-path"].has_value()) for (auto &fs : file_streams)
           if (fs.is_open()) fs.close();
+        for (auto &fs : raw_streams) if (fs.is_open()) fs.close();
+        if (segment_stream.is_open()) segment_stream.close();
         if (write_control and control_file_stream.is_open())
           control_file_stream.close();
+        trace::close();
+        perf_counters.write();
+        metrics_exporter.stop();
+        realtime::leave();
       }};
 
     bool error_during_resource_allocation;
 
+    auto const filename_prefix{[&](){
+        auto const ctime_filename{
+          std::chrono::system_clock::to_time_t(time_point_system_reference)};
+        char filename_prefix[21];
+        std::strftime(filename_prefix, sizeof(filename_prefix),
+          "%Y-%m-%d-%H-%M-%SZ", std::gmtime(&ctime_filename));
+        filename_prefix[20] = '\0';
+        return std::string{filename_prefix};
+      }()};
+    std::array<std::filesystem::path, cc::n_sensors> paths_file{};
+    std::array<std::filesystem::path, cc::n_sensors> paths_file_raw{};
+    std::filesystem::path path_file_segment{};
+    std::uint64_t segment_offset{0u};
+
     // Open files for writing
     if (main_opts["base-path"].has_value()) {
       error_during_resource_allocation = false;
 
-      auto const filename_prefix{[&](){
-          auto const ctime_filename{
-            std::chrono::system_clock::to_time_t(time_point_system_reference)};
-          char filename_prefix[21];
-          std::strftime(filename_prefix, sizeof(filename_prefix),
-            "%Y-%m-%d-%H-%M-%SZ", std::gmtime(&ctime_filename));
-          filename_prefix[20] = '\0';
-          return std::string{filename_prefix};
-        }()};
       auto const path_dir_shortly{std::filesystem::path{
         *main_opts["base-path"]} / cc::basename_dir_data /
         cc::basename_dir_shortly};
@@ -984,7 +1456,33 @@ int main(int const argc, char const * const argv[]) {
       if (not util::safe_is_directory(path_dir_shortly))
         return cc::exit_code_error;
 
-      util::for_constexpr([&](auto const &name, auto &fs){
+      if (write_segment) {
+        auto const dirname_file{path_dir_shortly / cc::hostname};
+        if (not util::safe_create_directory(dirname_file))
+          return cc::exit_code_error;
+
+        auto const path_file{segment::path_file_segment_get(dirname_file,
+          time_point_system_reference, sensors::write_format_ext(write_format))};
+        auto const offset_opt{segment::open(segment_stream, path_file)};
+        if (not offset_opt.has_value())
+          { close_files(); return cc::exit_code_error; }
+        path_file_segment = path_file;
+        segment_offset = *offset_opt;
+
+        auto const path_file_index{segment::path_file_index_get(path_file)};
+        segment::index_entry const entry{
+          std::chrono::duration_cast<cc::timestamp_duration_t>(
+            time_point_system_reference.time_since_epoch()).count(),
+          *offset_opt};
+        if (not segment::append_index_entry(path_file_index, entry))
+          { close_files(); return cc::exit_code_error; }
+
+        if constexpr (cc::log_info) std::cerr << log_info_prefix
+          << "Log for all sensors will be appended to " << path_file
+          << " at offset " << *offset_opt << ", indexed in " << path_file_index
+          << "." << std::endl;
+      } else util::for_constexpr([&](auto const &name, auto &fs,
+            auto &path_file_out){
           if (error_during_resource_allocation) return;
 
           auto const dirname_file{path_dir_shortly / cc::hostname};
@@ -999,11 +1497,35 @@ int main(int const argc, char const * const argv[]) {
 
           if (not util::safe_open(fs, path_file, std::ios::out))
             { error_during_resource_allocation = true; return; }
+          path_file_out = path_file;
 
           if constexpr (cc::log_info) std::cerr << log_info_prefix
             << "Log for " << name << " will be written to " << path_file << "."
             << std::endl;
-        }, cc::sensors_physical_instance_names, file_streams);
+        }, cc::sensors_physical_instance_names, file_streams, paths_file);
+      if (error_during_resource_allocation)
+        { close_files(); return cc::exit_code_error; }
+
+      if (write_raw) util::for_constexpr([&](auto const &name, auto &fs,
+            auto &path_file_out){
+          if (error_during_resource_allocation) return;
+
+          auto const dirname_file{path_dir_shortly / cc::hostname};
+          if (not util::safe_create_directory(dirname_file))
+            { error_during_resource_allocation = true; return; }
+
+          auto const path_file{dirname_file / (filename_prefix + "-" + name +
+            "." + std::string{cc::extension_file_raw})};
+          if (not util::safe_writeable(path_file) or
+              not util::safe_open(fs, path_file,
+                std::ios::out | std::ios::binary))
+            { error_during_resource_allocation = true; return; }
+          path_file_out = path_file;
+
+          if constexpr (cc::log_info) std::cerr << log_info_prefix
+            << "Samples of " << name << " will be written to " << path_file
+            << "." << std::endl;
+        }, cc::sensors_physical_instance_names, raw_streams, paths_file_raw);
       if (error_during_resource_allocation)
         { close_files(); return cc::exit_code_error; }
     }
@@ -1020,6 +1542,32 @@ int main(int const argc, char const * const argv[]) {
         << std::endl;
     }
 
+    // Open performance counters, writing their summary next to the data files
+    if (flags["perf-counters"]) {
+      std::optional<std::filesystem::path> path_file{};
+      if (main_opts["base-path"].has_value()) {
+        auto const dirname_file{std::filesystem::path{*main_opts["base-path"]}
+          / cc::basename_dir_data / cc::basename_dir_shortly / cc::hostname};
+        if (util::safe_create_directory(dirname_file))
+          path_file = dirname_file / (filename_prefix + "-perf-counters.toml");
+      }
+      if (not main_opts["base-path"].has_value() or path_file.has_value())
+        perf_counters.start(path_file);
+    }
+
+    // Register the metrics of the sensors and start exporting them
+    auto const sensors_metrics{util::map_constexpr([](auto const &name){
+        return &metrics::sensor(name); }, cc::sensors_physical_instance_names)};
+    {
+      auto const port{util::parse_arg_value(util::int_parser, opts,
+        "metrics-port", -1)};
+      metrics_exporter.start(opts["metrics-file"].has_value() ?
+        std::make_optional(std::filesystem::path{*opts["metrics-file"]}) :
+        std::optional<std::filesystem::path>{},
+        port >= 0 ? std::make_optional(port) : std::optional<int>{},
+        cc::sampling_interval);
+    }
+
     // Instantiate control parameters and state
     auto const path_file_control_params_opt{main_opts["base-path"].has_value() ?
       std::make_optional(control::path_file_control_params_get(
@@ -1070,6 +1618,25 @@ int main(int const argc, char const * const argv[]) {
             (*out), s, write_format, name, not print_newline); },
       cc::blueprint, cc::sensors_physical_instance_names, outs, print_newlines);
 
+    // NOTE: Like rollups, raw streams are disabled for the rest of the run if
+    // writing them fails, which is better than losing the aggregates as well.
+    auto const disable_raw_on_error{[&](std::ofstream const &fs,
+          std::filesystem::path const &path_file){
+        if (fs.good()) return;
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "writing to " << path_file << ": "
+          << util::ios_error_description(fs.rdstate())
+          << ", disabling raw streams for this run." << std::endl;
+        write_raw = false;
+      }};
+    if (write_raw) util::for_constexpr([&](auto const &s, auto const &name,
+          auto &fs, auto const &path_file){
+        if (not write_raw) return;
+        fs << codec::raw_header(s, std::string{name});
+        disable_raw_on_error(fs, path_file);
+      }, cc::blueprint, cc::sensors_physical_instance_names, raw_streams,
+      paths_file_raw);
+
     if (write_control) {
       sensors::write_field_names((*control_out),
         control::as_sensor(control_params, clock), write_format);
@@ -1079,70 +1646,1059 @@ int main(int const argc, char const * const argv[]) {
         control::as_sensor(control_state, clock), write_format);
     }
 
+    // Rollups of the aggregates, per sensor
+    // NOTE: Failing to read or write rollups does not stop the sampling, the
+    // rollups are just disabled for the rest of the run.
+    auto rollups{util::map_constexpr([&](auto const &s, auto const &name){
+        return rollup::Cascade<std::remove_cvref_t<decltype(s)>>{
+          std::string{name}, write_rollup ? std::filesystem::path{
+            *main_opts["base-path"]} / cc::basename_dir_data /
+            cc::basename_dir_rollup / cc::hostname :
+          std::filesystem::path{}};
+      }, cc::blueprint, cc::sensors_physical_instance_names)};
+    auto const timestamp_of{[](auto const &time_point){
+        return std::chrono::duration_cast<cc::timestamp_duration_t>(
+          time_point.time_since_epoch()); }};
+    auto const disable_rollup_on_error{[&](bool const okay){
+        if (okay or not write_rollup) return;
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "updating rollups, disabling them for this run." << std::endl;
+        write_rollup = false;
+      }};
+    if (write_rollup) {
+      disable_rollup_on_error(rollup::create_directories(
+        std::filesystem::path{*main_opts["base-path"]} / cc::basename_dir_data /
+        cc::basename_dir_rollup / cc::hostname));
+      util::for_constexpr([&](auto &r){
+          if (write_rollup) disable_rollup_on_error(
+            r.rebuild(timestamp_of(time_point_system_reference))); },
+        rollups);
+    }
+
+    // Change-only logging, per sensor and for the control state
+    auto deadbands{util::map_constexpr([](auto const &s){
+        return sensors::Deadband<std::remove_cvref_t<decltype(s)>>{};
+      }, cc::blueprint)};
+    sensors::Deadband<std::remove_cvref_t<decltype(
+      control::as_sensor(control_state, clock))>> control_deadband{};
+
+    // Removal of implausible values, per sensor (see `filter.cpp`)
+    auto filters{util::map_constexpr([](auto const &s){
+        return sensors::init_filter(s); }, cc::blueprint)};
+
+    // Sampling proceeds in ticks, which are the sampling interval unless
+    // sampling adaptively. Sensors are sampled at the ticks their schedule
+    // says, and the control ticks once per sampling interval with the latest
+    // sample of each sensor.
+    unsigned const ticks_per_interval{
+      sample_adaptive ? cc::adaptive_ticks_per_interval : 1u};
+    unsigned const ticks_per_aggregate{
+      cc::samples_per_aggregate * ticks_per_interval};
+    auto const tick_duration{cc::sampling_interval / ticks_per_interval};
+    auto schedules{util::map_constexpr([&](auto const &s){
+        return adaptive::Schedule<std::remove_cvref_t<decltype(s)>>{
+          ticks_per_interval, sensors::min_sampling_interval(s)};
+      }, cc::blueprint)};
+    auto const near_threshold{[&](std::string_view const &name){
+        bool near{false};
+        control::for_each_sensor_near_threshold(control_state, control_params,
+          [&](std::string_view const &n){ near = near or n == name; });
+        return near;
+      }};
+    std::remove_cvref_t<decltype(cc::blueprint)> xs{};
+
+    // The samples of the current aggregate, per sensor, in columnar layout
+    auto batches{util::map_constexpr([&](auto const &s){
+        auto columns{sensors::init_columns(s)};
+        sensors::reserve(columns, ticks_per_aggregate);
+        return columns;
+      }, cc::blueprint)};
+
+    // How late the sampling wakes up for each tick, in microseconds
+    std::vector<double> wakeup_latenesses{};
+    wakeup_latenesses.reserve(cc::aggregates_per_run * ticks_per_aggregate);
+    std::chrono::nanoseconds wakeup_lateness_max{0};
+
+    // Switch to real-time scheduling, after the log drain and the metrics
+    // exporter have been started at normal priority
+    if (sample_realtime) {
+      int const n_cpus{static_cast<int>(std::thread::hardware_concurrency())};
+      auto const cpu{util::parse_arg_value(util::int_parser, opts,
+        "realtime-cpu", n_cpus > 1 ? n_cpus - 1 : -1)};
+      realtime::enter(util::parse_arg_value(util::int_parser, opts,
+          "realtime", cc::realtime_priority_default),
+        cpu >= 0 ? std::make_optional(cpu) : std::optional<int>{});
+    }
+
     // Start sampling
     auto time_point_system_last{time_point_system_reference};
+    std::size_t n_samples{0u};
+    auto const usage_start{bench::usage()};
     for (unsigned aggregate_index{0u};
         aggregate_index < cc::aggregates_per_run;
         ++aggregate_index) {
 
-      auto aggregate{cc::blueprint};
-      auto state{util::map_constexpr([](auto const &s){
-        return sensors::init_state(s); }, cc::blueprint)};
-
-      for (unsigned sample_index{0u};
-          sample_index < cc::samples_per_aggregate;
-          ++sample_index) {
+      for (unsigned tick{0u}; tick < ticks_per_aggregate; ++tick) {
+        auto const tick_run{aggregate_index * ticks_per_aggregate + tick};
 
         if (quit_early) { close_files(); return cc::exit_code_interrupt; }
 
-        // NOTE: Turns out `std::future::get` is not marked const.
-        auto /*const*/ x_futures{util::map_constexpr(
-          [&](auto const &s, auto const &sensor_io){
-            return std::async(std::launch::async, [&](){
-              return sensors::sample(s, clock, sensor_io); });
-          }, cc::blueprint, sensor_ios)};
-        auto const xs{util::map_constexpr(
-          [&](auto /*const*/ &x_future){ return x_future.get(); }, x_futures)};
-
-        std::tie(aggregate, state) = util::tr(util::map_constexpr([](
-              auto const& a, auto const &s, auto const &x){
-            return aggregation_step(a, s, x);
-          }, aggregate, state, xs));
-
-        if ((sample_index + 1u) == cc::samples_per_aggregate) {
-          aggregate = util::map_constexpr([](auto const &a, auto const &s){
-              return aggregation_finish(a, s);
-            }, aggregate, state);
+        timeline::Scope const scope_tick{"shortly", "tick", tick_run};
+        perf_counters.enter(perf::Phase::sample);
+        auto const time_point_tick{sampling_clock.now()};
+
+        auto const collect{[&](auto &&x_new, auto &x, auto &f, auto &b,
+            auto &schedule, auto const &name){
+            timeline::Scope const scope{"shortly", "collect"};
+            x = std::move(x_new);
+            ++n_samples;
+            sensors::filter_step(f, x);
+            sensors::append(b, x);
+            if (sample_adaptive)
+              schedule.update(x, tick, tick_run, near_threshold(name));
+          }};
+        if (loop.has_value()) {
+          auto x_tasks{util::map_constexpr(
+            [&](auto const &s, auto const &sensor_io, auto const &schedule,
+                auto const &name, auto const &sensor_metrics){
+              using T = std::remove_cvref_t<decltype(s)>;
+              if (not schedule.due(tick))
+                return std::optional<engine::Task<T>>{};
+              return std::optional{sample_task(s, clock, sensor_io, name,
+                *sensor_metrics)};
+            }, cc::blueprint, sensor_ios, schedules,
+            cc::sensors_physical_instance_names, sensors_metrics)};
+          loop->run(x_tasks, cc::sensors_physical_instance_names);
+          util::for_constexpr([&](auto &x_task, auto &x, auto &f, auto &b,
+              auto &schedule, auto const &name){
+              if (x_task.has_value())
+                collect(x_task->result(), x, f, b, schedule, name);
+            }, x_tasks, xs, filters, batches, schedules,
+            cc::sensors_physical_instance_names);
+        } else {
+          // NOTE: Turns out `std::future::get` is not marked const.
+          auto /*const*/ x_futures{util::map_constexpr(
+            [&](auto const &s, auto const &sensor_io, auto const &schedule,
+                auto const &name, auto const &sensor_metrics){
+              using T = std::remove_cvref_t<decltype(s)>;
+              if (not schedule.due(tick)) return std::future<T>{};
+              return std::async(std::launch::async, [&](){
+                timeline::Scope const scope{"sample", name};
+                sensor_metrics->samples_attempted.add();
+                auto x{sensors::sample(s, clock, sensor_io)};
+                if (not x.timestamp.has_value())
+                  sensor_metrics->samples_failed.add();
+                return x; });
+            }, cc::blueprint, sensor_ios, schedules,
+            cc::sensors_physical_instance_names, sensors_metrics)};
+          util::for_constexpr([&](auto /*const*/ &x_future, auto &x, auto &f,
+              auto &b, auto &schedule, auto const &name){
+              if (x_future.valid())
+                collect(x_future.get(), x, f, b, schedule, name);
+            }, x_futures, xs, filters, batches, schedules,
+            cc::sensors_physical_instance_names);
+        }
+
+        if ((tick + 1u) == ticks_per_aggregate) {
+          timeline::Scope const scope_aggregate{"shortly", "aggregate"};
+          perf_counters.enter(perf::Phase::aggregate);
+          auto const aggregate{util::map_constexpr(
+            [](auto const &s, auto const &b){
+              auto const [a, state]{
+                aggregation_step(s, sensors::init_state(s), b)};
+              return aggregation_finish(a, state);
+            }, cc::blueprint, batches)};
+          if (write_raw) util::for_constexpr([&](auto const &b, auto &fs,
+                auto const &path_file){
+              if (not write_raw) return;
+              timeline::Scope const scope{"write", "raw"};
+              auto const block_opt{codec::raw_block(b)};
+              if (not block_opt.has_value()) {
+                if constexpr (cc::log_errors) std::cerr << log_error_prefix
+                  << "encoding samples for " << path_file << ", disabling "
+                  << "raw streams for this run." << std::endl;
+                write_raw = false;
+                return;
+              }
+              fs << *block_opt;
+              metrics::bytes_written.add(block_opt->size());
+              disable_raw_on_error(fs, path_file);
+            }, batches, raw_streams, paths_file_raw);
+          util::for_constexpr([](auto &b){ sensors::clear(b); }, batches);
 
           util::for_constexpr([&](auto const &a, std::ostream * const &out,
-            auto const &name, bool const &print_newline){
-              sensors::write_fields(
-                (*out), a, write_format, name, not print_newline); },
+            auto const &name, bool const &print_newline, auto &deadband){
+              timeline::Scope const scope{"write", name};
+              // NOTE: `tellp` fails on pipes, where nothing is counted.
+              auto const position{out->tellp()};
+              sensors::write_fields((*out), a, write_format, name,
+                not print_newline, write_deadband ?
+                  deadband.step(a) : decltype(deadband.step(a)){});
+              if (auto const p{out->tellp()}; position >= 0 and p >= position)
+                metrics::bytes_written.add(
+                  static_cast<std::uint64_t>(p - position)); },
             aggregate, outs, cc::sensors_physical_instance_names,
-            print_newlines);
+            print_newlines, deadbands);
+
+          // NOTE: Only flushed while exporting metrics, so that the bytes
+          // written that are exported have reached the files, and to time it.
+          if (metrics_exporter.running()) {
+            timeline::Scope const scope{"write", "flush"};
+            auto const tic{sampling_clock.now()};
+            for (auto * const out : outs) out->flush();
+            for (auto &fs : raw_streams) if (fs.is_open()) fs.flush();
+            metrics::flush_durations.observe(sampling_clock.now() - tic);
+          }
+
+          if (write_rollup) {
+            timeline::Scope const scope{"write", "rollup"};
+            auto const t{timestamp_of(time_point_system_reference +
+              cc::sampling_interval * aggregate_index *
+              cc::samples_per_aggregate)};
+            util::for_constexpr([&](auto &r, auto const &a){
+                if (write_rollup) disable_rollup_on_error(r.push(a, t)); },
+              rollups, aggregate);
+          }
         }
 
-        if (write_control) sensors::write_fields((*control_out),
-          control::as_sensor(control_state, clock), write_format);
-        auto const time_point_system_now{clock.now()};
-        auto overrides{control::trigger_tick(triggers_pending,
-          time_point_system_last, time_point_system_now)};
-        control_state = control::control_tick(control_state, control_params,
-          xs, pi, lpd433_receiver_opt, overrides);
-        time_point_system_last = time_point_system_now;
+        if ((tick + 1u) % ticks_per_interval == 0u) {
+          perf_counters.enter(perf::Phase::control);
+          if (write_control) {
+            timeline::Scope const scope{"write", "control"};
+            auto const x{control::as_sensor(control_state, clock)};
+            sensors::write_fields((*control_out), x, write_format, {}, false,
+              write_deadband ? control_deadband.step(x) :
+                decltype(control_deadband.step(x)){});
+          }
+          auto const time_point_system_now{clock.now()};
+          auto overrides{control::trigger_tick(triggers_pending,
+            time_point_system_last, time_point_system_now)};
+          timeline::Scope const scope{"shortly", "control_tick"};
+          control_state = control::control_tick(control_state, control_params,
+            xs, pi, lpd433_receiver_opt, overrides);
+          time_point_system_last = time_point_system_now;
+        }
 
         auto const time_point_next_sample{time_point_reference +
-          cc::sampling_interval * (aggregate_index * cc::samples_per_aggregate +
-          sample_index + 1u)};
-        if (interruptible_wait_until(sampling_clock, time_point_next_sample))
+          tick_duration * (tick_run + 1u)};
+        auto const time_point_tick_end{sampling_clock.now()};
+        metrics::ticks.add();
+        metrics::tick_duration_in_seconds.set(std::chrono::duration<double>{
+          time_point_tick_end - time_point_tick}.count());
+        if (wait and time_point_tick_end > time_point_next_sample)
+          metrics::tick_overruns.add();
+        timeline::Scope const scope_wait{"shortly", "wait"};
+        perf_counters.enter(perf::Phase::wait);
+        if (wait and
+            interruptible_wait_until(sampling_clock, time_point_next_sample))
           { close_files(); return cc::exit_code_interrupt; }
+        if (wait) {
+          auto const lateness{std::chrono::duration_cast<
+            std::chrono::nanoseconds>(
+              sampling_clock.now() - time_point_next_sample)};
+          metrics::wakeup_lateness.observe(lateness);
+          wakeup_lateness_max = std::max(wakeup_lateness_max, lateness);
+          metrics::wakeup_lateness_max_in_seconds.set(
+            std::chrono::duration<double>{wakeup_lateness_max}.count());
+          wakeup_latenesses.push_back(
+            std::chrono::duration<double, std::micro>{lateness}.count());
+        }
       }
     }
 
+    if (sample_realtime) realtime::leave();
+
+    if constexpr (cc::log_info) if (not wakeup_latenesses.empty()) {
+      auto const s{bench::stats(wakeup_latenesses)};
+      std::cerr << log_info_prefix << "Woke up late for the ticks by "
+        << s.median << "µs (median), " << s.mean << "µs ± " << s.stddev
+        << "µs (mean) and " << s.max << "µs (max) "
+        << (sample_realtime ? "with" : "without") << " `--realtime`."
+        << std::endl;
+    }
+
+    if constexpr (cc::bench_shortly)
+      bench::report(std::cerr, usage_start, bench::usage(), cc::n_sensors,
+        n_samples);
+
+    if constexpr (cc::log_info) if (sample_adaptive)
+      util::for_constexpr([&](auto const &schedule, auto const &name){
+          std::cerr << log_info_prefix << "Sampled " << name << " "
+            << schedule.n_samples() << " times (" << cc::samples_per_aggregate *
+            cc::aggregates_per_run << " without `--adaptive`)." << std::endl;
+        }, schedules, cc::sensors_physical_instance_names);
+
+    if (write_rollup) util::for_constexpr([&](auto &r){
+        if (write_rollup) disable_rollup_on_error(r.close_until(
+          timestamp_of(time_point_system_reference + duration_shortly_run))); },
+      rollups);
+
     if (path_file_control_state_opt.has_value())
       safe_serialize(control_state, *path_file_control_state_opt);
 
     close_files();
+
+    // Append this run's data to the day's partial archive
+    if (write_archive) {
+      auto const path_dir_daily{std::filesystem::path{
+        *main_opts["base-path"]} / cc::basename_dir_data /
+        cc::basename_dir_daily};
+      auto const dirname_file{path_dir_daily / cc::hostname};
+      if (not util::safe_is_directory(path_dir_daily) or
+          not util::safe_create_directory(dirname_file))
+        return cc::exit_code_error;
+
+      std::int64_t const mtime{std::chrono::duration_cast<
+        std::chrono::seconds>(clock.now().time_since_epoch()).count()};
+      std::vector<archive::member> members{};
+      if (write_segment) {
+        auto const data_opt{
+          archive::read_file(path_file_segment, segment_offset)};
+        if (not data_opt.has_value()) return cc::exit_code_error;
+        members.emplace_back(filename_prefix + "-" +
+          std::string{cc::basename_suffix_file_segment} + "." +
+          sensors::write_format_ext(write_format), *data_opt, mtime);
+      } else for (auto const &path_file : paths_file) {
+        auto const data_opt{archive::read_file(path_file)};
+        if (not data_opt.has_value()) return cc::exit_code_error;
+        members.emplace_back(path_file.filename().string(), *data_opt, mtime);
+      }
+      if (write_raw) for (auto const &path_file : paths_file_raw) {
+        auto const data_opt{archive::read_file(path_file)};
+        if (not data_opt.has_value()) return cc::exit_code_error;
+        members.emplace_back(path_file.filename().string(), *data_opt, mtime);
+      }
+      // Same order as `daily.py` would archive the files in
+      std::sort(members.begin(), members.end(),
+        [](auto const &m0, auto const &m1){ return m0.name < m1.name; });
+
+      if (not archive::append(archive::path_file_archive_part_get(
+          dirname_file, time_point_system_reference), members))
+        return cc::exit_code_error;
+    }
+  } else if (main_mode == MainMode::codec) {
+    if (write_format != sensors::WriteFormat::toml) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`" << sensors::write_format_ext(write_format) << "` output not "
+        << "supported (implemented) in mode `codec`." << std::endl;
+      return cc::exit_code_error;
+    }
+
+    flags_t flags{{"no-xz", false}};
+    opts_t opts{{"repeats", {}}, {"write-encoded", {}}};
+    arg_itr = util::get_cmd_args(flags, opts, arg_itr, args.end());
+    auto const repeats{std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "repeats", 1))};
+
+    // Read each file and pick the first sensor type whose header matches
+    struct codec_file {
+      archive::member csv;
+      std::optional<std::string> (*encode)(std::string_view);
+      std::optional<std::string> (*decode)(std::string_view);
+      // What decoding has to give if not `csv`, i.e. for files written with
+      // `shortly --deadband`, the file with the unchanged values filled in (as
+      // `reconstruct` writes it), as these are decoded as what they stand for
+      std::optional<std::string> reconstructed{};
+      std::string encoded{};
+    };
+    std::vector<codec_file> files{};
+    std::size_t n_files_skipped{0u};
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr) {
+      std::filesystem::path const path_file{*arg_itr};
+      auto data_opt{archive::read_file(path_file)};
+      if (not data_opt.has_value()) return cc::exit_code_error;
+      bool found{false};
+      util::for_constexpr([&](auto const &data){
+          using T = std::remove_cvref_t<decltype(data)>;
+          if (found or not codec::encode_csv<T>(*data_opt).has_value()) return;
+          found = true;
+          std::optional<std::string> reconstructed{};
+          if (data_opt->find(cc::csv_unchanged_string) != data_opt->npos) {
+            auto const read_opt{sensors::read_csv<T>(*data_opt)};
+            if (read_opt.has_value()) reconstructed =
+              sensors::write_csv(read_opt->first, read_opt->second);
+          }
+          files.push_back({{path_file.filename().string(),
+            std::move(*data_opt), 0}, codec::encode_csv<T>,
+            codec::decode_csv<T>, std::move(reconstructed)});
+        }, sensors::sensor_types_t{});
+      if (not found) {
+        if constexpr (cc::log_info) std::cerr << log_info_prefix
+          << "Skipping " << path_file << ", which can not be encoded "
+          << "losslessly." << std::endl;
+        ++n_files_skipped;
+      }
+    }
+    if (files.empty()) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << (n_files_skipped == 0u ? "No files given" :
+          "None of the files given can be encoded") << " in mode `codec`."
+        << std::endl;
+      return cc::exit_code_error;
+    }
+
+    using steady_clock = std::chrono::steady_clock;
+    auto const seconds_since{[](steady_clock::time_point const &tic){
+      return std::chrono::duration<double>{steady_clock::now() - tic}.count();
+    }};
+    double duration_encode{0.}, duration_decode{0.}, duration_tar_xz{0.};
+    bool round_trip_okay{true};
+    std::size_t size_tar_xz{0u};
+    for (int i{0}; i < repeats; ++i) {
+      auto tic{steady_clock::now()};
+      for (auto &file : files) file.encoded = *file.encode(file.csv.data);
+      duration_encode += seconds_since(tic);
+
+      tic = steady_clock::now();
+      for (auto const &file : files)
+        round_trip_okay &= file.decode(file.encoded) ==
+          (file.reconstructed.has_value() ? *file.reconstructed :
+            file.csv.data);
+      duration_decode += seconds_since(tic);
+
+      // The reference: what `daily.py` would produce from the same files
+      if (flags["no-xz"]) continue;
+      tic = steady_clock::now();
+      std::vector<archive::member> members{};
+      for (auto const &file : files) members.push_back(file.csv);
+      auto const tar_opt{archive::tar_members(members)};
+      if (not tar_opt.has_value()) return cc::exit_code_error;
+      auto const tar_xz_opt{
+        archive::xz_stream(*tar_opt, cc::daily_lzma_dict_size)};
+      if (not tar_xz_opt.has_value()) return cc::exit_code_error;
+      duration_tar_xz += seconds_since(tic);
+      size_tar_xz = tar_xz_opt->size();
+    }
+
+    std::size_t size_csv{0u}, size_codec{0u};
+    std::string encoded_concatenated{};
+    for (auto const &file : files) {
+      size_csv += file.csv.data.size();
+      size_codec += file.encoded.size();
+      encoded_concatenated += file.encoded;
+    }
+    if (opts["write-encoded"].has_value()) {
+      std::ofstream f;
+      if (not util::safe_open(f, *opts["write-encoded"],
+          std::ios::out | std::ios::trunc | std::ios::binary))
+        return cc::exit_code_error;
+      f.write(encoded_concatenated.data(),
+        static_cast<std::streamsize>(encoded_concatenated.size()));
+      f.close();
+      if (not f) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "writing " << *opts["write-encoded"] << ": "
+          << util::ios_error_description(f.rdstate()) << "." << std::endl;
+        return cc::exit_code_error;
+      }
+    }
+
+    auto const ratio{[&](std::size_t const size){
+      return size == 0u ? 0. :
+        static_cast<double>(size_csv) / static_cast<double>(size); }};
+    auto const throughput{[&](double const duration){
+      return static_cast<double>(size_csv) * repeats / duration / (1 << 20); }};
+    using io::toml::TOMLWrapper;
+    // NOTE: Unsigned integers would be written in hexadecimal
+    auto const count{[](std::size_t const n){
+      return static_cast<std::int64_t>(n); }};
+    std::cout
+      << TOMLWrapper{std::make_pair("number_files", count(files.size()))}
+      << TOMLWrapper{std::make_pair("number_files_skipped",
+          count(n_files_skipped))}
+      << TOMLWrapper{std::make_pair("repeats", repeats)}
+      << TOMLWrapper{std::make_pair("round_trip_okay", round_trip_okay)}
+      << "\n"
+      << TOMLWrapper{std::make_pair("size_csv_in_bytes", count(size_csv))}
+      << TOMLWrapper{std::make_pair("size_codec_in_bytes", count(size_codec))}
+      << TOMLWrapper{std::make_pair("ratio_codec", ratio(size_codec))}
+      << TOMLWrapper{std::make_pair("duration_encode_in_seconds",
+          duration_encode / repeats)}
+      << TOMLWrapper{std::make_pair("duration_decode_in_seconds",
+          duration_decode / repeats)}
+      << TOMLWrapper{std::make_pair("throughput_encode_in_mib_per_second",
+          throughput(duration_encode))}
+      << TOMLWrapper{std::make_pair("throughput_decode_in_mib_per_second",
+          throughput(duration_decode))};
+    if (not flags["no-xz"]) {
+      auto const codec_xz_opt{
+        archive::xz_stream(encoded_concatenated, cc::daily_lzma_dict_size)};
+      if (not codec_xz_opt.has_value()) return cc::exit_code_error;
+      std::cout
+        << "\n"
+        << TOMLWrapper{std::make_pair("size_tar_xz_in_bytes",
+            count(size_tar_xz))}
+        << TOMLWrapper{std::make_pair("size_codec_xz_in_bytes",
+            count(codec_xz_opt->size()))}
+        << TOMLWrapper{std::make_pair("ratio_tar_xz", ratio(size_tar_xz))}
+        << TOMLWrapper{std::make_pair("ratio_codec_xz",
+            ratio(codec_xz_opt->size()))}
+        << TOMLWrapper{std::make_pair("duration_tar_xz_in_seconds",
+            duration_tar_xz / repeats)}
+        << TOMLWrapper{std::make_pair("throughput_tar_xz_in_mib_per_second",
+            throughput(duration_tar_xz))};
+    }
+
+    if (not round_trip_okay) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "decoding did not reproduce all files exactly." << std::endl;
+      return cc::exit_code_error;
+    }
+  } else if (main_mode == MainMode::bench_csv) {
+    if (write_format != sensors::WriteFormat::toml) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`" << sensors::write_format_ext(write_format) << "` output not "
+        << "supported (implemented) in mode `bench-csv`." << std::endl;
+      return cc::exit_code_error;
+    }
+
+    flags_t flags{};
+    opts_t opts{{"repeats", {}}};
+    arg_itr = util::get_cmd_args(flags, opts, arg_itr, args.end());
+    auto const repeats{std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "repeats", 1))};
+
+    // Read each file and pick the first sensor type whose header matches. The
+    // functions return the number of rows read, or nothing on failure.
+    struct bench_csv_file {
+      std::string csv;
+      std::optional<std::size_t> (*read)(std::string_view, bool);
+      std::optional<std::string> (*round_trip)(std::string_view);
+    };
+    std::vector<bench_csv_file> files{};
+    std::size_t n_files_skipped{0u};
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr) {
+      std::filesystem::path const path_file{*arg_itr};
+      auto data_opt{archive::read_file(path_file)};
+      if (not data_opt.has_value()) return cc::exit_code_error;
+      bool found{false};
+      util::for_constexpr([&](auto const &data){
+          using T = std::remove_cvref_t<decltype(data)>;
+          if (found or not sensors::read_csv<T>(*data_opt).has_value()) return;
+          found = true;
+          files.push_back({std::move(*data_opt),
+            [](std::string_view const csv, bool const scalar){
+              auto const read_opt{sensors::read_csv<T>(csv, scalar)};
+              return read_opt.has_value() ?
+                std::optional<std::size_t>{n_rows(read_opt->second)} :
+                std::optional<std::size_t>{}; },
+            [](std::string_view const csv){
+              auto const read_opt{sensors::read_csv<T>(csv)};
+              return read_opt.has_value() ? std::optional<std::string>{
+                sensors::write_csv(read_opt->first, read_opt->second)} :
+                std::optional<std::string>{}; }});
+        }, sensors::sensor_types_t{});
+      if (not found) {
+        if constexpr (cc::log_info) std::cerr << log_info_prefix
+          << "Skipping " << path_file << ", which is not a file of a single "
+          << "sensor." << std::endl;
+        ++n_files_skipped;
+      }
+    }
+
+    using steady_clock = std::chrono::steady_clock;
+    auto const seconds_since{[](steady_clock::time_point const &tic){
+      return std::chrono::duration<double>{steady_clock::now() - tic}.count();
+    }};
+    double duration_read{0.}, duration_read_scalar{0.},
+      duration_round_trip{0.};
+    std::size_t n_rows{0u}, n_rows_scalar{0u};
+    bool round_trip_okay{true};
+    for (int i{0}; i < repeats; ++i) {
+      n_rows = n_rows_scalar = 0u;
+      auto tic{steady_clock::now()};
+      for (auto const &file : files)
+        n_rows += file.read(file.csv, false).value_or(0u);
+      duration_read += seconds_since(tic);
+
+      tic = steady_clock::now();
+      for (auto const &file : files)
+        n_rows_scalar += file.read(file.csv, true).value_or(0u);
+      duration_read_scalar += seconds_since(tic);
+
+      tic = steady_clock::now();
+      for (auto const &file : files)
+        round_trip_okay &= file.round_trip(file.csv) == file.csv;
+      duration_round_trip += seconds_since(tic);
+    }
+    round_trip_okay &= n_rows == n_rows_scalar;
+
+    std::size_t size_csv{0u};
+    for (auto const &file : files) size_csv += file.csv.size();
+    auto const throughput{[&](double const duration){
+      return static_cast<double>(size_csv) * repeats / duration / 1e9; }};
+    using io::toml::TOMLWrapper;
+    // NOTE: Unsigned integers would be written in hexadecimal
+    auto const count{[](std::size_t const n){
+      return static_cast<std::int64_t>(n); }};
+    std::cout
+      << TOMLWrapper{std::make_pair("number_files", count(files.size()))}
+      << TOMLWrapper{std::make_pair("number_files_skipped",
+          count(n_files_skipped))}
+      << TOMLWrapper{std::make_pair("number_rows", count(n_rows))}
+      << TOMLWrapper{std::make_pair("repeats", repeats)}
+      << TOMLWrapper{std::make_pair("round_trip_okay", round_trip_okay)}
+      << TOMLWrapper{std::make_pair("instruction_set",
+          std::string{io::csv::simd::instruction_set})}
+      << "\n"
+      << TOMLWrapper{std::make_pair("size_csv_in_bytes", count(size_csv))}
+      << TOMLWrapper{std::make_pair("duration_read_in_seconds",
+          duration_read / repeats)}
+      << TOMLWrapper{std::make_pair("duration_read_scalar_in_seconds",
+          duration_read_scalar / repeats)}
+      << TOMLWrapper{std::make_pair("duration_round_trip_in_seconds",
+          duration_round_trip / repeats)}
+      << TOMLWrapper{std::make_pair("throughput_read_in_gb_per_second",
+          throughput(duration_read))}
+      << TOMLWrapper{std::make_pair("throughput_read_scalar_in_gb_per_second",
+          throughput(duration_read_scalar))}
+      << TOMLWrapper{std::make_pair("throughput_round_trip_in_gb_per_second",
+          throughput(duration_round_trip))};
+
+    if (not round_trip_okay) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "writing the rows read did not reproduce all files exactly."
+        << std::endl;
+      return cc::exit_code_error;
+    }
+  } else if (main_mode == MainMode::bench_aggregation) {
+    if (write_format != sensors::WriteFormat::toml) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`" << sensors::write_format_ext(write_format) << "` output not "
+        << "supported (implemented) in mode `bench-aggregation`." << std::endl;
+      return cc::exit_code_error;
+    }
+
+    flags_t flags{};
+    opts_t opts{{"repeats", {}}, {"window", {}}};
+    arg_itr = util::get_cmd_args(flags, opts, arg_itr, args.end());
+    auto const repeats{std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "repeats", 1))};
+    auto const window{static_cast<std::size_t>(std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "window", 64)))};
+
+    // Each file is split into windows up front, once as rows for aggregating
+    // sample by sample and once as columns for the batch kernels, so that only
+    // the aggregation itself is timed. The function also returns the number
+    // of aggregates that are written differently by both ways.
+    struct bench_aggregation_result {
+      std::size_t n_samples;
+      std::size_t n_aggregates;
+      std::size_t n_aggregates_differing;
+      double duration_scalar;
+      double duration_batch;
+    };
+    using bench_aggregation_function_t =
+      bench_aggregation_result (*)(std::string_view, std::size_t, int);
+    std::vector<std::pair<std::string, bench_aggregation_function_t>> files{};
+    std::size_t n_files_skipped{0u};
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr) {
+      std::filesystem::path const path_file{*arg_itr};
+      auto data_opt{archive::read_file(path_file)};
+      if (not data_opt.has_value()) return cc::exit_code_error;
+      bool found{false};
+      util::for_constexpr([&](auto const &data){
+          using T = std::remove_cvref_t<decltype(data)>;
+          if (found or not sensors::read_csv<T>(*data_opt).has_value()) return;
+          found = true;
+          files.emplace_back(std::move(*data_opt),
+            [](std::string_view const csv, std::size_t const window,
+                int const repeats){
+              using steady_clock = std::chrono::steady_clock;
+              auto const seconds_since{[](steady_clock::time_point const &tic){
+                return std::chrono::duration<double>{
+                  steady_clock::now() - tic}.count(); }};
+
+              auto const columns{sensors::read_csv<T>(csv)->second};
+              std::vector<std::vector<T>> rows{};
+              std::vector<decltype(sensors::init_columns(T{}))> batches{};
+              for (std::size_t i{0u}; i < n_rows(columns); ++i) {
+                if (i % window == 0u) {
+                  rows.emplace_back();
+                  batches.push_back(sensors::init_columns(T{}));
+                }
+                rows.back().push_back(sensors::row_at(columns, i));
+                sensors::append(batches.back(), rows.back().back());
+              }
+
+              std::vector<T> aggregates_scalar(rows.size()),
+                aggregates_batch(batches.size());
+              bench_aggregation_result result{
+                n_rows(columns), rows.size(), 0u, 0., 0.};
+              for (int i{0}; i < repeats; ++i) {
+                auto tic{steady_clock::now()};
+                for (std::size_t j{0u}; j < rows.size(); ++j) {
+                  T a{};
+                  auto state{sensors::init_state(a)};
+                  for (auto const &x : rows[j])
+                    std::tie(a, state) = aggregation_step(a, state, x);
+                  aggregates_scalar[j] = aggregation_finish(a, state);
+                }
+                result.duration_scalar += seconds_since(tic);
+
+                tic = steady_clock::now();
+                for (std::size_t j{0u}; j < batches.size(); ++j) {
+                  auto const [a, state]{aggregation_step(
+                    T{}, sensors::init_state(T{}), batches[j])};
+                  aggregates_batch[j] = aggregation_finish(a, state);
+                }
+                result.duration_batch += seconds_since(tic);
+              }
+
+              // NOTE: The kernels sum floats in a different order, so means
+              // may differ in the last digit written. Summing one by one in
+              // `float` loses more precision over long windows, though, e.g.
+              // for air pressure.
+              for (std::size_t j{0u}; j < rows.size(); ++j) {
+                std::ostringstream ss_scalar{}, ss_batch{};
+                sensors::write_fields(ss_scalar, aggregates_scalar[j]);
+                sensors::write_fields(ss_batch, aggregates_batch[j]);
+                if (ss_scalar.str() != ss_batch.str())
+                  ++result.n_aggregates_differing;
+              }
+              return result; });
+        }, sensors::sensor_types_t{});
+      if (not found) {
+        if constexpr (cc::log_info) std::cerr << log_info_prefix
+          << "Skipping " << path_file << ", which is not a file of a single "
+          << "sensor." << std::endl;
+        ++n_files_skipped;
+      }
+    }
+
+    bench_aggregation_result total{0u, 0u, 0u, 0., 0.};
+    for (auto const &[csv, f] : files) {
+      auto const result{f(csv, window, repeats)};
+      total.n_samples += result.n_samples;
+      total.n_aggregates += result.n_aggregates;
+      total.n_aggregates_differing += result.n_aggregates_differing;
+      total.duration_scalar += result.duration_scalar / repeats;
+      total.duration_batch += result.duration_batch / repeats;
+    }
+
+    auto const throughput{[&](double const duration){
+      return static_cast<double>(total.n_samples) / duration / 1e6; }};
+    using io::toml::TOMLWrapper;
+    // NOTE: Unsigned integers would be written in hexadecimal
+    auto const count{[](std::size_t const n){
+      return static_cast<std::int64_t>(n); }};
+    std::cout
+      << TOMLWrapper{std::make_pair("number_files", count(files.size()))}
+      << TOMLWrapper{std::make_pair("number_files_skipped",
+          count(n_files_skipped))}
+      << TOMLWrapper{std::make_pair("number_samples", count(total.n_samples))}
+      << TOMLWrapper{std::make_pair("number_aggregates",
+          count(total.n_aggregates))}
+      << TOMLWrapper{std::make_pair("number_aggregates_differing",
+          count(total.n_aggregates_differing))}
+      << TOMLWrapper{std::make_pair("window", count(window))}
+      << TOMLWrapper{std::make_pair("repeats", repeats)}
+      << TOMLWrapper{std::make_pair("instruction_set",
+          std::string{batch::kernels::instruction_set})}
+      << "\n"
+      << TOMLWrapper{std::make_pair("duration_scalar_in_seconds",
+          total.duration_scalar)}
+      << TOMLWrapper{std::make_pair("duration_batch_in_seconds",
+          total.duration_batch)}
+      << TOMLWrapper{std::make_pair(
+          "throughput_scalar_in_megasamples_per_second",
+          throughput(total.duration_scalar))}
+      << TOMLWrapper{std::make_pair(
+          "throughput_batch_in_megasamples_per_second",
+          throughput(total.duration_batch))};
+  } else if (main_mode == MainMode::bench_micro) {
+    flags_t flags{};
+    opts_t opts{{"cpu", {}}, {"samples", {}}, {"warmup", {}},
+      {"sample-time", {}}, {"filter", {}}, {"output", {}}};
+    arg_itr = util::get_cmd_args(flags, opts, arg_itr, args.end());
+
+    bench::Options options{};
+    options.n_samples = static_cast<std::size_t>(std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "samples", 20)));
+    options.n_warmup = static_cast<std::size_t>(std::max(0,
+      util::parse_arg_value(util::int_parser, opts, "warmup", 3)));
+    options.sample_duration = std::chrono::milliseconds{std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "sample-time", 10))};
+    auto const cpu{util::parse_arg_value(util::int_parser, opts, "cpu", -1)};
+    if (cpu >= 0 and not bench::pin_to_cpu(cpu)) return cc::exit_code_error;
+
+    std::optional<std::regex> filter{};
+    if (opts["filter"].has_value()) {
+      try { filter = std::regex{*opts["filter"]}; }
+      catch (std::regex_error const &e) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "parsing filter \"" << *opts["filter"] << "\" (" << e.what()
+          << ")." << std::endl;
+        return cc::exit_code_error;
+      }
+    }
+
+    std::ofstream file_stream{};
+    if (opts["output"].has_value() and
+        not util::safe_open(file_stream, *opts["output"], std::ios::out))
+      return cc::exit_code_error;
+    std::ostream &out{
+      opts["output"].has_value() ? file_stream : std::cout};
+
+    // The build and settings, so that results are only compared as intended
+    out << std::boolalpha << "{\"hostname\": \"" << cc::hostname
+      << "\", \"compiler\": \"" << __VERSION__
+      << "\", \"ndebug\": " << cc::ndebug
+      << ", \"simulate_sensors\": " << cc::simulate_sensors
+      << ", \"cpu\": " << cpu << ", \"samples\": " << options.n_samples
+      << ", \"warmup\": " << options.n_warmup
+      << ", \"sample_time_in_ms\": " << std::chrono::duration_cast<
+        std::chrono::milliseconds>(options.sample_duration).count() << "}"
+      << std::endl;
+    bench::Suite suite{out, options, filter};
+
+    // NOTE: Output goes to a string stream that is rewound before each
+    // iteration, so that it does not grow.
+    std::ostringstream ss{};
+    util::for_constexpr([&](auto const &s, auto const &name){
+        auto const rows{
+          sensors::synthetic_rows(s, name, cc::samples_per_aggregate)};
+        for (auto const wf :
+            {sensors::WriteFormat::csv, sensors::WriteFormat::toml}) {
+          auto const suffix{"/" + sensors::write_format_ext(wf) + "/" + name};
+          suite.run("write_field_names" + suffix, [&](){
+              ss.seekp(0);
+              sensors::write_field_names(ss, s, wf, name); });
+          std::size_t i{0u};
+          suite.run("write_fields" + suffix, [&](){
+              ss.seekp(0);
+              sensors::write_fields(ss, rows[i++ % rows.size()], wf, name); });
+        }
+
+        auto batch{sensors::init_columns(s)};
+        for (auto const &row : rows) sensors::append(batch, row);
+        suite.run("aggregation/" + std::string{name}, [&](){
+            auto const [a, state]{
+              aggregation_step(s, sensors::init_state(s), batch)};
+            bench::do_not_optimize(aggregation_finish(a, state)); });
+      }, cc::blueprint, cc::sensors_physical_instance_names);
+
+    {
+      using io::toml::TOMLWrapper;
+      suite.run("toml_wrapper", [&](){
+          ss.seekp(0);
+          ss << TOMLWrapper{std::make_pair("hostname", cc::hostname)}
+            << TOMLWrapper{std::make_pair("sampling_interval", 3.), "s"}
+            << TOMLWrapper{std::make_pair("aggregates_per_run",
+                static_cast<std::int64_t>(cc::aggregates_per_run))}
+            << TOMLWrapper{std::make_pair("log_errors", cc::log_errors)}; });
+    }
+
+    // Of the threshold controller itself, as the generated function of each
+    // host switches outputs when a threshold is crossed
+    {
+      float hold_time_counter{0.f};
+      bool target{false};
+      std::size_t i{0u};
+      suite.run("threshold_controller_tick", [&](){
+          auto const input{20.f + .25f * static_cast<float>(i++ % 17u)};
+          auto const target_opt{control::threshold_controller_tick(3.f,
+            input, target, 22.f, 1.f, true, true, false, &hold_time_counter,
+            6.f, 600.f, std::optional<float>{}, 6.f, 600.f,
+            std::optional<float>{})};
+          if (target_opt.has_value()) target = *target_opt; });
+    }
+
+    std::filesystem::path path_file{};
+    try {
+      path_file = std::filesystem::temp_directory_path() /
+        "sensor-logging-bench-micro";
+    } catch (std::filesystem::filesystem_error const &e) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "finding a temporary directory (" << e.what() << ")." << std::endl;
+      return cc::exit_code_error;
+    }
+    control::control_state control_state{};
+    control::control_params control_params{};
+    suite.run("control_serialize/state", [&](){
+        control::serialize(control_state, path_file); });
+    suite.run("control_deserialize/state", [&](){
+        control::deserialize(control_state, path_file); });
+    suite.run("control_serialize/params", [&](){
+        control::serialize(control_params, path_file); });
+    suite.run("control_deserialize/params", [&](){
+        control::deserialize(control_params, path_file); });
+    control::file_clear(path_file);
+
+    if (not out.good()) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "writing results: " << util::ios_error_description(out.rdstate())
+        << "." << std::endl;
+      return cc::exit_code_error;
+    }
+  } else if (main_mode == MainMode::decode_raw) {
+    if (write_format != sensors::WriteFormat::csv) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`" << sensors::write_format_ext(write_format) << "` output not "
+        << "supported (implemented) in mode `decode-raw`." << std::endl;
+      return cc::exit_code_error;
+    }
+
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr) {
+      std::filesystem::path const path_file{*arg_itr};
+      auto const data_opt{archive::read_file(path_file)};
+      if (not data_opt.has_value()) return cc::exit_code_error;
+      std::optional<std::string> csv_opt{};
+      util::for_constexpr([&](auto const &data){
+          using T = std::remove_cvref_t<decltype(data)>;
+          if (not csv_opt.has_value())
+            csv_opt = codec::decode_raw<T>(*data_opt);
+        }, sensors::sensor_types_t{});
+      if (not csv_opt.has_value()) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << path_file << " is not a raw stream of any known sensor type, or "
+          << "it is corrupt." << std::endl;
+        return cc::exit_code_error;
+      }
+      std::cout << *csv_opt;
+    }
+  } else if (main_mode == MainMode::reconstruct) {
+    if (write_format != sensors::WriteFormat::csv) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`" << sensors::write_format_ext(write_format) << "` output not "
+        << "supported (implemented) in mode `reconstruct`." << std::endl;
+      return cc::exit_code_error;
+    }
+
+    // NOTE: Reading fills in the unchanged values already, so this only has to
+    // write the rows again.
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr) {
+      std::filesystem::path const path_file{*arg_itr};
+      auto const data_opt{archive::read_file(path_file)};
+      if (not data_opt.has_value()) return cc::exit_code_error;
+      std::optional<std::string> csv_opt{};
+      util::for_constexpr([&](auto const &data){
+          using T = std::remove_cvref_t<decltype(data)>;
+          if (csv_opt.has_value()) return;
+          auto const read_opt{sensors::read_csv<T>(*data_opt)};
+          if (read_opt.has_value()) csv_opt =
+            sensors::write_csv(read_opt->first, read_opt->second);
+        }, sensors::sensor_types_t{});
+      if (not csv_opt.has_value()) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << path_file << " is not a `shortly` file of any known sensor "
+          << "type." << std::endl;
+        return cc::exit_code_error;
+      }
+      std::cout << *csv_opt;
+    }
+  } else if (main_mode == MainMode::query) {
+    if (write_format != sensors::WriteFormat::csv) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`" << sensors::write_format_ext(write_format) << "` output not "
+        << "supported (implemented) in mode `query`." << std::endl;
+      return cc::exit_code_error;
+    }
+    if (not main_opts["base-path"].has_value()) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "`--base-path` option must be set in `query` mode." << std::endl;
+      return cc::exit_code_error;
+    }
+
+    flags_t flags{};
+    opts_t opts{{"start", {}}, {"end", {}}, {"fields", {}}, {"jobs", {}}};
+    arg_itr = util::get_cmd_args(flags, opts, arg_itr, args.end());
+
+    query::request request{query::timestamp_t::min(),
+      query::timestamp_t::max(), {},
+      std::chrono::duration_cast<query::timestamp_t>(duration_shortly_run)};
+    auto const parse_time_opt{[&](key_t const &key, query::timestamp_t &time){
+        if (not opts[key].has_value()) return true;
+        auto const time_opt{query::parse_time(*opts[key])};
+        if (not time_opt.has_value()) {
+          if constexpr (cc::log_errors) std::cerr << log_error_prefix
+            << "parsing time string `" << *opts[key] << "`." << std::endl;
+          return false;
+        }
+        time = *time_opt;
+        return true;
+      }};
+    if (not parse_time_opt("start", request.time_begin) or
+        not parse_time_opt("end", request.time_end))
+      return cc::exit_code_error;
+
+    std::vector<std::string> fields{};
+    if (opts["fields"].has_value()) {
+      std::istringstream ss{*opts["fields"]};
+      for (std::string field; std::getline(ss, field, ',');)
+        if (not field.empty()) fields.push_back(field);
+    }
+
+    // The columns of each sensor, as in the header of its files
+    std::vector<query::instance> instances{};
+    util::for_constexpr([&](auto const &s, auto const &name){
+        std::ostringstream ss{};
+        sensors::write_field_names(ss, s, sensors::WriteFormat::csv, name);
+        std::string header;
+        std::getline(std::istringstream{std::move(ss).str()}, header);
+        io::csv::FieldReader in{header};
+        query::instance i{name, {}};
+        for (auto field_opt{in.next()}; field_opt.has_value();
+            field_opt = in.next())
+          i.columns.emplace_back(field_opt->substr(1u, field_opt->size() - 2u));
+        instances.push_back(std::move(i));
+      }, cc::blueprint, cc::sensors_physical_instance_names);
+
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr) {
+      auto const itr{std::find_if(instances.begin(), instances.end(),
+        [&](auto const &i){ return i.name == *arg_itr; })};
+      if (itr == instances.end()) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "no physical sensor named `" << *arg_itr << "` on this host."
+          << std::endl;
+        return cc::exit_code_error;
+      }
+      request.instances.push_back(*itr);
+    }
+    if (request.instances.empty()) request.instances = instances;
+
+    // Projection: the timestamp and the requested fields, in the given order
+    if (not fields.empty()) {
+      std::set<std::string> fields_found{};
+      for (auto &i : request.instances) {
+        std::vector<std::string> columns{i.name + "_timestamp"};
+        for (auto const &field : fields) {
+          auto const column{i.name + "_" + field};
+          if (std::find(i.columns.cbegin(), i.columns.cend(), column) ==
+              i.columns.cend()) continue;
+          fields_found.insert(field);
+          if (column != columns.front()) columns.push_back(column);
+        }
+        i.columns = std::move(columns);
+      }
+      std::erase_if(request.instances, [](auto const &i){
+        return i.columns.size() <= 1u; });
+      for (auto const &field : fields) if (fields_found.count(field) == 0u) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "none of the selected sensors has a field `" << field << "`."
+          << std::endl;
+        return cc::exit_code_error;
+      }
+    }
+
+    auto const n_threads{static_cast<std::size_t>(std::max(1,
+      util::parse_arg_value(util::int_parser, opts, "jobs",
+        static_cast<int>(std::thread::hardware_concurrency()))))};
+    std::filesystem::path const path_dir_data{
+      std::filesystem::path{*main_opts["base-path"]} / cc::basename_dir_data};
+    auto const tasks_opt{query::plan(request,
+      path_dir_data / cc::basename_dir_shortly / cc::hostname,
+      path_dir_data / cc::basename_dir_daily / cc::hostname,
+      sensors::write_format_ext(write_format))};
+    if (not tasks_opt.has_value()) return cc::exit_code_error;
+
+    std::vector<query::row> rows{};
+    bool const success{query::run(*tasks_opt, n_threads, rows)};
+    query::write(std::cout, request, rows);
+    if constexpr (cc::log_info) std::cerr << log_info_prefix
+      << "Selected " << rows.size() << " rows in " << tasks_opt->size()
+      << " tasks on up to " << n_threads << " threads." << std::endl;
+    if (not success) return cc::exit_code_error;
   } else if (main_mode == MainMode::daily) {
     if (not main_opts["base-path"].has_value()) {
       if constexpr (cc::log_errors) std::cerr << log_error_prefix
@@ -1213,6 +2769,11 @@ int main(int const argc, char const * const argv[]) {
     auto const status_value{std::system(command.c_str())};
     if (WIFEXITED(status_value)) return WEXITSTATUS(status_value);
     return cc::exit_code_error;
+  } else if (main_mode == MainMode::test) {
+    std::vector<std::string> names{};
+    for (; arg_itr < args.end() and *arg_itr != "--"; ++arg_itr)
+      names.push_back(*arg_itr);
+    if (not test::run(names)) return cc::exit_code_error;
   }
 
   if (arg_itr < args.end() and *arg_itr == "--") ++arg_itr;
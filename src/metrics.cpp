@@ -0,0 +1,343 @@
+namespace metrics {
+  // Counters and gauges of the sampler, for monitoring many nodes. They are
+  // updated with relaxed atomic operations wherever something happens (the
+  // sampling threads, the I/O wrappers, the LPD433 threads, …), and a thread
+  // of `Exporter` writes them in the OpenMetrics text format to a file and/or
+  // serves them over HTTP on a local port, so that collecting them never
+  // waits on, or makes wait, the sampling.
+  //
+  // NOTE: Labelled series (per sensor) are registered before the sampling and
+  // the exporter start, and never removed, so reading them needs no lock.
+
+  class Counter {
+    std::atomic<std::uint64_t> value{0u};
+
+  public:
+    void add(std::uint64_t const n = 1u) {
+      value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const { return value.load(std::memory_order_relaxed); }
+  };
+
+  class Gauge {
+    std::atomic<double> value{0.};
+
+  public:
+    void set(double const x) { value.store(x, std::memory_order_relaxed); }
+
+    double get() const { return value.load(std::memory_order_relaxed); }
+  };
+
+  // Count and sum of durations, as an OpenMetrics summary without quantiles
+  class Summary {
+    Counter count{};
+    Counter sum_in_ns{};
+
+  public:
+    void observe(std::chrono::nanoseconds const duration) {
+      count.add();
+      sum_in_ns.add(static_cast<std::uint64_t>(
+        std::max(duration.count(), decltype(duration.count()){0})));
+    }
+
+    std::uint64_t n() const { return count.get(); }
+
+    double sum_in_seconds() const {
+      return static_cast<double>(sum_in_ns.get()) * 1e-9;
+    }
+  };
+
+  // Counters per error code, in a fixed table that codes are added to with a
+  // compare-and-swap on first use
+  class CountersByCode {
+    static std::size_t constexpr capacity{64u};
+    // NOTE: 0 marks a free slot, as it is no error code.
+    std::array<std::atomic<int>, capacity> codes{};
+    std::array<Counter, capacity> counters{};
+    Counter counter_overflow{};
+
+  public:
+    void add(int const code) {
+      auto const hash{static_cast<std::size_t>(code < 0 ? -code : code)};
+      for (std::size_t i{0u}; i < capacity; ++i) {
+        auto const slot{(hash + i) % capacity};
+        int expected{codes[slot].load(std::memory_order_acquire)};
+        if (expected == 0 and codes[slot].compare_exchange_strong(expected,
+            code, std::memory_order_acq_rel)) expected = code;
+        if (expected == code) { counters[slot].add(); return; }
+      }
+      counter_overflow.add();
+    }
+
+    // Calls `f` with each code seen so far, or `std::nullopt` for the codes
+    // that did not fit into the table, and its count
+    template <class F>
+    void for_each(F &&f) const {
+      for (std::size_t slot{0u}; slot < capacity; ++slot) {
+        auto const code{codes[slot].load(std::memory_order_acquire)};
+        if (code != 0) f(std::optional<int>{code}, counters[slot].get());
+      }
+      if (auto const n{counter_overflow.get()}; n > 0u)
+        f(std::optional<int>{}, n);
+    }
+  };
+
+  struct Sensor {
+    std::string name;
+    Counter samples_attempted{};
+    Counter samples_failed{};
+
+    explicit Sensor(std::string_view const name) : name{name} {}
+  };
+
+  std::deque<Sensor> sensors{};
+
+  // Registers the counters of sensor instance `name`, which must happen
+  // before the exporter starts
+  Sensor &sensor(std::string_view const name) {
+    return sensors.emplace_back(name);
+  }
+
+  CountersByCode pigpio_errors{};
+  Counter serial_checksum_failures{};
+  Counter dht_timeouts{};
+  Counter lpd433_codes_received{};
+  Counter lpd433_codes_sent{};
+  Counter ticks{};
+  Counter tick_overruns{};
+  Gauge tick_duration_in_seconds{};
+  Summary wakeup_lateness{};
+  Gauge wakeup_lateness_max_in_seconds{};
+  Counter bytes_written{};
+  Summary flush_durations{};
+
+  // Counts `result` as a pigpio error if it is one and returns it
+  int pigpio_result(int const result) {
+    if (result < 0) pigpio_errors.add(result);
+    return result;
+  }
+
+  // Writes all metrics in the OpenMetrics text format
+  std::ostream &write(std::ostream &out) {
+    std::string_view constexpr prefix{"sensor_logging_"};
+    auto const family{[&](std::string_view const name,
+        std::string_view const type, std::string_view const help){
+      out << "# TYPE " << prefix << name << " " << type << "\n"
+        << "# HELP " << prefix << name << " " << help << "\n"; }};
+    auto const counter{[&](std::string_view const name,
+        std::string_view const help, Counter const &c){
+      family(name, "counter", help);
+      out << prefix << name << "_total " << c.get() << "\n"; }};
+
+    family("samples_attempted", "counter", "Samples attempted per sensor.");
+    for (auto const &s : sensors) out << prefix
+      << "samples_attempted_total{sensor=\"" << s.name << "\"} "
+      << s.samples_attempted.get() << "\n";
+    family("samples_failed", "counter",
+      "Samples per sensor that returned no reading at all.");
+    for (auto const &s : sensors) out << prefix
+      << "samples_failed_total{sensor=\"" << s.name << "\"} "
+      << s.samples_failed.get() << "\n";
+    family("pigpio_errors", "counter", "Errors returned by pigpio, by code.");
+    pigpio_errors.for_each([&](std::optional<int> const &code,
+        std::uint64_t const n){
+      out << prefix << "pigpio_errors_total{code=\""
+        << (code.has_value() ? std::to_string(*code) : "other") << "\"} "
+        << n << "\n"; });
+    counter("serial_checksum_failures",
+      "Packets from serial sensors with a wrong checksum.",
+      serial_checksum_failures);
+    counter("dht_timeouts", "Readings of DHT sensors that timed out.",
+      dht_timeouts);
+    counter("lpd433_codes_received", "LPD433 codes received.",
+      lpd433_codes_received);
+    counter("lpd433_codes_sent", "LPD433 codes sent.", lpd433_codes_sent);
+    counter("ticks", "Ticks of the sampling loop.", ticks);
+    counter("tick_overruns",
+      "Ticks that ended after the next one was due.", tick_overruns);
+    family("tick_duration_seconds", "gauge",
+      "Time the last tick took before waiting for the next.");
+    out << prefix << "tick_duration_seconds "
+      << tick_duration_in_seconds.get() << "\n";
+    family("wakeup_lateness_seconds", "summary",
+      "Time by which the sampling woke up late for the next tick.");
+    out << prefix << "wakeup_lateness_seconds_count " << wakeup_lateness.n()
+      << "\n" << prefix << "wakeup_lateness_seconds_sum "
+      << wakeup_lateness.sum_in_seconds() << "\n";
+    family("wakeup_lateness_max_seconds", "gauge",
+      "Largest time by which the sampling woke up late in the run.");
+    out << prefix << "wakeup_lateness_max_seconds "
+      << wakeup_lateness_max_in_seconds.get() << "\n";
+    counter("written_bytes", "Bytes of data and raw samples written.",
+      bytes_written);
+    family("flush_duration_seconds", "summary",
+      "Time taken to flush the data files after each aggregate.");
+    out << prefix << "flush_duration_seconds_count " << flush_durations.n()
+      << "\n" << prefix << "flush_duration_seconds_sum "
+      << flush_durations.sum_in_seconds() << "\n";
+    return out << "# EOF\n";
+  }
+
+  // Writes the metrics to a file every `refresh_interval` (replacing it
+  // atomically, by renaming a temporary file) and/or answers HTTP requests on
+  // a port of the loopback interface with them, from a thread of its own
+  class Exporter {
+    std::optional<std::filesystem::path> path_file{};
+    std::chrono::milliseconds refresh_interval{};
+    int fd_listen{-1};
+    // NOTE: Written to by `stop` to wake up the thread.
+    int fd_stop{-1};
+    std::thread thread{};
+
+    bool write_file() const {
+      auto path_file_tmp{*path_file};
+      path_file_tmp += ".tmp";
+      {
+        std::ofstream fs{};
+        if (not util::safe_open(fs, path_file_tmp,
+            std::ios::out | std::ios::trunc)) return false;
+        write(fs).flush();
+        if (not fs.good()) {
+          if constexpr (cc::log_errors) std::cerr << log_error_prefix
+            << "writing metrics to " << path_file_tmp << ": "
+            << util::ios_error_description(fs.rdstate()) << "." << std::endl;
+          return false;
+        }
+      }
+      std::error_code ec{};
+      std::filesystem::rename(path_file_tmp, *path_file, ec);
+      if (ec) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "renaming " << path_file_tmp << " to " << *path_file << ": "
+          << ec.message() << "." << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    // NOTE: The request itself is not looked at, any request gets the metrics.
+    void serve(int const fd) const {
+      timeval const timeout{1, 0};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      std::array<char, 1024u> request{};
+      std::string received{};
+      while (received.find("\r\n\r\n") == received.npos) {
+        auto const n{::recv(fd, request.data(), request.size(), 0)};
+        if (n <= 0) return;
+        received.append(request.data(), static_cast<std::size_t>(n));
+        if (received.size() > 16u * request.size()) return;
+      }
+
+      std::ostringstream body{};
+      write(body);
+      auto const body_str{body.str()};
+      auto const response{std::string{"HTTP/1.1 200 OK\r\n"
+        "Content-Type: application/openmetrics-text; version=1.0.0; "
+          "charset=utf-8\r\n"
+        "Content-Length: "} + std::to_string(body_str.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body_str};
+      for (std::size_t sent{0u}; sent < response.size();) {
+        auto const n{::send(fd, response.data() + sent,
+          response.size() - sent, MSG_NOSIGNAL)};
+        if (n <= 0) return;
+        sent += static_cast<std::size_t>(n);
+      }
+    }
+
+    void run() {
+      timeline::name_thread("metrics");
+      auto time_point_refresh{std::chrono::steady_clock::now()};
+      while (true) {
+        if (path_file.has_value() and
+            std::chrono::steady_clock::now() >= time_point_refresh) {
+          write_file();
+          time_point_refresh += refresh_interval;
+        }
+        auto const timeout{path_file.has_value() ?
+          std::max(std::chrono::duration_cast<std::chrono::milliseconds>(
+            time_point_refresh - std::chrono::steady_clock::now()).count(),
+            std::chrono::milliseconds::rep{0}) : -1};
+        std::array<pollfd, 2> fds{{{fd_stop, POLLIN, 0},
+          {fd_listen, POLLIN, 0}}};
+        if (::poll(fds.data(), fd_listen < 0 ? 1u : 2u,
+            static_cast<int>(timeout)) < 0 and errno != EINTR) {
+          if constexpr (cc::log_errors) std::cerr << log_error_prefix
+            << "waiting for metrics requests: " << std::strerror(errno) << "."
+            << std::endl;
+          break;
+        }
+        if (fds[0].revents != 0) break;
+        if (fds[1].revents & POLLIN) {
+          int const fd{::accept4(fd_listen, nullptr, nullptr, SOCK_CLOEXEC)};
+          if (fd >= 0) { serve(fd); ::close(fd); }
+        }
+      }
+      if (path_file.has_value()) write_file();
+    }
+
+    bool listen(int const port) {
+      fd_listen = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      int const reuse{1};
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_port = htons(static_cast<std::uint16_t>(port));
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (fd_listen < 0 or setsockopt(fd_listen, SOL_SOCKET, SO_REUSEADDR,
+            &reuse, sizeof(reuse)) != 0 or
+          ::bind(fd_listen, reinterpret_cast<sockaddr const *>(&address),
+            sizeof(address)) != 0 or ::listen(fd_listen, 4) != 0) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "listening for metrics requests on port " << port << ": "
+          << std::strerror(errno) << "." << std::endl;
+        if (fd_listen >= 0) ::close(fd_listen);
+        fd_listen = -1;
+        return false;
+      }
+      return true;
+    }
+
+  public:
+    Exporter() = default;
+    Exporter(Exporter const &) = delete;
+    Exporter &operator=(Exporter const &) = delete;
+
+    ~Exporter() { stop(); }
+
+    // Starts exporting to `path_file_out` and/or on `port`, returning whether
+    // that succeeded. On failure, nothing is exported, but the sampling can
+    // go on regardless.
+    bool start(std::optional<std::filesystem::path> const &path_file_out,
+        std::optional<int> const &port,
+        std::chrono::milliseconds const refresh_interval_arg) {
+      if (not path_file_out.has_value() and not port.has_value()) return true;
+      if (port.has_value() and not listen(*port)) return false;
+      fd_stop = ::eventfd(0u, EFD_CLOEXEC);
+      if (fd_stop < 0) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "starting the metrics exporter: " << std::strerror(errno) << "."
+          << std::endl;
+        if (fd_listen >= 0) { ::close(fd_listen); fd_listen = -1; }
+        return false;
+      }
+      path_file = path_file_out;
+      refresh_interval = refresh_interval_arg;
+      thread = std::thread{[this](){ run(); }};
+      return true;
+    }
+
+    bool running() const { return thread.joinable(); }
+
+    // Stops exporting, after writing the metrics file a last time
+    void stop() {
+      if (not thread.joinable()) return;
+      std::uint64_t const one{1u};
+      [[maybe_unused]] auto const n{::write(fd_stop, &one, sizeof(one))};
+      thread.join();
+      ::close(fd_stop);
+      if (fd_listen >= 0) ::close(fd_listen);
+      fd_stop = fd_listen = -1;
+    }
+  };
+} // namespace metrics
@@ -0,0 +1,228 @@
+namespace perf {
+  // Hardware and software performance counters of the Linux `perf_event_open`
+  // interface, read around the phases of the ticks of a `shortly` run with
+  // `--perf-counters`, to see e.g. whether the sampling threads or the writing
+  // cost the cycles and cache misses, and how often a run is switched out.
+  //
+  // The counters follow the whole process, including threads started after
+  // them, so a phase is charged with everything the process did while the
+  // main thread was in it, e.g. the sampling threads during `sample`.
+  //
+  // Counters that cannot be opened (no PMU, e.g. in a virtual machine, or
+  // `kernel.perf_event_paranoid` too strict) are left out of the summary, and
+  // if the kernel may not be counted, only user space is. The software
+  // counters only count in the kernel, so they are then taken from
+  // `getrusage` instead. Since the Raspberry Pi has fewer hardware counters
+  // than are requested here, the kernel may multiplex them, and their counts
+  // are then scaled estimates.
+
+  struct Counter {
+    std::string_view name;
+    std::uint32_t type;
+    std::uint64_t config;
+    // The same count from the resource usage of the process, if there is one
+    std::uint64_t (*from_rusage)(rusage const &);
+  };
+
+  std::array<Counter, 5> constexpr counters{{
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, nullptr},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, nullptr},
+    {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, nullptr},
+    {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,
+      [](rusage const &r){
+        return static_cast<std::uint64_t>(r.ru_nvcsw + r.ru_nivcsw); }},
+    {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,
+      [](rusage const &r){
+        return static_cast<std::uint64_t>(r.ru_minflt + r.ru_majflt); }}}};
+
+  enum struct Phase : std::size_t { sample, aggregate, control, wait };
+
+  std::array<std::string_view, 4> constexpr phase_names{
+    "sample", "aggregate", "control", "wait"};
+
+  class Counters {
+    using clock_t = std::chrono::steady_clock;
+    using values_t = std::array<std::uint64_t, counters.size()>;
+
+    struct Totals {
+      std::size_t n_entries{0u};
+      clock_t::duration duration{};
+      values_t values{};
+    };
+
+    bool enabled{false};
+    bool kernel_excluded{false};
+    std::optional<std::filesystem::path> path_file{};
+    std::array<int, counters.size()> fds{};
+    std::array<int, counters.size()> errnos{};
+    std::optional<Phase> phase{};
+    clock_t::time_point time_point_last{};
+    values_t values_last{};
+    std::array<Totals, phase_names.size()> totals{};
+
+    static int open(Counter const &counter, bool const exclude_kernel) {
+      perf_event_attr attr{};
+      attr.type = counter.type;
+      attr.size = sizeof(attr);
+      attr.config = counter.config;
+      attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      attr.inherit = 1;
+      attr.exclude_kernel = exclude_kernel ? 1 : 0;
+      attr.exclude_hv = 1;
+      return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+        PERF_FLAG_FD_CLOEXEC));
+    }
+
+    // Whether counter `i` is taken from `getrusage`
+    bool from_rusage(std::size_t const i) const {
+      return kernel_excluded and counters[i].from_rusage != nullptr;
+    }
+
+    bool available(std::size_t const i) const {
+      return fds[i] >= 0 or from_rusage(i);
+    }
+
+    // NOTE: Unavailable counters stay at 0.
+    values_t read_values() const {
+      values_t values{};
+      rusage usage{};
+      if (kernel_excluded) getrusage(RUSAGE_SELF, &usage);
+      for (std::size_t i{0u}; i < fds.size(); ++i) {
+        if (from_rusage(i)) values[i] = counters[i].from_rusage(usage);
+        if (fds[i] < 0) continue;
+        // Value, time enabled and time running
+        std::array<std::uint64_t, 3> buffer{};
+        if (::read(fds[i], buffer.data(), sizeof(buffer)) !=
+            static_cast<ssize_t>(sizeof(buffer))) continue;
+        values[i] = buffer[2] == 0u or buffer[2] >= buffer[1] ? buffer[0] :
+          static_cast<std::uint64_t>(static_cast<double>(buffer[0]) *
+            static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]));
+      }
+      return values;
+    }
+
+  public:
+    Counters() { fds.fill(-1); }
+
+    ~Counters() { for (auto const fd : fds) if (fd >= 0) ::close(fd); }
+
+    Counters(Counters const &) = delete;
+    Counters &operator=(Counters const &) = delete;
+
+    // Opens the counters, for writing the summary to `path_file_out` later, or
+    // to stderr if not given. Returns whether any counter is available, but
+    // the run goes on either way.
+    bool start(std::optional<std::filesystem::path> const &path_file_out) {
+      if (path_file_out.has_value() and
+          not util::safe_writeable(*path_file_out)) return false;
+      path_file = path_file_out;
+
+      // Returns whether a counter may not count the kernel, in which case all
+      // of them are reopened without it, for comparable counts
+      auto const open_all{[&](){
+          for (std::size_t i{0u}; i < counters.size(); ++i) {
+            if (from_rusage(i)) continue;
+            fds[i] = open(counters[i], kernel_excluded);
+            errnos[i] = fds[i] < 0 ? errno : 0;
+            if (not kernel_excluded and
+                (errnos[i] == EACCES or errnos[i] == EPERM)) {
+              for (std::size_t j{0u}; j < i; ++j)
+                if (fds[j] >= 0) ::close(fds[j]);
+              fds.fill(-1);
+              return false;
+            }
+          }
+          return true;
+        }};
+      if (not open_all()) { kernel_excluded = true; open_all(); }
+
+      for (std::size_t i{0u}; i < counters.size(); ++i)
+        enabled = enabled or available(i);
+      if (not enabled) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "no performance counters available ("
+          << std::strerror(errnos.front()) << "), continuing without them."
+          << std::endl;
+        return false;
+      }
+      if constexpr (cc::log_info) {
+        for (std::size_t i{0u}; i < counters.size(); ++i) if (not available(i))
+          std::cerr << log_info_prefix << "Performance counter "
+            << counters[i].name << " is not available ("
+            << std::strerror(errnos[i]) << ")." << std::endl;
+        if (kernel_excluded) std::cerr << log_info_prefix
+          << "Performance counters only count user space, and context "
+          << "switches and page faults come from getrusage." << std::endl;
+      }
+      return true;
+    }
+
+    // Charges the counts since the last call to the phase that was entered
+    // then, and enters `next`, or none
+    void enter(std::optional<Phase> const next) {
+      if (not enabled) return;
+      auto const time_point{clock_t::now()};
+      auto const values{read_values()};
+      if (phase.has_value()) {
+        auto &t{totals[static_cast<std::size_t>(*phase)]};
+        ++t.n_entries;
+        t.duration += time_point - time_point_last;
+        for (std::size_t i{0u}; i < values.size(); ++i)
+          t.values[i] += values[i] - values_last[i];
+      }
+      phase = next;
+      time_point_last = time_point;
+      values_last = values;
+    }
+
+    void stop() { enter({}); }
+
+    // Writes the summary of the phases in TOML, returning whether that
+    // succeeded
+    bool write() {
+      if (not enabled) return true;
+      stop();
+
+      std::ofstream fs{};
+      if (path_file.has_value() and not util::safe_open(fs, *path_file,
+          std::ios::out | std::ios::trunc)) return false;
+      std::ostream &out{path_file.has_value() ? fs : std::cerr};
+
+      using io::toml::TOMLWrapper;
+      out << "# Performance counters per phase of the ticks of a `shortly` run"
+        << "\n";
+      for (std::size_t i{0u}; i < counters.size(); ++i) {
+        if (not available(i)) out << "# " << counters[i].name
+          << ": not available (" << std::strerror(errnos[i]) << ")\n";
+        else if (from_rusage(i)) out << "# " << counters[i].name
+          << ": from getrusage, as the kernel may not be counted\n";
+      }
+      out << TOMLWrapper{std::make_pair("kernel_excluded", kernel_excluded)};
+      for (std::size_t p{0u}; p < phase_names.size(); ++p) {
+        auto const &t{totals[p]};
+        // NOTE: Unsigned integers would be written in hexadecimal
+        out << "\n[" << phase_names[p] << "]\n"
+          << TOMLWrapper{std::make_pair("number_entries",
+              static_cast<std::int64_t>(t.n_entries))}
+          << TOMLWrapper{std::make_pair("duration_in_seconds",
+              std::chrono::duration<double>{t.duration}.count())};
+        for (std::size_t i{0u}; i < counters.size(); ++i) if (available(i))
+          out << TOMLWrapper{std::make_pair(counters[i].name,
+            static_cast<std::int64_t>(t.values[i]))};
+      }
+      out.flush();
+
+      if (not out.good()) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "writing performance counters: "
+          << util::ios_error_description(out.rdstate()) << "." << std::endl;
+        return false;
+      }
+      if constexpr (cc::log_info) if (path_file.has_value())
+        std::cerr << log_info_prefix << "Wrote performance counters to "
+          << *path_file << "." << std::endl;
+      return true;
+    }
+  };
+} // namespace perf
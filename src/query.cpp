@@ -0,0 +1,383 @@
+namespace query {
+  // Querying selects the data of some physical sensors within a time range from
+  // everything that has been logged on this host, i.e. the `shortly` files and
+  // segments as well as the partial and finalized daily archives, and merges it
+  // into one CSV table ordered by time.
+  //
+  // All file names start with the time at which the run (or day) started, so
+  // most files can be ruled out without opening them. Of finalized archives,
+  // only the xz streams that the index lists as overlapping with the time range
+  // are decompressed. The remaining work is split into tasks (one per file,
+  // segment run or xz stream) that are spread over a number of threads.
+
+  using timestamp_t = cc::timestamp_duration_t;
+
+  struct instance {
+    std::string name;
+    // Names of the projected columns, starting with the timestamp
+    std::vector<std::string> columns;
+  };
+
+  struct request {
+    // Inclusive time range
+    timestamp_t time_begin;
+    timestamp_t time_end;
+    std::vector<instance> instances;
+    // The time range covered by the files of a single `shortly` run
+    timestamp_t duration_run;
+  };
+
+  struct row {
+    timestamp_t timestamp;
+    std::size_t instance_index;
+    // The projected fields, joined by the CSV delimiter
+    std::string fields;
+  };
+
+  // Where the data of a task come from, in order of precedence for rows that
+  // are found more than once: a finalized archive is what the day ends up as,
+  // while a partial archive or a file still in the `shortly` directory may be
+  // cut short by a crash
+  enum class source { shortly, archive_partial, archive };
+
+  struct task {
+    source from;
+    std::function<bool(std::vector<row> &)> run;
+  };
+
+  // Parses a UTC time given as `YYYY-MM-DD`, as `YYYY-MM-DD HH:MM:SS` (with a
+  // space or `T` in the middle), or as seconds since epoch, like the timestamps
+  // in the data files
+  std::optional<timestamp_t> parse_time(std::string const &s) {
+    timestamp_t t;
+    if (io::csv::parse(s, t)) return {t};
+    for (auto const format :
+        {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d"}) {
+      std::istringstream iss{s}; std::tm when_tm{};
+      iss >> std::get_time(&when_tm, format);
+      if (not iss.fail() and
+          iss.peek() == std::istringstream::traits_type::eof())
+        return {std::chrono::duration_cast<timestamp_t>(
+          std::chrono::seconds{timegm(&when_tm)})};
+    }
+    return {};
+  }
+
+  struct file_info {
+    timestamp_t time_begin;
+    timestamp_t time_end;
+    // Physical sensor instance name, or `cc::basename_suffix_file_segment`
+    std::string name;
+  };
+
+  // Parses the name of a data file as written by `shortly` or `daily.py`, i.e.
+  // `<YYYY-MM-DD-HH-MM-SS>Z-<name>.<ext>` for a run's file or chunk of a
+  // segment, and `<YYYY-MM-DD>-segment.<ext>` for a whole segment
+  std::optional<file_info> parse_file_name(std::string const &basename,
+      std::string const &ext, timestamp_t const duration_run) {
+    // The extension is stripped first, so that the patterns are only compiled
+    // once rather than for each file of a scan.
+    static std::regex const run_regex{
+      "([0-9]{4}-[0-9]{2}-[0-9]{2}-[0-9]{2}-[0-9]{2}-[0-9]{2})Z-(.+)"};
+    static std::regex const segment_regex{"([0-9]{4}-[0-9]{2}-[0-9]{2})-" +
+      std::string{cc::basename_suffix_file_segment}};
+    std::string const suffix{"." + ext};
+    if (not basename.ends_with(suffix)) return {};
+    std::string const stem{basename, 0u, basename.size() - suffix.size()};
+    std::smatch match;
+    std::tm when_tm{};
+    if (std::regex_match(stem, match, run_regex)) {
+      std::istringstream iss{match[1].str()};
+      iss >> std::get_time(&when_tm, "%Y-%m-%d-%H-%M-%S");
+      if (iss.fail()) return {};
+      timestamp_t const begin{std::chrono::duration_cast<timestamp_t>(
+        std::chrono::seconds{timegm(&when_tm)})};
+      return {{begin, begin + duration_run, match[2].str()}};
+    }
+    if (std::regex_match(stem, match, segment_regex)) {
+      std::istringstream iss{match[1].str()};
+      iss >> std::get_time(&when_tm, "%Y-%m-%d");
+      if (iss.fail()) return {};
+      timestamp_t const begin{std::chrono::duration_cast<timestamp_t>(
+        std::chrono::seconds{timegm(&when_tm)})};
+      // NOTE: The last run of a day may end after midnight.
+      return {{begin, begin + std::chrono::days{1} + duration_run,
+        std::string{cc::basename_suffix_file_segment}}};
+    }
+    return {};
+  }
+
+  bool overlaps(request const &r, timestamp_t const time_begin,
+      timestamp_t const time_end) {
+    return time_begin <= r.time_end and time_end >= r.time_begin;
+  }
+
+  bool is_requested(request const &r, file_info const &info) {
+    return overlaps(r, info.time_begin, info.time_end) and
+      (info.name == cc::basename_suffix_file_segment or
+       std::any_of(r.instances.cbegin(), r.instances.cend(),
+         [&](instance const &i){ return i.name == info.name; }));
+  }
+
+  // Extracts the rows of the requested instances within the time range from
+  // CSV data. Each line starting with a quote is taken as a header line, which
+  // defines the columns of the lines following it, so this works for segments
+  // containing several runs as well. Fields written as unchanged (see `shortly
+  // --deadband`) are filled in from the lines before.
+  void scan(std::string_view const data, request const &r,
+      std::vector<row> &rows) {
+    // Per instance, the indices of its projected columns in the current header
+    // and their last values
+    std::vector<std::vector<std::optional<std::size_t>>>
+      indices(r.instances.size());
+    std::vector<std::vector<std::string_view>> values(r.instances.size());
+    std::vector<std::string_view> fields{};
+    io::csv::FieldScanner in{data};
+    while (not in.done()) {
+      fields.clear();
+      for (auto field_opt{in.next()}; field_opt.has_value();
+          field_opt = in.next())
+        fields.push_back(*field_opt);
+      in.next_line();
+      if (fields.front().empty() and fields.size() == 1u) continue;
+
+      if (fields.front().starts_with('"')) {
+        for (auto &field : fields)
+          if (field.size() >= 2u and field.front() == '"' and
+              field.back() == '"') field = field.substr(1u, field.size() - 2u);
+        for (std::size_t k{0u}; k < r.instances.size(); ++k) {
+          indices[k].clear();
+          values[k].assign(r.instances[k].columns.size(), {});
+          for (auto const &column : r.instances[k].columns) {
+            auto const itr{std::find(fields.cbegin(), fields.cend(), column)};
+            indices[k].push_back(itr == fields.cend() ? std::nullopt :
+              std::optional<std::size_t>{itr - fields.cbegin()});
+          }
+        }
+        continue;
+      }
+
+      for (std::size_t k{0u}; k < r.instances.size(); ++k) {
+        if (indices[k].empty() or not indices[k].front().has_value() or
+            *indices[k].front() >= fields.size()) continue;
+        for (std::size_t j{0u}; j < indices[k].size(); ++j) {
+          if (not indices[k][j].has_value() or
+              *indices[k][j] >= fields.size()) values[k][j] = {};
+          else if (fields[*indices[k][j]] != cc::csv_unchanged_string)
+            values[k][j] = fields[*indices[k][j]];
+        }
+        timestamp_t timestamp;
+        if (not io::csv::parse(values[k].front(), timestamp) or
+            timestamp < r.time_begin or timestamp > r.time_end) continue;
+        row x{timestamp, k, {}};
+        for (std::size_t j{0u}; j < indices[k].size(); ++j) {
+          if (j > 0u) x.fields += cc::csv_delimiter_string;
+          x.fields += values[k][j];
+        }
+        rows.push_back(std::move(x));
+      }
+    }
+  }
+
+  // Collects the tasks needed to answer the request `r` from the data in
+  // `path_dir_shortly` and `path_dir_daily`
+  std::optional<std::vector<task>> plan(request const &r,
+      std::filesystem::path const &path_dir_shortly,
+      std::filesystem::path const &path_dir_daily, std::string const &ext) {
+    std::vector<task> tasks{};
+    auto const scan_members{[&r](std::vector<archive::member> const &members,
+        std::vector<row> &rows){
+      for (auto const &m : members) scan(m.data, r, rows); }};
+
+    // Files still lying around in the `shortly` directory. These are also
+    // remembered, as they may be in a partial archive at the same time.
+    std::set<std::string> basenames_present{};
+    std::set<std::string> dates_segment_present{};
+    try {
+      if (std::filesystem::is_directory(path_dir_shortly))
+          for (auto const &entry :
+            std::filesystem::directory_iterator{path_dir_shortly}) {
+        if (not entry.is_regular_file()) continue;
+        auto const path_file{entry.path()};
+        auto const basename{path_file.filename().string()};
+        auto const info_opt{parse_file_name(basename, ext, r.duration_run)};
+        if (not info_opt.has_value()) continue;
+        basenames_present.insert(basename);
+        if (info_opt->name == cc::basename_suffix_file_segment)
+          dates_segment_present.insert(basename.substr(0u, 10u));
+        if (not is_requested(r, *info_opt)) continue;
+
+        auto const index{
+          segment::read_index(segment::path_file_index_get(path_file))};
+        if (info_opt->name != cc::basename_suffix_file_segment or
+            index.empty()) {
+          tasks.push_back({source::shortly,
+            [&r, path_file](std::vector<row> &rows){
+              auto const data_opt{archive::read_file(path_file)};
+              if (data_opt.has_value()) scan(*data_opt, r, rows);
+              return data_opt.has_value(); }});
+          continue;
+        }
+
+        // Only the runs of a segment that overlap with the time range
+        auto const file_size{std::filesystem::file_size(path_file)};
+        for (std::size_t i{0u}; i < index.size(); ++i) {
+          auto const begin{index[i].offset};
+          auto const end{
+            i + 1u < index.size() ? index[i + 1u].offset : file_size};
+          timestamp_t const time_begin{index[i].timestamp};
+          if (begin >= end or
+              not overlaps(r, time_begin, time_begin + r.duration_run))
+            continue;
+          tasks.push_back({source::shortly,
+            [&r, path_file, begin, end](std::vector<row> &rows){
+              auto const data_opt{
+                archive::read_file_range(path_file, begin, end - begin)};
+              if (data_opt.has_value()) scan(*data_opt, r, rows);
+              return data_opt.has_value(); }});
+        }
+      }
+    } catch (std::filesystem::filesystem_error const &e) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix <<
+        e.what() << std::endl;
+      return {};
+    }
+
+    auto const is_member_requested{
+      [&r, ext, basenames_present, dates_segment_present](
+          std::string const &name){
+        auto const info_opt{parse_file_name(name, ext, r.duration_run)};
+        if (not info_opt.has_value() or not is_requested(r, *info_opt) or
+            basenames_present.count(name) > 0u) return false;
+        return not (info_opt->name == cc::basename_suffix_file_segment and
+          dates_segment_present.count(name.substr(0u, 10u)) > 0u);
+      }};
+
+    // Archives, one per day
+    static std::regex const archive_regex{
+      "([0-9]{4}-[0-9]{2}-[0-9]{2})\\.tar\\.xz(\\.part)?"};
+    try {
+      if (std::filesystem::is_directory(path_dir_daily))
+          for (auto const &entry :
+            std::filesystem::directory_iterator{path_dir_daily}) {
+        if (not entry.is_regular_file()) continue;
+        auto const path_file{entry.path()};
+        auto const basename{path_file.filename().string()};
+        std::smatch match;
+        if (not std::regex_match(basename, match, archive_regex)) continue;
+        auto const info_opt{parse_file_name(match[1].str() + "-" +
+          std::string{cc::basename_suffix_file_segment} + "." + ext, ext,
+          r.duration_run)};
+        if (not info_opt.has_value() or
+            not overlaps(r, info_opt->time_begin, info_opt->time_end))
+          continue;
+
+        auto const entries_opt{match[2].matched ?
+          std::optional<std::vector<archive::index_entry>>{} :
+          archive::read_index(path_file)};
+        if (not entries_opt.has_value()) {
+          tasks.push_back({
+            match[2].matched ? source::archive_partial : source::archive,
+            [path_file, scan_members, is_member_requested](
+                std::vector<row> &rows){
+              auto const members_opt{archive::read_members_streaming(
+                path_file, is_member_requested)};
+              if (members_opt.has_value()) scan_members(*members_opt, rows);
+              return members_opt.has_value(); }});
+          continue;
+        }
+
+        // NOTE: The index has whole seconds, so the range is widened to them.
+        auto const selected{archive::select(*entries_opt,
+          std::chrono::floor<std::chrono::seconds>(r.time_begin).count(),
+          std::chrono::ceil<std::chrono::seconds>(r.time_end).count(),
+          is_member_requested)};
+        std::map<std::uint64_t, std::vector<archive::index_entry>> streams{};
+        for (auto const &e : selected) streams[e.offset].push_back(e);
+        for (auto &stream : streams)
+          tasks.push_back({source::archive, [path_file, scan_members,
+              stream_entries = std::move(stream.second)](
+              std::vector<row> &rows){
+            auto const members_opt{
+              archive::read_members(path_file, stream_entries)};
+            if (members_opt.has_value()) scan_members(*members_opt, rows);
+            return members_opt.has_value(); }});
+      }
+    } catch (std::filesystem::filesystem_error const &e) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix <<
+        e.what() << std::endl;
+      return {};
+    }
+    return {tasks};
+  }
+
+  // Runs the tasks on up to `n_threads` threads and merges their rows, ordered
+  // by time and instance. Rows occurring more than once (e.g. because a run's
+  // chunk of a segment is also in an archive under a different name) are only
+  // kept once, from the source with the highest precedence, and of those from
+  // the task that comes first. Returns whether all tasks succeeded.
+  bool run(std::vector<task> const &tasks, std::size_t const n_threads,
+      std::vector<row> &rows) {
+    std::vector<std::vector<row>> results(tasks.size());
+    std::atomic<std::size_t> next{0u};
+    std::atomic<bool> success{true};
+    auto const work{[&](){
+      for (std::size_t i{next++}; i < tasks.size(); i = next++)
+        if (not tasks[i].run(results[i])) success = false;
+    }};
+    std::vector<std::thread> threads{};
+    for (std::size_t i{1u}; i < std::min(n_threads, tasks.size()); ++i)
+      threads.emplace_back(work);
+    work();
+    for (auto &thread : threads) thread.join();
+
+    std::vector<std::size_t> order(tasks.size());
+    std::iota(order.begin(), order.end(), std::size_t{0u});
+    std::stable_sort(order.begin(), order.end(),
+      [&](std::size_t const i0, std::size_t const i1){
+        return tasks[i0].from > tasks[i1].from; });
+    for (auto const i : order) std::move(results[i].begin(),
+      results[i].end(), std::back_inserter(rows));
+    auto const key{[](row const &x){
+      return std::tie(x.timestamp, x.instance_index); }};
+    std::stable_sort(rows.begin(), rows.end(),
+      [&](row const &x0, row const &x1){ return key(x0) < key(x1); });
+    rows.erase(std::unique(rows.begin(), rows.end(),
+      [](row const &x0, row const &x1){
+        return x0.timestamp == x1.timestamp and
+          x0.instance_index == x1.instance_index; }), rows.end());
+    return success;
+  }
+
+  // Writes the rows as one table with the columns of all instances, where each
+  // line holds the fields of one instance and leaves the others empty, without
+  // the trailing whitespace of the delimiters of empty fields at its end
+  void write(std::ostream &out, request const &r, std::vector<row> const &rows) {
+    bool is_first_column{true};
+    for (auto const &i : r.instances) for (auto const &column : i.columns) {
+      if (is_first_column) is_first_column = false;
+      else out << cc::csv_delimiter_string;
+      out << "\"" << column << "\"";
+    }
+    out << "\n";
+
+    std::vector<std::string> blanks{};
+    for (auto const &i : r.instances) {
+      std::string blank{};
+      for (std::size_t j{1u}; j < i.columns.size(); ++j)
+        blank += cc::csv_delimiter_string;
+      blanks.push_back(std::move(blank));
+    }
+    std::string line{};
+    for (auto const &x : rows) {
+      line.clear();
+      for (std::size_t k{0u}; k < r.instances.size(); ++k) {
+        if (k > 0u) line += cc::csv_delimiter_string;
+        line += k == x.instance_index ? x.fields : blanks[k];
+      }
+      line.erase(line.find_last_not_of(' ') + 1u);
+      out << line << "\n";
+    }
+    out << std::flush;
+  }
+} // namespace query
@@ -0,0 +1,124 @@
+namespace realtime {
+  // Real-time scheduling of the sampling with `shortly --realtime`, so that
+  // ticks start on time and samples are taken at regular intervals even when
+  // the Pi is busy otherwise (e.g. with `daily`, which runs at `SCHED_IDLE`).
+  //
+  // The calling (main) thread is put on `SCHED_FIFO` and optionally pinned to
+  // a CPU. Threads it starts from then on inherit both, i.e. the sampling
+  // threads, but not the threads started before, i.e. the log drain and the
+  // metrics exporter, which stay at normal priority. The threads started
+  // during the run that do not sample, i.e. those sending LPD433 codes or
+  // buzzing, return to normal with `reset_thread`. All memory of the process
+  // is locked, the heap is kept from shrinking and the stacks are faulted in
+  // up front, so that the ticks take no page faults after the first one
+  // (which faults in the stacks of the sampling threads).
+  //
+  // Each step that the system does not allow (see `aux/90-pi-priority.conf`
+  // for the limits needed) is logged and skipped, and the run goes on.
+
+  int constexpr priority_min{1}, priority_max{99};
+
+  // Whether `enter` has been called and `leave` not since, on the main thread
+  bool active{false};
+  // The CPUs the process could run on before `enter`
+  // NOTE: Only written by `enter`, before the threads that read it start.
+  std::optional<cpu_set_t> cpus_outer{};
+  // The default stack size of new threads before `enter`
+  std::optional<std::size_t> stack_size_outer{};
+
+  // Sets the default stack size of the threads started from then on and
+  // returns the one before, if that succeeded
+  std::optional<std::size_t> exchange_default_stack_size(
+      std::size_t const size) {
+    pthread_attr_t attr;
+    if (pthread_getattr_default_np(&attr) != 0) return {};
+    std::size_t size_outer;
+    bool const okay{pthread_attr_getstacksize(&attr, &size_outer) == 0 and
+      pthread_attr_setstacksize(&attr, size) == 0 and
+      pthread_setattr_default_np(&attr) == 0};
+    pthread_attr_destroy(&attr);
+    if (not okay) return {};
+    return {size_outer};
+  }
+
+  // Touches `cc::realtime_prefault_stack_size` bytes of the stack below the
+  // caller
+  [[gnu::noinline]] void prefault_stack() {
+    std::array<volatile char, cc::realtime_prefault_stack_size> stack;
+    // NOTE: Less than any page size.
+    for (std::size_t i{0u}; i < stack.size(); i += 1024u) stack[i] = 0;
+  }
+
+  // Grows the heap by `size` bytes, faulted in, and keeps it from shrinking
+  // again, with all threads allocating from it
+  // NOTE: The limit of a single arena is left in place by `leave` on purpose:
+  // glibc fixes the number of arenas once a thread needs one other than the
+  // main arena, so resetting `M_ARENA_MAX` would not undo it, and the threads
+  // started after the run do little allocating.
+  void prefault_heap(std::size_t const size) {
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_ARENA_MAX, 1);
+    auto * const p{static_cast<volatile char *>(std::malloc(size))};
+    if (p == nullptr) return;
+    auto const page_size{static_cast<std::size_t>(sysconf(_SC_PAGESIZE))};
+    for (std::size_t i{0u}; i < size; i += page_size) p[i] = 0;
+    std::free(const_cast<char *>(p));
+  }
+
+  // Switches the calling thread to real-time scheduling as described above,
+  // returning whether it is now on `SCHED_FIFO`
+  bool enter(int const priority, std::optional<int> const &cpu) {
+    active = true;
+    if (cpu_set_t cpus; sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+      cpus_outer = cpus;
+    if (cpu.has_value()) bench::pin_to_cpu(*cpu);
+
+    stack_size_outer =
+      exchange_default_stack_size(cc::realtime_thread_stack_size);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "locking memory: " << std::strerror(errno) << "." << std::endl;
+    }
+    prefault_heap(cc::realtime_prefault_heap_size);
+    prefault_stack();
+
+    sched_param const param{std::clamp(priority, priority_min, priority_max)};
+    if (auto const error{pthread_setschedparam(pthread_self(), SCHED_FIFO,
+        &param)}; error != 0) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "switching to SCHED_FIFO with priority " << param.sched_priority
+        << ": " << std::strerror(error) << "." << std::endl;
+      return false;
+    }
+    if constexpr (cc::log_info) std::cerr << log_info_prefix
+      << "Sampling on SCHED_FIFO with priority " << param.sched_priority
+      << (cpu.has_value() ? " on CPU " + std::to_string(*cpu) : "") << "."
+      << std::endl;
+    return true;
+  }
+
+  // Returns the calling thread to normal scheduling on the CPUs it could run
+  // on before `enter`, if that has been called
+  void reset_thread() {
+    if (not cpus_outer.has_value()) return;
+    sched_param const param{0};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    sched_setaffinity(0, sizeof(*cpus_outer), &*cpus_outer);
+  }
+
+  // Returns the calling thread to normal scheduling, restores the default
+  // stack size of new threads and unlocks the memory, e.g. before compressing
+  // the archive of the run, unless `enter` has not been called or `leave` has
+  // been called since
+  void leave() {
+    if (not std::exchange(active, false)) return;
+    reset_thread();
+    if (stack_size_outer.has_value())
+      exchange_default_stack_size(*std::exchange(stack_size_outer, {}));
+    munlockall();
+    // NOTE: The defaults of glibc.
+    mallopt(M_MMAP_MAX, 65536);
+    mallopt(M_TRIM_THRESHOLD, 128 * 1024);
+  }
+} // namespace realtime
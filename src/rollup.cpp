@@ -0,0 +1,227 @@
+namespace rollup {
+  // Summaries of the aggregates over coarser periods, so that looking at
+  // months of data does not mean reading all of it. Each `shortly` aggregate
+  // is folded into a per-minute rollup with the generated aggregation
+  // functions, treating it like a sample. Closed minutes are folded into the
+  // hour the same way, and closed hours into the day. Every rollup is written
+  // as one row as soon as its period closes, to
+  // `data/rollup/<host>/<level>/<prefix>-<name>.csv`, where `<prefix>` is the
+  // date of the period for minutes, its month for hours and its year for days.
+  // The timestamp of a rollup row is the start of its period.
+  //
+  // NOTE: Statistics such as `stddev` or `median` of a rollup are thus those
+  // of the rows of the level below, not of the original samples.
+  //
+  // A `shortly` run does not span more than an hour, so the open hour and day
+  // are rebuilt from the files of the level below when a run starts. This
+  // assumes that runs are aligned to the minute, as they are unless `--now` is
+  // given. A period that was left open by an interrupted run is written when
+  // the next run starts, if that is in the following period.
+
+  using timestamp_t = cc::timestamp_duration_t;
+
+  enum struct Level { minutely, hourly, daily };
+  std::array<Level, 3> constexpr levels{
+    Level::minutely, Level::hourly, Level::daily};
+
+  std::string level_name(Level const level) {
+    if (level == Level::minutely) return "minutely";
+    else if (level == Level::hourly) return "hourly";
+    else return "daily";
+  }
+
+  timestamp_t period(Level const level) {
+    if (level == Level::minutely)
+      return std::chrono::duration_cast<timestamp_t>(std::chrono::minutes{1});
+    else if (level == Level::hourly)
+      return std::chrono::duration_cast<timestamp_t>(std::chrono::hours{1});
+    else return std::chrono::duration_cast<timestamp_t>(std::chrono::days{1});
+  }
+
+  timestamp_t period_start(Level const level, timestamp_t const t) {
+    return t - t % period(level);
+  }
+
+  std::filesystem::path path_file_get(std::filesystem::path const &path_dir,
+      Level const level, timestamp_t const start, std::string const &name) {
+    auto const start_ctime{std::chrono::system_clock::to_time_t(
+      std::chrono::system_clock::time_point{
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          start)})};
+    char prefix[11];
+    std::strftime(prefix, sizeof(prefix),
+      level == Level::minutely ? "%Y-%m-%d" :
+      level == Level::hourly ? "%Y-%m" : "%Y", std::gmtime(&start_ctime));
+    return path_dir / level_name(level) /
+      (std::string{prefix} + "-" + name + ".csv");
+  }
+
+  bool file_exists(std::filesystem::path const &path_file) {
+    std::error_code ec{};
+    return std::filesystem::exists(path_file, ec);
+  }
+
+  // The rollups of one physical sensor `name` of type `T`
+  template <typename T>
+  class Cascade {
+    struct accumulator {
+      // Start of the open period, or nothing if there is none
+      std::optional<timestamp_t> start{};
+      T aggregate{};
+      decltype(sensors::init_state(T{})) state{};
+    };
+
+    std::string name;
+    std::filesystem::path path_dir;
+    std::array<accumulator, levels.size()> accumulators{};
+
+    // Rows of a file of this sensor (none if there is no such file), or
+    // nothing on error
+    std::optional<std::vector<T>> read_rows(
+        std::filesystem::path const &path_file) const {
+      if (not file_exists(path_file)) return {std::vector<T>{}};
+      auto const data_opt{archive::read_file(path_file)};
+      if (not data_opt.has_value()) return {};
+      auto const read_opt{sensors::read_csv<T>(*data_opt)};
+      if (not read_opt.has_value() or read_opt->first != name) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << path_file << " is not a rollup file of " << name << " with the "
+          << "current fields." << std::endl;
+        return {};
+      }
+      std::vector<T> rows{};
+      for (std::size_t i{0u}; i < n_rows(read_opt->second); ++i)
+        rows.push_back(sensors::row_at(read_opt->second, i));
+      return {rows};
+    }
+
+    bool write_row(Level const level, T const &row) const {
+      auto const path_file{path_file_get(path_dir, level, *row.timestamp,
+        name)};
+      std::error_code ec{};
+      bool const write_header{not file_exists(path_file) or
+        std::filesystem::is_empty(path_file, ec)};
+      std::ofstream fs{};
+      if (not util::safe_open(fs, path_file, std::ios::out | std::ios::app))
+        return false;
+      if (write_header)
+        sensors::write_field_names(fs, row, sensors::WriteFormat::csv, name);
+      sensors::write_fields(fs, row, sensors::WriteFormat::csv, name);
+      if (not fs.good()) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "writing to " << path_file << ": "
+          << util::ios_error_description(fs.rdstate()) << "." << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    static void fold(accumulator &acc, timestamp_t const start,
+        T const &row) {
+      if (not acc.start.has_value())
+        acc = {start, T{}, sensors::init_state(T{})};
+      std::tie(acc.aggregate, acc.state) =
+        aggregation_step(acc.aggregate, acc.state, row);
+    }
+
+    bool push(std::size_t const i, T const &row, timestamp_t const t) {
+      auto const start{period_start(levels[i], t)};
+      bool okay{true};
+      if (accumulators[i].start.has_value() and
+          *accumulators[i].start != start) okay = close(i);
+      fold(accumulators[i], start, row);
+      return okay;
+    }
+
+    // Writes the rollup of an open period of level `i` and, with `cascade`,
+    // folds it into the level above
+    bool close(std::size_t const i, accumulator &acc, bool const cascade) {
+      if (not acc.start.has_value()) return true;
+      auto row{aggregation_finish(acc.aggregate, acc.state)};
+      row.timestamp = *acc.start;
+      acc.start.reset();
+      bool okay{write_row(levels[i], row)};
+      if (cascade and i + 1u < levels.size())
+        okay &= push(i + 1u, row, *row.timestamp);
+      return okay;
+    }
+
+    bool close(std::size_t const i) {
+      return close(i, accumulators[i], true);
+    }
+
+  public:
+    Cascade(std::string const &name, std::filesystem::path const &path_dir)
+      : name{name}, path_dir{path_dir} {}
+
+    // Restores the open periods containing `now` of all levels above minutes
+    // from the rows of the level below, and writes the rollups of the periods
+    // right before them, if they are missing
+    // NOTE: Periods that have been written already are left alone, as they
+    // would be written twice otherwise. The rollups written here are not
+    // folded into the level above, as that is rebuilt from the files next.
+    bool rebuild(timestamp_t const now) {
+      for (std::size_t i{1u}; i < levels.size(); ++i) {
+        auto const start{period_start(levels[i], now)};
+        auto const start_previous{start - period(levels[i])};
+
+        std::set<timestamp_t> starts_present{};
+        std::vector<T> rows_below{};
+        std::set<std::filesystem::path> paths_read{};
+        auto const read{[&](Level const level, timestamp_t const t,
+            auto const &f){
+          auto const path_file{path_file_get(path_dir, level, t, name)};
+          if (not paths_read.insert(path_file).second) return true;
+          auto const rows_opt{read_rows(path_file)};
+          if (not rows_opt.has_value()) return false;
+          for (auto const &row : *rows_opt)
+            if (row.timestamp.has_value()) f(row);
+          return true;
+        }};
+        for (auto const t : {start_previous, start})
+          if (not read(levels[i], t, [&](T const &row){
+                starts_present.insert(*row.timestamp); }) or
+              not read(levels[i - 1u], t, [&](T const &row){
+                rows_below.push_back(row); }))
+            return false;
+
+        accumulator previous{};
+        for (auto const &row : rows_below) {
+          auto const s{period_start(levels[i], *row.timestamp)};
+          if (starts_present.contains(s)) continue;
+          if (s == start) fold(accumulators[i], s, row);
+          else if (s == start_previous) fold(previous, s, row);
+        }
+        if (not close(i, previous, false)) return false;
+      }
+      return true;
+    }
+
+    // Folds an aggregate that starts at `t` into the rollups
+    bool push(T const &aggregate, timestamp_t const t) {
+      return push(0u, aggregate, t);
+    }
+
+    // Writes the rollups of all open periods that end no later than `t`
+    bool close_until(timestamp_t const t) {
+      bool okay{true};
+      for (std::size_t i{0u}; i < levels.size(); ++i) {
+        auto const &acc{accumulators[i]};
+        if (acc.start.has_value() and *acc.start + period(levels[i]) <= t)
+          okay &= close(i);
+      }
+      return okay;
+    }
+  };
+
+  // Creates the directories for the rollups of the host below `path_dir`
+  bool create_directories(std::filesystem::path const &path_dir) {
+    if (not util::safe_create_directory(path_dir.parent_path()) or
+        not util::safe_create_directory(path_dir))
+      return false;
+    for (auto const level : levels)
+      if (not util::safe_create_directory(path_dir / level_name(level)))
+        return false;
+    return true;
+  }
+} // namespace rollup
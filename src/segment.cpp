@@ -0,0 +1,135 @@
+namespace segment {
+  // A segment is a per-day, per-host CSV file that every `shortly` run appends
+  // to, instead of creating one new file per physical sensor. Each run writes
+  // one header line followed by one wide row per aggregate, containing the
+  // fields of all sensors (i.e. the same thing that is written to stdout when
+  // no `--base-path` is given). This way, a single run's chunk of a segment is
+  // a valid CSV file on its own.
+  //
+  // Next to the segment lives an index file, which gets one fixed-size record
+  // appended per run, so that readers can find the start of a run without
+  // scanning the whole segment.
+
+  // NOTE: Like `control::serialize`, this is a raw binary dump of the struct.
+  // The fields are ordered and sized such that there is no padding, so on
+  // little-endian machines this corresponds to Python's `struct` format `<qQ`.
+  struct index_entry {
+    // Start of the run, in `cc::timestamp_duration_t` ticks since epoch
+    std::int64_t timestamp;
+    // Byte offset of the run's header line in the segment file
+    std::uint64_t offset;
+  };
+  static_assert(sizeof(index_entry) == 16u);
+  static_assert(std::is_trivially_copyable_v<index_entry>);
+
+  std::string date_string(std::chrono::system_clock::time_point const &when) {
+    auto const when_ctime{std::chrono::system_clock::to_time_t(when)};
+    char buf[11];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d", std::gmtime(&when_ctime));
+    buf[10] = '\0';
+    return {buf};
+  }
+
+  std::filesystem::path path_file_segment_get(
+      std::filesystem::path const &path_dir,
+      std::chrono::system_clock::time_point const &when,
+      std::string const &ext) {
+    return path_dir / (date_string(when) + "-" +
+      std::string{cc::basename_suffix_file_segment} + "." + ext);
+  }
+
+  std::filesystem::path path_file_index_get(
+      std::filesystem::path const &path_file_segment) {
+    return std::filesystem::path{path_file_segment} +=
+      "." + std::string{cc::extension_file_segment_index};
+  }
+
+  // Opens `fs` for appending to the segment at `path_file` and returns the byte
+  // offset at which this run's data will start. If a previous run was cut off
+  // in the middle of a line, the line is terminated first.
+  std::optional<std::uint64_t> open(std::ofstream &fs,
+      std::filesystem::path const &path_file) {
+    std::uint64_t offset{0u};
+    bool terminate_line{false};
+    try {
+      auto const type{std::filesystem::status(path_file).type()};
+      if (type == std::filesystem::file_type::regular) {
+        offset = std::filesystem::file_size(path_file);
+        if (offset > 0u) {
+          std::ifstream f{path_file, std::ios::in | std::ios::binary};
+          f.seekg(-1, std::ios::end);
+          terminate_line = f.get() != '\n';
+        }
+      } else if (type != std::filesystem::file_type::not_found) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << path_file << " exists, but is not a regular file." << std::endl;
+        return {};
+      }
+    } catch (std::filesystem::filesystem_error const &e) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix <<
+        e.what() << std::endl;
+      return {};
+    }
+
+    if (not util::safe_open(fs, path_file, std::ios::out | std::ios::app))
+      return {};
+    if (terminate_line) {
+      fs << '\n';
+      offset += 1u;
+      if constexpr (cc::log_info) std::cerr << log_info_prefix
+        << "Terminated incomplete last line of " << path_file << "."
+        << std::endl;
+    }
+    return {offset};
+  }
+
+  // Appends `entry` to an index file. A trailing partial entry (e.g. from a
+  // power outage during writing) is cut off first, as the entries after it
+  // would otherwise be misaligned.
+  bool append_index_entry(std::filesystem::path const &path_file_index,
+      index_entry const &entry) {
+    std::error_code ec{};
+    auto const size{std::filesystem::file_size(path_file_index, ec)};
+    if (not ec and size % sizeof(entry) != 0u) {
+      std::filesystem::resize_file(path_file_index,
+        size - size % sizeof(entry), ec);
+      if (ec) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "cutting off the partial last entry of " << path_file_index
+          << ": " << ec.message() << "." << std::endl;
+        return false;
+      }
+      if constexpr (cc::log_info) std::cerr << log_info_prefix
+        << "Cut off the partial last entry of " << path_file_index << "."
+        << std::endl;
+    }
+
+    std::ofstream f;
+    if (not util::safe_open(f, path_file_index,
+        std::ios::out | std::ios::app | std::ios::binary)) return false;
+    f.write(reinterpret_cast<decltype(f)::char_type const *>(&entry),
+      sizeof(entry));
+    f.close();
+    if (not f) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "writing index entry to " << path_file_index << ": "
+        << util::ios_error_description(f.rdstate()) << "." << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Reads all complete entries of an index file. A trailing partial entry (e.g.
+  // from a power outage during writing) is ignored.
+  std::vector<index_entry> read_index(
+      std::filesystem::path const &path_file_index) {
+    std::vector<index_entry> entries{};
+    if (not util::safe_readable(path_file_index)) return entries;
+    std::ifstream f{path_file_index, std::ios::in | std::ios::binary};
+    index_entry entry;
+    while (f.read(reinterpret_cast<decltype(f)::char_type *>(&entry),
+        sizeof(entry)))
+      entries.push_back(entry);
+    return entries;
+  }
+} // namespace segment
@@ -6,10 +6,142 @@ namespace sensors {
     else if (wf == WriteFormat::toml) return "toml";
     else throw std::logic_error("`wf` must be one of the defined enum values");
   }
+
+  // Whether `x` is within `deadband` of `reference` (see `deadband_step`)
+  template <typename T>
+  bool within_deadband(std::optional<T> const &reference,
+      std::optional<T> const &x, double const deadband) {
+    if (not reference.has_value() or not x.has_value())
+      return reference.has_value() == x.has_value();
+    return std::abs(static_cast<double>(*x) -
+      static_cast<double>(*reference)) <= deadband;
+  }
 }
 
+#include "codec.cpp"
+#include "batch.cpp"
+#include "statistics.cpp"
+#include "filter.cpp"
 #include "sensors.generated.cpp"
 
+namespace sensors {
+  // Writes each sample of a batch in columnar layout, as `write_fields` does
+  // for a single one
+  std::ostream &write_rows(std::ostream &out, auto const &columns,
+      WriteFormat const wf = WriteFormat::csv,
+      std::optional<std::string> const sensor_name_arg = {}) {
+    for (std::size_t i{0u}; i < n_rows(columns); ++i)
+      write_fields(out, row_at(columns, i), wf, sensor_name_arg);
+    return out;
+  }
+
+  // Reading back the CSV files of a single sensor, as written by `shortly`
+
+  // Returns the instance name and the rows of `csv`, or nothing if it is not a
+  // file of sensor type `T`. With `scalar`, the lines are split one by one with
+  // `io::csv::FieldReader` instead of scanning the whole data at once. Fields
+  // written as unchanged (see `Deadband`) get the value of the row before.
+  template <typename T>
+  std::optional<std::pair<std::string, decltype(init_columns(T{}))>> read_csv(
+      std::string_view const csv, bool const scalar = false) {
+    auto const header_end{csv.find('\n')};
+    if (header_end == csv.npos) return {};
+    auto const instance_opt{codec::instance_name(csv.substr(0u, header_end))};
+    if (not instance_opt.has_value() or codec::header_line(T{},
+        *instance_opt) != csv.substr(0u, header_end + 1u)) return {};
+
+    auto columns{init_columns(T{})};
+    auto const body{csv.substr(header_end + 1u)};
+    T row{};
+    if (scalar) {
+      for (std::size_t pos{0u}; pos < body.size();) {
+        auto line_end{body.find('\n', pos)};
+        if (line_end == body.npos) line_end = body.size();
+        io::csv::FieldReader in{body.substr(pos, line_end - pos)};
+        if (not read_fields(in, row) or not in.done()) return {};
+        append(columns, row);
+        pos = line_end + 1u;
+      }
+    } else {
+      io::csv::FieldScanner in{body};
+      while (not in.done()) {
+        if (not read_fields(in, row) or not in.next_line()) return {};
+        append(columns, row);
+      }
+    }
+    return {{*instance_opt, std::move(columns)}};
+  }
+
+  // The inverse of `read_csv`
+  template <typename T>
+  std::string write_csv(std::string const &instance, T const &columns) {
+    std::ostringstream ss{};
+    write_field_names(ss, decltype(row_at(columns, 0u)){}, WriteFormat::csv,
+      instance);
+    write_rows(ss, columns, WriteFormat::csv, instance);
+    return std::move(ss).str();
+  }
+
+  // `n` synthetic samples of the sensor type of `data` for benchmarks and
+  // tests: Each field gets the first of a float, an integer and a boolean
+  // value that it reads, varying from sample to sample, and fields are missing
+  // now and then, like after a failed reading.
+  template <typename T>
+  std::vector<T> synthetic_rows(T const &data, std::string const &instance,
+      std::size_t const n) {
+    auto const header{codec::header_line(data, instance)};
+    std::size_t n_fields{1u};
+    for (auto pos{header.find(cc::csv_delimiter_string)}; pos != header.npos;
+        pos = header.find(cc::csv_delimiter_string, pos + 1u))
+      ++n_fields;
+
+    std::vector<T> rows{};
+    for (std::size_t i{0u}; i < n; ++i) {
+      std::vector<std::string> values(n_fields);
+      values[0] = std::to_string(1700000000u + 3u * i) + ".00";
+      T row{};
+      for (std::size_t j{1u}; j < n_fields; ++j) {
+        if ((i + j) % 7u == 0u) continue;
+        for (auto const &value : {std::to_string(20.f + .125f *
+              static_cast<float>((i * j) % 17u)),
+            std::to_string((i + j) % 5u), std::to_string((i + j) % 2u)}) {
+          values[j] = value;
+          std::string line{values[0]};
+          for (std::size_t k{1u}; k < n_fields; ++k)
+            line += std::string{cc::csv_delimiter_string} + values[k];
+          io::csv::FieldReader in{line};
+          if (read_fields(in, row)) break;
+          values[j].clear();
+        }
+      }
+      std::string line{values[0]};
+      for (std::size_t k{1u}; k < n_fields; ++k)
+        line += std::string{cc::csv_delimiter_string} + values[k];
+      io::csv::FieldReader in{line};
+      read_fields(in, row);
+      rows.push_back(row);
+    }
+    return rows;
+  }
+
+  // Change-only logging of the rows of one sensor instance. The first row and
+  // every `cc::deadband_keyframe_interval`th one after it are keyframes, which
+  // are written in full, so that readers starting anywhere in a file do not
+  // have to go back far to find all values.
+  template <typename T>
+  class Deadband {
+    T reference{};
+    unsigned n_rows{0u};
+
+  public:
+    // Which fields of `data` to write as unchanged, for `write_fields`
+    auto step(T const &data) {
+      bool const keyframe{n_rows++ % cc::deadband_keyframe_interval == 0u};
+      return deadband_step(reference, data, keyframe);
+    }
+  };
+} // namespace sensors
+
 namespace sensors {
   // IO setup and sampling functions, written here manually, because
   // machine-generating them would involve a lot of complexity for little gain
@@ -30,6 +162,12 @@ namespace sensors {
 
   auto setup_sensor_io(auto const &) { return nullptr; }
 
+  // Shortest interval at which a sensor may be sampled, which bounds the rate
+  // of adaptive sampling (see `adaptive::Schedule`)
+  std::chrono::milliseconds min_sampling_interval(sensor const &) {
+    return cc::sampling_interval;
+  }
+
   //sensor sample_sensor(auto const &clock, auto const &) {
   sensor sample_sensor(std::chrono::system_clock const &clock, auto const &) {
     // NOTE: A design choice I made back when I first started the sensor-logging
@@ -156,6 +294,12 @@ namespace sensors {
       motion};
   }
 
+  // NOTE: The microcontroller of the SensorHub reads its DHT11 at most once a
+  // second (see below for the DHT22) and the other values more often.
+  std::chrono::milliseconds min_sampling_interval(sensorhub const &) {
+    return std::chrono::milliseconds{1000};
+  }
+
   auto setup_dht22_io(auto const &pi, auto const &args) {
     if constexpr (std::tuple_size_v<typeof(args)> == 2)
       return io::DHT(pi, std::get<0>(args), std::get<1>(args));
@@ -163,6 +307,12 @@ namespace sensors {
       io::DHT(pi, std::get<0>(args), std::get<1>(args), std::get<2>(args));
   }
 
+  dht22 dht22_from_data(auto const &clock, DHTXXD_data_t const &data) {
+    return (data.status == DHT_GOOD)
+      ? dht22{sample_sensor(clock), {data.temperature}, {data.humidity}}
+      : dht22{};
+  }
+
   dht22 sample_dht22(auto const &clock, auto const &dht) {
     // The DHTXXD library provides two ways of reading data:
     // * Read periodically in separate thread and set a flag to indicate that
@@ -178,12 +328,17 @@ namespace sensors {
     // I am choosing to go with the second option here. This means I need to
     // manage the frequency with which this function is called myself.
 
-    DHTXXD_manual_read(dht);
-    auto const data{DHTXXD_data(dht)};
+    return dht22_from_data(clock, io::dht_read(dht));
+  }
 
-    return (data.status == DHT_GOOD)
-      ? dht22{sample_sensor(clock), {data.temperature}, {data.humidity}}
-      : dht22{};
+  // Same, but waits for the reading on the event loop of `engine`
+  engine::Task<dht22> sample_dht22_async(auto const &clock, auto const &dht) {
+    co_return dht22_from_data(clock, co_await io::dht_read_async(dht));
+  }
+
+  // NOTE: As suggested by the DHTXXD library, see above.
+  std::chrono::milliseconds min_sampling_interval(dht22 const &) {
+    return std::chrono::milliseconds{3000};
   }
 
   auto setup_mhz19_io(auto const &pi, auto const &args) {
@@ -193,6 +348,26 @@ namespace sensors {
       io::Serial(pi, std::get<0>(args), std::get<1>(args), std::get<2>(args));
   }
 
+  // Read command of the MH-Z19 (see `sample_mhz19`)
+  char constexpr mhz19_byte_start{0xff};
+  char constexpr mhz19_byte_sensor_number{0x01};
+
+  std::array<char, 8> constexpr mhz19_cmd_read{{mhz19_byte_start,
+    mhz19_byte_sensor_number, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
+  mhz19 mhz19_from_packet(auto const &clock,
+      std::array<std::uint8_t, 8> const &packet) {
+    float const co2_concentration{static_cast<float>(
+      static_cast<std::uint32_t>(packet[2]) << 8u |
+      static_cast<std::uint32_t>(packet[3]) << 0u)};
+    float const temperature{packet[4] - 40.f};
+    int const status{packet[5]};
+    int const u0{packet[6]}, u1{packet[7]};
+    return mhz19{sample_sensor(clock), {co2_concentration}, {temperature},
+      status == 0 ? std::optional<int>{} : std::optional<int>{status},
+      {u0}, {u1}};
+  }
+
   mhz19 sample_mhz19(auto const &clock, auto const &serial) {
     // Resources on this sensor (MH-Z19, MH-Z19B, MH-Z19C):
     // revspace.nl/MHZ19
@@ -235,30 +410,52 @@ namespace sensors {
     // this triggers any other kind of resets, I should probably do it
     // infrequently.
 
-    char constexpr byte_start{0xff};
-    char constexpr byte_sensor_number{0x01};
-
-    std::array<char, 8> constexpr cmd_read{{byte_start, byte_sensor_number,
-      0x86, 0x00, 0x00, 0x00, 0x00, 0x00}};
-
     io::serial_flush(serial);
-    int const response{io::mhz19_send(serial, cmd_read)};
+    int const response{io::mhz19_send(serial, mhz19_cmd_read)};
     if (response >= 0) {
       auto const maybe_packet{io::mhz19_receive(serial)};
-      if (maybe_packet.has_value()) {
-        auto const packet{maybe_packet.value()};
-        float const co2_concentration{static_cast<float>(
-          static_cast<std::uint32_t>(packet[2]) << 8u |
-          static_cast<std::uint32_t>(packet[3]) << 0u)};
-        float const temperature{packet[4] - 40.f};
-        int const status{packet[5]};
-        int const u0{packet[6]}, u1{packet[7]};
-        return mhz19{sample_sensor(clock), {co2_concentration}, {temperature},
-          status == 0 ? std::optional<int>{} : std::optional<int>{status},
-          {u0}, {u1}};
-      }
+      if (maybe_packet.has_value())
+        return mhz19_from_packet(clock, maybe_packet.value());
     }
     return mhz19{};
   }
+
+  // Same, but waits for the answer on the event loop of `engine`
+  engine::Task<mhz19> sample_mhz19_async(auto const &clock,
+      auto const &serial) {
+    io::serial_flush(serial);
+    int const response{io::mhz19_send(serial, mhz19_cmd_read)};
+    if (response >= 0) {
+      auto const maybe_packet{co_await io::mhz19_receive_async(serial)};
+      if (maybe_packet.has_value())
+        co_return mhz19_from_packet(clock, maybe_packet.value());
+    }
+    co_return mhz19{};
+  }
+
+  // NOTE: The MH-Z19 answers a read command within a few milliseconds, but its
+  // readings only change about once a second anyway.
+  std::chrono::milliseconds min_sampling_interval(mhz19 const &) {
+    return std::chrono::milliseconds{1000};
+  }
+
+  // Samples `x` as a task on the event loop of `engine` (see
+  // `shortly --coroutines`). Sensors that do not wait for their devices are
+  // sampled as with `sample`, i.e. without letting other tasks run meanwhile.
+  template <class T>
+  engine::Task<T> sample_async(T const &x, auto const &clock,
+      auto const &sensor_io) {
+    co_return sample(x, clock, sensor_io);
+  }
+
+  engine::Task<dht22> sample_async(dht22 const &, auto const &clock,
+      auto const &sensor_io) {
+    return sample_dht22_async(clock, sensor_io);
+  }
+
+  engine::Task<mhz19> sample_async(mhz19 const &, auto const &clock,
+      auto const &sensor_io) {
+    return sample_mhz19_async(clock, sensor_io);
+  }
 } // namespace sensors
 
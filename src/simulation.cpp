@@ -0,0 +1,407 @@
+// Simulated stand-ins for the parts of the pigpio daemon interface and the
+// DHTXXD and _433D libraries used by `io.cpp`, for builds with
+// `SIMULATE_SENSORS` (see `CMakeLists.txt`). These make every mode run without
+// a Raspberry Pi, a running `pigpiod` or any sensors, e.g. to benchmark or test
+// `shortly` on a build machine.
+//
+// The simulated devices answer like the real ones, down to the register map
+// of the SensorHub and the packets and checksums of the MH-Z19, so that
+// everything above this layer runs unchanged. Their readings follow slow daily
+// cycles plus normally distributed noise. Each transaction with a device takes
+// `latency`, and fails with probability `failure_rate` (a timeout or a failed
+// I2C read), or else has a wrong checksum with probability
+// `checksum_error_rate`. The parameters are set with the `--simulation` option.
+
+namespace simulation {
+  // NOTE: `bench-shortly` measures the cost of the code rather than that of
+  // the devices, so its devices answer at once and never fail by default.
+  struct Parameters {
+    // Scale of the noise on all readings, relative to that of real sensors
+    double noise{1.};
+    std::chrono::microseconds latency{cc::bench_shortly ? 0 : 1000};
+    double failure_rate{cc::bench_shortly ? 0. : .01};
+    double checksum_error_rate{cc::bench_shortly ? 0. : .01};
+    // Probability that the LPD433 receiver has picked up a code when polled
+    double lpd433_rate{0.};
+    std::uint64_t seed{1u};
+  };
+
+  Parameters parameters{};
+
+  // Parses a comma-separated list of `<key>=<value>` pairs, with `noise`,
+  // `latency` (in milliseconds), `failure-rate`, `checksum-error-rate`,
+  // `lpd433-rate` and `seed` as keys, into the parameters, returning whether
+  // that succeeded
+  bool configure(std::string_view const spec) {
+    Parameters p{};
+    std::size_t begin{0u};
+    while (begin < spec.size()) {
+      auto end{spec.find(',', begin)};
+      if (end == spec.npos) end = spec.size();
+      auto const pair{spec.substr(begin, end - begin)};
+      begin = end + 1u;
+      auto const equal_sign_pos{pair.find('=')};
+      auto const key{pair.substr(0u, equal_sign_pos)};
+      std::string const value{equal_sign_pos == pair.npos ? "" :
+        pair.substr(equal_sign_pos + 1u)};
+      try {
+        if (key == "noise") p.noise = std::stod(value);
+        else if (key == "latency")
+          p.latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::duration<double, std::milli>{std::stod(value)});
+        else if (key == "failure-rate") p.failure_rate = std::stod(value);
+        else if (key == "checksum-error-rate")
+          p.checksum_error_rate = std::stod(value);
+        else if (key == "lpd433-rate") p.lpd433_rate = std::stod(value);
+        else if (key == "seed") p.seed = std::stoull(value, nullptr, 0);
+        else throw std::invalid_argument("unknown key");
+      } catch (std::exception const &) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "parsing simulation parameter \"" << pair << "\"." << std::endl;
+        return false;
+      }
+    }
+    parameters = p;
+    return true;
+  }
+
+  // NOTE: Sensors are sampled concurrently, so the random number generator and
+  // the device state below are shared under one lock. Contention does not
+  // matter at the rates at which sensors are read.
+  std::mutex mutex{};
+
+  std::mt19937_64 &generator() {
+    static std::mt19937_64 g{parameters.seed};
+    return g;
+  }
+
+  double uniform() {
+    std::lock_guard const lock{mutex};
+    return std::uniform_real_distribution<double>{0., 1.}(generator());
+  }
+
+  double normal(double const stddev) {
+    std::lock_guard const lock{mutex};
+    return std::normal_distribution<double>{0., stddev * parameters.noise}(
+      generator());
+  }
+
+  // Outcome of one transaction with a device
+  enum struct Outcome { good, failure, checksum_error };
+
+  // The same, without taking `latency`, for devices that answer later
+  Outcome outcome() {
+    auto const u{uniform()};
+    if (u < parameters.failure_rate) return Outcome::failure;
+    if (u < parameters.failure_rate + parameters.checksum_error_rate)
+      return Outcome::checksum_error;
+    return Outcome::good;
+  }
+
+  Outcome transact() {
+    std::this_thread::sleep_for(parameters.latency);
+    return outcome();
+  }
+
+  // Cycle between -1 and 1 over the day, shifted by `phase_hours`, as a
+  // stand-in for the daily variation of temperature, light and so on
+  double daily(double const phase_hours = 0.) {
+    auto const t{std::chrono::duration<double, std::ratio<3600>>{
+      std::chrono::system_clock::now().time_since_epoch()}.count()};
+    return std::sin(2. * std::numbers::pi * (t - phase_hours) / 24.);
+  }
+
+  double temperature() { return 21. + 2. * daily(9.); }
+  double humidity() { return 50. - 10. * daily(9.); }
+  double brightness() { return std::max(0., 40000. * daily(6.)) + 50.; }
+  double co2_concentration() { return 800. + 300. * daily(3.); }
+
+  std::uint8_t byte_clamped(double const x) {
+    return static_cast<std::uint8_t>(std::clamp(std::round(x), 0., 255.));
+  }
+
+  std::size_t constexpr n_sensorhub_registers{0x0eu};
+  using SensorHubRegisters =
+    std::array<std::optional<std::uint8_t>, n_sensorhub_registers>;
+
+  // SensorHub registers, as in `sensors::sample_sensorhub`, from one reading
+  // of all values
+  SensorHubRegisters sensorhub_reading() {
+    auto const brightness_value{static_cast<std::uint32_t>(std::clamp(
+      brightness() + normal(20.), 0., 65535.))};
+    auto const pressure_value{static_cast<std::uint32_t>(
+      101325. + normal(5.))};
+    SensorHubRegisters registers{};
+    registers[0x01u] = byte_clamped(temperature() + normal(.3));
+    registers[0x02u] = static_cast<std::uint8_t>(brightness_value);
+    registers[0x03u] = static_cast<std::uint8_t>(brightness_value >> 8u);
+    registers[0x04u] = std::uint8_t{0u};
+    registers[0x05u] = byte_clamped(temperature() + normal(.5));
+    registers[0x06u] = byte_clamped(humidity() + normal(1.));
+    registers[0x07u] = std::uint8_t{uniform() < parameters.failure_rate};
+    registers[0x08u] = byte_clamped(temperature() + 1. + normal(.1));
+    registers[0x09u] = static_cast<std::uint8_t>(pressure_value);
+    registers[0x0au] = static_cast<std::uint8_t>(pressure_value >> 8u);
+    registers[0x0bu] = static_cast<std::uint8_t>(pressure_value >> 16u);
+    registers[0x0cu] = std::uint8_t{uniform() < parameters.failure_rate};
+    registers[0x0du] = std::uint8_t{uniform() < .1};
+    return registers;
+  }
+
+  // The registers of a SensorHub hold one reading at a time, so that the
+  // bytes of the multi-byte values (brightness, pressure) fit together. A new
+  // reading is taken once a register is read again, i.e. in the next sampling
+  // cycle, whatever order the registers are read in.
+  struct SensorHub {
+    SensorHubRegisters registers{};
+    std::bitset<n_sensorhub_registers> read{};
+  };
+
+  std::map<unsigned, SensorHub> sensorhubs{};
+
+  std::optional<std::uint8_t> sensorhub_register(unsigned const handle,
+      unsigned const reg) {
+    if (reg >= n_sensorhub_registers) return {};
+    bool stale{};
+    {
+      std::lock_guard const lock{mutex};
+      auto const &hub{sensorhubs[handle]};
+      stale = hub.read.none() or hub.read.test(reg);
+    }
+    // NOTE: Outside the lock, which the noise takes itself.
+    auto const registers_opt{stale ?
+      std::make_optional(sensorhub_reading()) : std::nullopt};
+    std::lock_guard const lock{mutex};
+    auto &hub{sensorhubs[handle]};
+    if (registers_opt.has_value()) hub = {*registers_opt, {}};
+    hub.read.set(reg);
+    return hub.registers[reg];
+  }
+
+  struct SerialDevice {
+    std::vector<char> buffer{};
+    std::chrono::steady_clock::time_point time_point_ready{};
+  };
+
+  std::map<unsigned, SerialDevice> serial_devices{};
+  unsigned handle_next{0u};
+
+  // Answer of an MH-Z19 to a read command (see `sensors::sample_mhz19`)
+  std::array<char, 9> mhz19_response(Outcome const outcome) {
+    auto const co2{static_cast<std::uint32_t>(std::clamp(
+      co2_concentration() + normal(10.), 0., 5000.))};
+    std::array<char, 9> packet{{static_cast<char>(0xff),
+      static_cast<char>(0x86), static_cast<char>(co2 >> 8u),
+      static_cast<char>(co2), static_cast<char>(byte_clamped(
+        temperature() + 40. + normal(.5))), 0x00, 0x01, 0x2c}};
+    // NOTE: As in `io::mhz19_checksum`, which comes after this file.
+    for (std::size_t i{1u}; i < 8u; ++i) packet[8] -= packet[i];
+    if (outcome == Outcome::checksum_error) ++packet[8];
+    return packet;
+  }
+} // namespace simulation
+
+// pigpio daemon interface (see `pigpiod_if2.h`)
+
+int constexpr PI_BAD_HANDLE{-25};
+int constexpr PI_SIMULATED_FAILURE{-2000};
+
+int pigpio_start(char const *, char const *) { return 0; }
+void pigpio_stop(int) {}
+char const *pigpio_error(int) { return "simulated failure"; }
+
+int i2c_open(int, unsigned, unsigned, unsigned) {
+  std::lock_guard const lock{simulation::mutex};
+  return static_cast<int>(simulation::handle_next++);
+}
+
+int i2c_close(int, unsigned const handle) {
+  std::lock_guard const lock{simulation::mutex};
+  simulation::sensorhubs.erase(handle);
+  return 0;
+}
+
+int i2c_read_byte_data(int, unsigned const handle, unsigned const reg) {
+  if (simulation::transact() != simulation::Outcome::good)
+    return PI_SIMULATED_FAILURE;
+  auto const value_opt{simulation::sensorhub_register(handle, reg)};
+  return value_opt.has_value() ? *value_opt : PI_SIMULATED_FAILURE;
+}
+
+int serial_open(int, char *, unsigned, unsigned) {
+  std::lock_guard const lock{simulation::mutex};
+  auto const handle{simulation::handle_next++};
+  simulation::serial_devices[handle] = {};
+  return static_cast<int>(handle);
+}
+
+int serial_close(int, unsigned const handle) {
+  std::lock_guard const lock{simulation::mutex};
+  simulation::serial_devices.erase(handle);
+  return 0;
+}
+
+int serial_write(int, unsigned const handle, char * const buf,
+    unsigned const count) {
+  auto const outcome{simulation::transact()};
+  bool const respond{count == 9u and buf[2] == static_cast<char>(0x86) and
+    outcome != simulation::Outcome::failure};
+  auto const packet{simulation::mhz19_response(outcome)};
+  std::lock_guard const lock{simulation::mutex};
+  auto &device{simulation::serial_devices.at(handle)};
+  if (respond)
+    device.buffer.insert(device.buffer.end(), packet.begin(), packet.end());
+  device.time_point_ready = std::chrono::steady_clock::now() +
+    simulation::parameters.latency;
+  return 0;
+}
+
+int serial_data_available(int, unsigned const handle) {
+  std::lock_guard const lock{simulation::mutex};
+  auto const &device{simulation::serial_devices.at(handle)};
+  return std::chrono::steady_clock::now() < device.time_point_ready ? 0 :
+    static_cast<int>(device.buffer.size());
+}
+
+int serial_read(int, unsigned const handle, char * const buf,
+    unsigned const count) {
+  std::lock_guard const lock{simulation::mutex};
+  auto &buffer{simulation::serial_devices.at(handle).buffer};
+  auto const n{std::min(static_cast<std::size_t>(count), buffer.size())};
+  std::copy_n(buffer.begin(), n, buf);
+  buffer.erase(buffer.begin(), buffer.begin() + static_cast<long>(n));
+  return static_cast<int>(n);
+}
+
+int serial_read_byte(int const pi, unsigned const handle) {
+  char c;
+  return serial_read(pi, handle, &c, 1u) == 1 ?
+    static_cast<std::uint8_t>(c) : PI_SIMULATED_FAILURE;
+}
+
+int set_PWM_range(int, unsigned, unsigned) { return 0; }
+int set_PWM_frequency(int, unsigned, unsigned) { return 0; }
+int set_PWM_dutycycle(int, unsigned, unsigned) { return 0; }
+
+// DHTXXD and _433D libraries (see `DHTXXD.h` and `_433D.h`)
+
+struct DHTXXD_s {
+  DHTXXD_data_t data;
+  // When a reading triggered with `DHTXXD_manual_trigger` arrives
+  std::chrono::steady_clock::time_point time_point_ready{};
+};
+
+struct _433D_rx_s {
+  // The code picked up, until it is fetched
+  std::optional<_433D_rx_data_t> data;
+};
+
+struct _433D_tx_s {
+  int n_bits, n_repeats, intercode_gap, pulse_length_short, pulse_length_long;
+};
+
+// Reads as `outcome`, i.e. with a timeout on failure
+void dhtxxd_set_data(DHTXXD_t * const self,
+    simulation::Outcome const outcome) {
+  self->data.status = outcome == simulation::Outcome::failure ? DHT_TIMEOUT :
+    outcome == simulation::Outcome::checksum_error ? DHT_BAD_CHECKSUM :
+    DHT_GOOD;
+  self->data.temperature = static_cast<float>(std::round(
+    (simulation::temperature() + simulation::normal(.2)) * 10.) / 10.);
+  self->data.humidity = static_cast<float>(std::round(
+    (simulation::humidity() + simulation::normal(1.)) * 10.) / 10.);
+  self->data.timestamp = std::chrono::duration<double>{
+    std::chrono::system_clock::now().time_since_epoch()}.count();
+}
+
+extern "C" {
+  DHTXXD_t *DHTXXD(int const pi, int const gpio, int, DHTXXD_CB_t) {
+    return new DHTXXD_t{{pi, gpio, DHT_TIMEOUT, 0.f, 0.f, 0.}, {}};
+  }
+
+  void DHTXXD_cancel(DHTXXD_t * const self) { delete self; }
+  int DHTXXD_ready(DHTXXD_t *) { return 1; }
+  DHTXXD_data_t DHTXXD_data(DHTXXD_t * const self) { return self->data; }
+  void DHTXXD_auto_read(DHTXXD_t *, float) {}
+
+  void DHTXXD_manual_read(DHTXXD_t * const self) {
+    dhtxxd_set_data(self, simulation::transact());
+  }
+
+  // NOTE: A failed reading never arrives, as with a sensor that does not
+  // answer, so that it times out.
+  void DHTXXD_manual_trigger(DHTXXD_t * const self) {
+    auto const outcome{simulation::outcome()};
+    dhtxxd_set_data(self, outcome);
+    self->time_point_ready = outcome == simulation::Outcome::failure ?
+      std::chrono::steady_clock::time_point::max() :
+      std::chrono::steady_clock::now() + simulation::parameters.latency;
+  }
+
+  int DHTXXD_manual_done(DHTXXD_t * const self, int const timed_out) {
+    return timed_out or
+      std::chrono::steady_clock::now() >= self->time_point_ready;
+  }
+
+  // NOTE: The simulated receiver picks up random codes, which are hardly ever
+  // those of a control variable, when polled, and never calls back.
+  _433D_rx_t *_433D_rx(int, int, _433D_rx_CB_t) { return new _433D_rx_t{}; }
+  void _433D_rx_cancel(_433D_rx_t * const self) { delete self; }
+
+  int _433D_rx_ready(_433D_rx_t * const self) {
+    if (not self->data.has_value() and
+        simulation::uniform() < simulation::parameters.lpd433_rate) {
+      int constexpr n_bits{cc::lpd433_send_n_bits_default};
+      auto const code{static_cast<std::uint64_t>(simulation::uniform() *
+        static_cast<double>(std::uint64_t{1u} << n_bits))};
+      self->data = {code, n_bits, cc::lpd433_send_intercode_gap_default,
+        cc::lpd433_send_pulse_length_short_default,
+        cc::lpd433_send_pulse_length_long_default};
+    }
+    return self->data.has_value();
+  }
+
+  std::uint64_t _433D_rx_code(_433D_rx_t * const self) {
+    _433D_rx_data_t data{};
+    _433D_rx_data(self, &data);
+    return data.code;
+  }
+
+  void _433D_rx_data(_433D_rx_t * const self, _433D_rx_data_t * const data) {
+    *data = std::exchange(self->data, {}).value_or(_433D_rx_data_t{});
+  }
+
+  void _433D_rx_set_bits(_433D_rx_t *, int, int) {}
+  void _433D_rx_set_glitch(_433D_rx_t *, int) {}
+
+  _433D_tx_t *_433D_tx(int, int) {
+    return new _433D_tx_t{cc::lpd433_send_n_bits_default,
+      cc::lpd433_send_n_repeats_default, cc::lpd433_send_intercode_gap_default,
+      cc::lpd433_send_pulse_length_short_default,
+      cc::lpd433_send_pulse_length_long_default};
+  }
+
+  void _433D_tx_cancel(_433D_tx_t * const self) { delete self; }
+
+  // Takes as long as sending the code over the air would
+  void _433D_tx_send(_433D_tx_t * const self, std::uint64_t) {
+    std::this_thread::sleep_for(std::chrono::microseconds{self->n_repeats *
+      (self->intercode_gap + self->n_bits *
+        (self->pulse_length_short + self->pulse_length_long))});
+  }
+
+  void _433D_tx_set_repeats(_433D_tx_t * const self, int const repeats) {
+    self->n_repeats = repeats;
+  }
+
+  void _433D_tx_set_bits(_433D_tx_t * const self, int const bits) {
+    self->n_bits = bits;
+  }
+
+  void _433D_tx_set_timings(_433D_tx_t * const self, int const gap,
+      int const t0, int const t1) {
+    self->intercode_gap = gap;
+    self->pulse_length_short = t0;
+    self->pulse_length_long = t1;
+  }
+}
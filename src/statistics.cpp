@@ -0,0 +1,162 @@
+namespace statistics {
+  // Streaming statistics for the aggregates beyond `mean`, `min`, `max` and
+  // `first`. Each of these lives in the `_state` struct of a sensor, so they
+  // are passed by value through every aggregation step and must neither
+  // allocate nor grow with the number of samples.
+
+  // Welford's online algorithm, which does not suffer from the cancellation
+  // of the textbook formula with sums of squares
+  class Welford {
+    unsigned n{0u};
+    double mean{0.};
+    double m2{0.};
+
+  public:
+    void push(double const x) {
+      ++n;
+      auto const delta{x - mean};
+      mean += delta / static_cast<double>(n);
+      m2 += delta * (x - mean);
+    }
+
+    // Sample variance (with Bessel's correction), which needs two samples
+    std::optional<float> variance() const {
+      if (n < 2u) return {};
+      return {static_cast<float>(m2 / static_cast<double>(n - 1u))};
+    }
+
+    std::optional<float> stddev() const {
+      return util::optional_apply(
+        [](float const x){ return std::sqrt(x); }, variance());
+    }
+  };
+
+  // Quantile `p` of `n` sorted values, interpolating linearly between the two
+  // closest ranks
+  template <typename T>
+  float interpolate_sorted(T const * const values, std::size_t const n,
+      double const p) {
+    auto const position{p * static_cast<double>(n - 1u)};
+    auto const i{static_cast<std::size_t>(position)};
+    if (i + 1u >= n) return static_cast<float>(values[n - 1u]);
+    auto const fraction{position - static_cast<double>(i)};
+    return static_cast<float>(values[i] + fraction * (values[i + 1u] -
+      values[i]));
+  }
+
+  // Exact median of up to `capacity` samples
+  // NOTE: There is no sensible exact answer once more samples than that come
+  // in, so the median is missing then. For large windows, use the quantile
+  // estimate (`p50`) instead.
+  template <std::size_t capacity>
+  class Median {
+    std::array<float, capacity> values{};
+    std::size_t n{0u};
+
+  public:
+    void push(float const x) {
+      if (n < capacity) values[n] = x;
+      if (n <= capacity) ++n;
+    }
+
+    std::optional<float> median() const {
+      if (n == 0u or n > capacity) return {};
+      auto sorted{values};
+      std::sort(sorted.begin(), sorted.begin() + n);
+      return {interpolate_sorted(sorted.data(), n, .5)};
+    }
+  };
+
+  // Quantile estimate in constant memory. The first `exact_capacity` samples
+  // are kept, so that the quantile is exact for small windows. Beyond that,
+  // the P² algorithm by Jain and Chlamtac (1985) takes over, which tracks the
+  // quantile with five markers, adjusting their heights by piecewise-parabolic
+  // interpolation as samples come in.
+  // NOTE: The markers start out at the corresponding ranks of the kept
+  // samples instead of at the first five samples, which makes the estimate
+  // converge much faster.
+  template <unsigned percent, std::size_t exact_capacity = 32u>
+  class P2Quantile {
+    static_assert(percent > 0u and percent < 100u and exact_capacity >= 5u);
+    static double constexpr p{percent / 100.};
+    static std::array<double, 5> constexpr fractions{
+      0., p / 2., p, (1. + p) / 2., 1.};
+
+    std::array<double, exact_capacity> values{};
+    std::array<double, 5> heights{};
+    std::array<double, 5> positions{};
+    std::array<double, 5> desired_positions{};
+    std::size_t n{0u};
+
+    double parabolic(std::size_t const i, double const d) const {
+      auto const &q{heights};
+      auto const &m{positions};
+      return q[i] + d / (m[i + 1u] - m[i - 1u]) *
+        ((m[i] - m[i - 1u] + d) * (q[i + 1u] - q[i]) / (m[i + 1u] - m[i]) +
+         (m[i + 1u] - m[i] - d) * (q[i] - q[i - 1u]) / (m[i] - m[i - 1u]));
+    }
+
+    double linear(std::size_t const i, double const d) const {
+      auto const j{d > 0. ? i + 1u : i - 1u};
+      return heights[i] + d * (heights[j] - heights[i]) /
+        (positions[j] - positions[i]);
+    }
+
+    void init_markers() {
+      auto sorted{values};
+      std::sort(sorted.begin(), sorted.end());
+      auto const m{static_cast<double>(exact_capacity - 1u)};
+      for (std::size_t i{0u}; i < 5u; ++i) {
+        desired_positions[i] = 1. + m * fractions[i];
+        positions[i] = std::round(desired_positions[i]);
+      }
+      // Positions must be strictly increasing
+      for (std::size_t i{1u}; i < 4u; ++i)
+        positions[i] = std::max(positions[i], positions[i - 1u] + 1.);
+      for (std::size_t i{3u}; i > 0u; --i)
+        positions[i] = std::min(positions[i], positions[i + 1u] - 1.);
+      for (std::size_t i{0u}; i < 5u; ++i)
+        heights[i] = sorted[static_cast<std::size_t>(positions[i]) - 1u];
+    }
+
+  public:
+    void push(double const x) {
+      if (n < exact_capacity) {
+        values[n++] = x;
+        return;
+      }
+      if (n == exact_capacity) init_markers();
+      ++n;
+
+      // Find the cell of `x` and move the markers above it up by one
+      std::size_t k{0u};
+      if (x < heights[0]) heights[0] = x;
+      else if (x >= heights[4]) { heights[4] = x; k = 3u; }
+      else while (x >= heights[k + 1u]) ++k;
+      for (std::size_t i{k + 1u}; i < 5u; ++i) positions[i] += 1.;
+      for (std::size_t i{0u}; i < 5u; ++i)
+        desired_positions[i] += fractions[i];
+
+      // Adjust the inner markers that are off their desired position
+      for (std::size_t i{1u}; i < 4u; ++i) {
+        auto const delta{desired_positions[i] - positions[i]};
+        if ((delta >= 1. and positions[i + 1u] - positions[i] > 1.) or
+            (delta <= -1. and positions[i - 1u] - positions[i] < -1.)) {
+          auto const d{delta >= 0. ? 1. : -1.};
+          auto const height{parabolic(i, d)};
+          heights[i] = heights[i - 1u] < height and height < heights[i + 1u] ?
+            height : linear(i, d);
+          positions[i] += d;
+        }
+      }
+    }
+
+    std::optional<float> quantile() const {
+      if (n == 0u) return {};
+      if (n > exact_capacity) return {static_cast<float>(heights[2])};
+      auto sorted{values};
+      std::sort(sorted.begin(), sorted.begin() + n);
+      return {interpolate_sorted(sorted.data(), n, p)};
+    }
+  };
+} // namespace statistics
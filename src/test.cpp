@@ -0,0 +1,774 @@
+namespace test {
+  // Self-tests for `sensor-logging test`, mostly of the code that reads back
+  // what earlier runs wrote, as it has to cope with files that were cut short
+  // by a power outage. `ctest` runs each suite on its own (see
+  // `CMakeLists.txt`). Files are only written below a temporary directory,
+  // which is removed again afterwards.
+
+  // Counts the checks of a suite and logs those that fail
+  class Suite {
+    std::string_view name;
+    std::size_t n_checks{0u};
+    std::size_t n_failed{0u};
+
+    bool count(bool const okay) {
+      ++n_checks;
+      if (not okay) ++n_failed;
+      return okay;
+    }
+
+  public:
+    explicit Suite(std::string_view const name) : name{name} {}
+
+    void check(bool const okay, std::string_view const what) {
+      if (count(okay)) return;
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "test `" << name << "`: " << what << "." << std::endl;
+    }
+
+    template <typename T>
+    void check_equal(T const &actual, T const &expected,
+        std::string_view const what) {
+      if (count(actual == expected)) return;
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "test `" << name << "`: " << what << " is " << actual
+        << " instead of " << expected << "." << std::endl;
+    }
+
+    // For the results of `statistics`, which are missing without samples
+    void check_near(std::optional<float> const &actual, double const expected,
+        double const tolerance, std::string_view const what) {
+      if (count(actual.has_value() and
+          std::abs(*actual - expected) <= tolerance)) return;
+      if constexpr (cc::log_errors) {
+        std::cerr << log_error_prefix << "test `" << name << "`: " << what
+          << " is ";
+        if (actual.has_value()) std::cerr << *actual;
+        else std::cerr << "missing";
+        std::cerr << " instead of " << expected << " ± " << tolerance << "."
+          << std::endl;
+      }
+    }
+
+    // Logs the number of passed checks and returns whether all of them did
+    bool finish() const {
+      if constexpr (cc::log_info) std::cerr << log_info_prefix << "Test `"
+        << name << "`: " << n_checks - n_failed << " of " << n_checks
+        << " checks passed." << std::endl;
+      return n_failed == 0u;
+    }
+  };
+
+  // A new directory below the system's temporary one, which is removed with
+  // its contents at the end of the lifetime of this
+  class TemporaryDirectory {
+    std::filesystem::path path_;
+
+  public:
+    TemporaryDirectory() : path_{std::filesystem::temp_directory_path() /
+        ("sensor-logging-test-" + std::to_string(getpid()))} {
+      std::filesystem::create_directories(path_);
+    }
+    TemporaryDirectory(TemporaryDirectory const &) = delete;
+    TemporaryDirectory &operator=(TemporaryDirectory const &) = delete;
+
+    ~TemporaryDirectory() {
+      std::error_code ec{};
+      std::filesystem::remove_all(path_, ec);
+    }
+
+    std::filesystem::path const &path() const { return path_; }
+  };
+
+  // Captures what is written to stderr during its lifetime, i.e. the errors
+  // logged for input that is meant to be rejected
+  class CaptureStderr {
+    std::ostringstream captured{};
+    std::streambuf * const buffer_outer;
+
+  public:
+    CaptureStderr() : buffer_outer{std::cerr.rdbuf(captured.rdbuf())} {}
+    CaptureStderr(CaptureStderr const &) = delete;
+    CaptureStderr &operator=(CaptureStderr const &) = delete;
+
+    ~CaptureStderr() { std::cerr.rdbuf(buffer_outer); }
+
+    std::string str() const { return captured.str(); }
+  };
+
+  // Appending to and reading an index file next to a segment, including one
+  // whose last entry was only partly written
+  void segment_index(Suite &suite) {
+    TemporaryDirectory const dir{};
+    auto const path_file_index{segment::path_file_index_get(
+      dir.path() / ("1970-01-01-" +
+        std::string{cc::basename_suffix_file_segment} + ".csv"))};
+    auto const entries_equal{[](std::vector<segment::index_entry> const &x,
+        std::vector<segment::index_entry> const &y){
+        return std::equal(x.cbegin(), x.cend(), y.cbegin(), y.cend(),
+          [](auto const &e0, auto const &e1){
+            return e0.timestamp == e1.timestamp and e0.offset == e1.offset; });
+      }};
+
+    suite.check(segment::read_index(path_file_index).empty(),
+      "a missing index has entries");
+
+    std::vector<segment::index_entry> entries{
+      {1700000000000, 0u}, {1700000300000, 4096u}};
+    for (auto const &entry : entries) suite.check(
+      segment::append_index_entry(path_file_index, entry),
+      "appending an entry failed");
+    suite.check(entries_equal(segment::read_index(path_file_index), entries),
+      "the entries read differ from those appended");
+
+    // A torn entry is ignored by readers and cut off by the next writer
+    std::size_t constexpr size_torn{sizeof(segment::index_entry) / 2u + 1u};
+    {
+      std::ofstream f{path_file_index,
+        std::ios::out | std::ios::app | std::ios::binary};
+      f << std::string(size_torn, '\xff');
+    }
+    suite.check_equal(std::filesystem::file_size(path_file_index),
+      std::uintmax_t{entries.size() * sizeof(segment::index_entry) +
+        size_torn}, "the size of the index with a torn entry");
+    suite.check(entries_equal(segment::read_index(path_file_index), entries),
+      "a torn entry is read");
+
+    entries.push_back({1700000600000, 8192u});
+    suite.check(segment::append_index_entry(path_file_index, entries.back()),
+      "appending an entry after a torn one failed");
+    suite.check_equal(std::filesystem::file_size(path_file_index),
+      std::uintmax_t{entries.size() * sizeof(segment::index_entry)},
+      "the size of the index after appending to a torn one");
+    suite.check(entries_equal(segment::read_index(path_file_index), entries),
+      "the entries read after appending to a torn one differ");
+  }
+
+  // Encoding and decoding files and raw streams of each sensor type, including
+  // ones cut short or claiming more rows than they hold
+  void codec_files(Suite &suite) {
+    std::size_t constexpr n_blocks{4u};
+    std::size_t constexpr n_rows_per_block{16u};
+    std::size_t i_type{0u};
+
+    util::for_constexpr([&](auto const &data){
+        using T = std::remove_cvref_t<decltype(data)>;
+        std::string const instance{"test_" + std::to_string(i_type++)};
+        auto const what{[&](std::string const &s){
+          return s + " (" + instance + ")"; }};
+
+        auto rows{sensors::synthetic_rows(data, instance,
+          n_blocks * n_rows_per_block)};
+        // Runs of failed samples, which have no timestamp
+        for (std::size_t i{3u}; i + 1u < rows.size(); i += 11u)
+          rows[i] = rows[i + 1u] = T{};
+        auto const header{codec::header_line(data, instance)};
+        std::ostringstream ss{};
+        ss << header;
+        for (auto const &row : rows)
+          sensors::write_fields(ss, row, sensors::WriteFormat::csv, instance);
+        auto const csv{std::move(ss).str()};
+
+        auto const encoded_opt{codec::encode_csv<T>(csv)};
+        suite.check(encoded_opt.has_value(), what("encoding failed"));
+        if (not encoded_opt.has_value()) return;
+        auto const &encoded{*encoded_opt};
+        suite.check(codec::decode_csv<T>(encoded) == std::optional{csv},
+          what("the decoded file differs"));
+
+        // The magic, the header line and the number of rows come first
+        auto const start_with_n_rows{[&](std::uint64_t const n){
+          codec::BitWriter out{};
+          codec::write_header(out, codec::magic,
+            std::string_view{header}.substr(0u, header.size() - 1u));
+          codec::write_varint(out, n);
+          return std::string{out.finish()};
+        }};
+        auto const start{start_with_n_rows(rows.size())};
+        suite.check(encoded.starts_with(start), what("unexpected start"));
+
+        // Files of failed samples only, where each column is a single run of
+        // absent values, which takes no space however long it is
+        auto const absent_with_n_rows{[&](std::uint64_t const n){
+          codec::BitWriter out{};
+          for (auto pos{header.find(cc::csv_delimiter_string)};;
+              pos = header.find(cc::csv_delimiter_string, pos + 1u)) {
+            codec::write_varint(out, 0u);
+            codec::write_varint(out, n);
+            if (pos == header.npos) break;
+          }
+          return start_with_n_rows(n) + out.finish();
+        }};
+        suite.check(codec::decode_csv<T>(absent_with_n_rows(
+          cc::codec_rows_max)).has_value(),
+          what("a file of as many failed samples as allowed is not decoded"));
+
+        bool prefix_decoded{false}, wrong_n_rows_decoded{false};
+        bool absent_decoded{false}, corrupt_decoded_wrongly{false};
+        std::string errors{};
+        {
+          CaptureStderr const capture{};
+          for (std::size_t size{0u}; size < encoded.size(); ++size)
+            if (codec::decode_csv<T>(encoded.substr(0u, size)).has_value())
+              prefix_decoded = true;
+          for (std::uint64_t const n : {std::uint64_t{rows.size() - 1u},
+              std::uint64_t{rows.size() + 1u}, std::uint64_t{1u} << 40u,
+              std::numeric_limits<std::uint64_t>::max()})
+            if (codec::decode_csv<T>(start_with_n_rows(n) +
+                encoded.substr(start.size())).has_value())
+              wrong_n_rows_decoded = true;
+          for (std::uint64_t const n : {cc::codec_rows_max + 1u,
+              std::uint64_t{1u} << 40u})
+            if (codec::decode_csv<T>(absent_with_n_rows(n)).has_value())
+              absent_decoded = true;
+          // Anything may come out of a corrupt file, as long as it is a file
+          // of the sensor type
+          for (std::size_t i{start.size()}; i < encoded.size(); ++i) {
+            auto corrupt{encoded};
+            corrupt[i] = static_cast<char>(corrupt[i] ^ '\x5a');
+            auto const decoded_opt{codec::decode_csv<T>(corrupt)};
+            if (decoded_opt.has_value() and
+                not decoded_opt->starts_with(header))
+              corrupt_decoded_wrongly = true;
+          }
+          errors = capture.str();
+        }
+        suite.check(not prefix_decoded, what("a file cut short is decoded"));
+        suite.check(not wrong_n_rows_decoded,
+          what("a file with a wrong number of rows is decoded"));
+        suite.check(not absent_decoded,
+          what("a file of too many failed samples is decoded"));
+        if constexpr (cc::log_errors) suite.check(
+          errors.find(" rows, which it can not hold.") != errors.npos,
+          what("no error is logged for a wrong number of rows"));
+        suite.check(not corrupt_decoded_wrongly,
+          what("a corrupt file decodes to one of another type"));
+
+        // Raw streams, of which a last block cut short is left out
+        auto stream{codec::raw_header(data, instance)};
+        auto const size_header{stream.size()};
+        std::ostringstream ss_but_last_block{};
+        ss_but_last_block << header;
+        std::string block_last{};
+        for (std::size_t i{0u}; i < n_blocks; ++i) {
+          auto columns{init_columns(T{})};
+          for (std::size_t j{0u}; j < n_rows_per_block; ++j) {
+            auto const &row{rows[i * n_rows_per_block + j]};
+            append(columns, row);
+            if (i + 1u < n_blocks) sensors::write_fields(ss_but_last_block,
+              row, sensors::WriteFormat::csv, instance);
+          }
+          auto const block_opt{codec::raw_block(columns)};
+          suite.check(block_opt.has_value(), what("encoding a block failed"));
+          if (not block_opt.has_value()) return;
+          stream += *block_opt;
+          block_last = *block_opt;
+        }
+        suite.check(codec::decode_raw<T>(stream) == std::optional{csv},
+          what("the decoded raw stream differs"));
+
+        // A last block that claims a sample more than it holds
+        codec::BitReader in{block_last};
+        auto const size_opt{codec::read_varint(in)};
+        codec::BitReader payload{in.rest()};
+        auto const n_opt{codec::read_varint(payload)};
+        suite.check(size_opt.has_value() and n_opt.has_value(),
+          what("unexpected start of a block"));
+        if (not n_opt.has_value()) return;
+        codec::BitWriter payload_wrong{};
+        codec::write_varint(payload_wrong, *n_opt + 1u);
+        codec::write_bytes(payload_wrong, payload.rest());
+        codec::BitWriter block_wrong{};
+        codec::write_varint(block_wrong, payload_wrong.finish().size());
+        codec::write_bytes(block_wrong, payload_wrong.finish());
+
+        std::optional<std::string> decoded_cut_short{}, decoded_header_cut{};
+        std::optional<std::string> decoded_wrong_n{};
+        {
+          CaptureStderr const capture{};
+          decoded_cut_short =
+            codec::decode_raw<T>(stream.substr(0u, stream.size() - 1u));
+          decoded_header_cut =
+            codec::decode_raw<T>(stream.substr(0u, size_header - 1u));
+          decoded_wrong_n = codec::decode_raw<T>(stream.substr(0u,
+            stream.size() - block_last.size()) + block_wrong.finish());
+        }
+        suite.check(decoded_cut_short == std::optional{
+          std::move(ss_but_last_block).str()},
+          what("a raw stream cut short decodes wrongly"));
+        suite.check(not decoded_header_cut.has_value(),
+          what("a raw stream without a complete header is decoded"));
+        suite.check(not decoded_wrong_n.has_value(),
+          what("a block with a wrong number of samples is decoded"));
+      }, sensors::sensor_types_t{});
+  }
+
+  // Parsing times, selecting the rows within a time range (both ends included)
+  // and merging those of several tasks, keeping rows found more than once only
+  // from the source with the highest precedence
+  void query_rows(Suite &suite) {
+    using std::chrono::seconds;
+    using std::chrono::milliseconds;
+    auto const rows_equal{[](std::vector<query::row> const &x,
+        std::vector<query::row> const &y){
+        return std::equal(x.cbegin(), x.cend(), y.cbegin(), y.cend(),
+          [](auto const &r0, auto const &r1){
+            return r0.timestamp == r1.timestamp and
+              r0.instance_index == r1.instance_index and
+              r0.fields == r1.fields; });
+      }};
+
+    for (auto const &[s, t] : std::initializer_list<
+        std::pair<std::string, std::optional<query::timestamp_t>>>{
+          {"86401", seconds{86401}}, {"86401.25", milliseconds{86401250}},
+          {"1970-01-02", std::chrono::days{1}},
+          {"1970-01-02 00:00:01", seconds{86401}},
+          {"1970-01-02T00:00:01", seconds{86401}},
+          {"", {}}, {"yesterday", {}}, {"1970-01-02 00:00:01x", {}},
+          {"1970-01-02x", {}}, {"86401.", {}}})
+      suite.check(query::parse_time(s) == t, "parsing \"" + s + "\"");
+
+    // Two runs of a segment, the second one with other columns. Fields
+    // written as unchanged get the value of the line before, even if that is
+    // out of the time range.
+    query::request const r{seconds{100}, seconds{200},
+      {{"a", {"a_timestamp", "a_x"}}, {"b", {"b_timestamp", "b_y"}}},
+      std::chrono::minutes{5}};
+    std::vector<query::row> rows{};
+    query::scan(
+      "\"a_timestamp\", \"a_x\", \"b_timestamp\", \"b_y\"\n"
+      "99.99, 1, 99.99, 2\n"
+      "100.00, 3, 100.00, =\n"
+      "150.00, =, 150.00, 5\n"
+      "\"a_x\", \"a_timestamp\"\n"
+      "7, 200.00\n"
+      "8, 200.01\n", r, rows);
+    suite.check(rows_equal(rows, {
+        {seconds{100}, 0u, "100.00, 3"}, {seconds{100}, 1u, "100.00, 2"},
+        {seconds{150}, 0u, "150.00, 3"}, {seconds{150}, 1u, "150.00, 5"},
+        {seconds{200}, 0u, "200.00, 7"}}),
+      "the rows scanned differ");
+
+    auto const rows_task{[](query::source const from,
+        std::vector<query::row> const &rows, bool const success = true){
+        return query::task{from, [rows, success](std::vector<query::row> &x){
+          x.insert(x.end(), rows.cbegin(), rows.cend());
+          return success; }};
+      }};
+    std::vector<query::task> tasks{
+      rows_task(query::source::shortly,
+        {{seconds{2}, 0u, "shortly"}, {seconds{1}, 1u, "shortly"}}),
+      rows_task(query::source::archive_partial,
+        {{seconds{2}, 0u, "partial"}, {seconds{3}, 0u, "partial"}}),
+      rows_task(query::source::archive, {{seconds{2}, 0u, "archive"}}),
+      rows_task(query::source::shortly, {{seconds{3}, 0u, "later"},
+        {seconds{1}, 1u, "later"}, {seconds{1}, 0u, "later"}})};
+    std::vector<query::row> const rows_merged{
+      {seconds{1}, 0u, "later"}, {seconds{1}, 1u, "shortly"},
+      {seconds{2}, 0u, "archive"}, {seconds{3}, 0u, "partial"}};
+    for (std::size_t const n_threads : {1u, 4u}) {
+      rows.clear();
+      suite.check(query::run(tasks, n_threads, rows),
+        "running the tasks failed");
+      suite.check(rows_equal(rows, rows_merged),
+        "the rows merged on " + std::to_string(n_threads) +
+        " thread(s) differ");
+    }
+    tasks.push_back(rows_task(query::source::archive, {}, false));
+    rows.clear();
+    suite.check(not query::run(tasks, 2u, rows),
+      "running the tasks succeeded despite a failed one");
+    suite.check(rows_equal(rows, rows_merged),
+      "the rows merged despite a failed task differ");
+
+    // Each line has the fields of one instance, without trailing blanks
+    std::ostringstream ss{};
+    query::write(ss, r,
+      {{seconds{100}, 0u, "100.00, 3"}, {seconds{100}, 1u, "100.00, 2"}});
+    suite.check_equal(ss.str(), std::string{
+        "\"a_timestamp\", \"a_x\", \"b_timestamp\", \"b_y\"\n"
+        "100.00, 3, ,\n"
+        ", , 100.00, 2\n"},
+      "the table written");
+  }
+
+  // The streaming statistics against the exact values, computed from all
+  // samples at once
+  void statistics_exact(Suite &suite) {
+    std::vector<double> const xs{2., 4., 4., 4., 5., 5., 7., 9.};
+    double constexpr variance_xs{32. / 7.};
+
+    statistics::Welford welford{};
+    suite.check(not welford.variance().has_value(),
+      "the variance of no samples is there");
+    welford.push(xs.front());
+    suite.check(not welford.stddev().has_value(),
+      "the standard deviation of a single sample is there");
+    // Around a large offset, where the sum of squares cancels out
+    for (auto const x : xs | std::views::drop(1)) welford.push(x);
+    statistics::Welford welford_offset{};
+    for (auto const x : xs) welford_offset.push(1e9 + x);
+    suite.check_near(welford.variance(), variance_xs, 1e-5, "the variance");
+    suite.check_near(welford.stddev(), std::sqrt(variance_xs), 1e-5,
+      "the standard deviation");
+    suite.check_near(welford_offset.variance(), variance_xs, 1e-3,
+      "the variance around an offset");
+
+    statistics::Median<4u> median{};
+    suite.check(not median.median().has_value(),
+      "the median of no samples is there");
+    for (auto const x : {5.f, 1.f, 3.f}) median.push(x);
+    suite.check_near(median.median(), 3., 0., "the median of an odd count");
+    median.push(2.f);
+    suite.check_near(median.median(), 2.5, 0., "the median of an even count");
+    median.push(4.f);
+    suite.check(not median.median().has_value(),
+      "the median of more samples than it keeps is there");
+
+    // Exact for as many samples as are kept, estimated beyond
+    std::mt19937 generator{42u};
+    std::vector<double> ys(10001u);
+    std::iota(ys.begin(), ys.end(), 0.);
+    for (auto &y : ys) y = y * y / 1e4;
+    std::shuffle(ys.begin(), ys.end(), generator);
+    auto const check_quantile{[&](auto &&quantile, double const p,
+        std::string const &what){
+        suite.check(not quantile.quantile().has_value(),
+          what + " of no samples is there");
+        for (std::size_t const n : {1u, 5u, 31u, 32u, 33u, 1000u, 10001u}) {
+          quantile = {};
+          for (std::size_t i{0u}; i < n; ++i) quantile.push(ys[i]);
+          std::vector<double> sorted(ys.cbegin(),
+            ys.cbegin() + static_cast<std::ptrdiff_t>(n));
+          std::sort(sorted.begin(), sorted.end());
+          auto const what_n{what + " of " + std::to_string(n) + " samples"};
+          if (n <= 32u) {
+            suite.check_near(quantile.quantile(),
+              statistics::interpolate_sorted(sorted.data(), n, p),
+              1e-6 * (1. + sorted.back()), what_n);
+            continue;
+          }
+          // The estimate has to be within three ranks, or a percent of them,
+          // of the exact quantile
+          auto const rank{p * static_cast<double>(n - 1u)};
+          auto const slack{std::max(3., .01 * static_cast<double>(n))};
+          auto const low{sorted[static_cast<std::size_t>(
+            std::max(0., std::floor(rank - slack)))]};
+          auto const high{sorted[static_cast<std::size_t>(
+            std::min(static_cast<double>(n - 1u), std::ceil(rank + slack)))]};
+          suite.check_near(quantile.quantile(), (low + high) / 2.,
+            (high - low) / 2., what_n);
+        }
+      }};
+    check_quantile(statistics::P2Quantile<50u>{}, .5, "the median");
+    check_quantile(statistics::P2Quantile<90u>{}, .9, "the 90th percentile");
+  }
+
+  // The batch kernels and the aggregation of whole batches against folding one
+  // sample at a time, which they may only differ from in the order in which
+  // floats are summed
+  void batch_aggregation(Suite &suite) {
+    // Lengths around those of the vectors and of the validity words
+    for (std::size_t const n : {1u, 3u, 4u, 5u, 8u, 9u, 63u, 64u, 65u, 1000u}) {
+      std::vector<float> xs(n);
+      for (std::size_t i{0u}; i < n; ++i)
+        xs[i] = 101325.f + static_cast<float>((i * 37u) % 101u) - 50.f;
+      double sum_exact{0.};
+      for (auto const x : xs) sum_exact += x;
+      auto const what{[n](std::string const &s){
+          return s + " of " + std::to_string(n) + " values"; }};
+      // The usual bound on the rounding error of summing in any order
+      auto const tolerance_sum{static_cast<double>(n) *
+        std::numeric_limits<float>::epsilon() * sum_exact};
+      suite.check_near(batch::kernels::sum(xs.data(), n), sum_exact,
+        tolerance_sum, what("the sum"));
+      suite.check_near(batch::kernels::min(xs.data(), n),
+        *std::min_element(xs.cbegin(), xs.cend()), 0., what("the minimum"));
+      suite.check_near(batch::kernels::max(xs.data(), n),
+        *std::max_element(xs.cbegin(), xs.cend()), 0., what("the maximum"));
+
+      // With every fifth sample missing
+      batch::Column<float> column{};
+      std::optional<float> mean{}, min{}, max{}, first{};
+      for (std::size_t i{0u}; i < n; ++i) {
+        auto const x{i % 5u == 1u ? std::optional<float>{} : xs[i]};
+        column.push_back(x);
+        mean = util::optional_apply(sensors::aggregation_step_mean, mean, x);
+        min = util::optional_apply(sensors::aggregation_step_min, min, x);
+        max = util::optional_apply(sensors::aggregation_step_max, max, x);
+        first = util::optional_apply(sensors::aggregation_step_first, first, x);
+      }
+      std::optional<float> const none{};
+      suite.check_near(batch::step_mean(none, column), *mean, tolerance_sum,
+        what("the batch sum"));
+      suite.check_near(batch::step_min(none, column), *min, 0.,
+        what("the batch minimum"));
+      suite.check_near(batch::step_max(none, column), *max, 0.,
+        what("the batch maximum"));
+      suite.check_near(batch::step_first(none, column), *first, 0.,
+        what("the first of a batch"));
+      suite.check_near(batch::step_mean(std::optional<float>{1.f}, column),
+        *mean + 1., tolerance_sum + 1., what("the batch sum continued"));
+    }
+
+    // The aggregates of each sensor type as written, where the fields of
+    // means may differ by one in the last digit, and all others not at all
+    util::for_constexpr([&](auto const &s){
+        for (std::size_t const n : {std::size_t{cc::samples_per_aggregate},
+            std::size_t{1000u}}) {
+          auto const rows{sensors::synthetic_rows(s, name(s), n)};
+          auto aggregate{s};
+          auto state{sensors::init_state(s)};
+          auto columns{sensors::init_columns(s)};
+          for (auto const &row : rows) {
+            std::tie(aggregate, state) =
+              aggregation_step(aggregate, state, row);
+            sensors::append(columns, row);
+          }
+          auto const [aggregate_batch, state_batch]{
+            aggregation_step(s, sensors::init_state(s), columns)};
+          std::ostringstream scalar{}, batched{};
+          sensors::write_fields(scalar, aggregation_finish(aggregate, state));
+          sensors::write_fields(batched,
+            aggregation_finish(aggregate_batch, state_batch));
+
+          auto const fields{[](std::string const &line){
+              std::vector<std::string> xs{};
+              std::size_t begin{0u};
+              for (auto end{line.find(cc::csv_delimiter_string)};;
+                  end = line.find(cc::csv_delimiter_string, begin)) {
+                xs.push_back(line.substr(begin, end - begin));
+                if (end == line.npos) return xs;
+                begin = end + cc::csv_delimiter_string.size();
+              }
+            }};
+          auto line_scalar{std::move(scalar).str()};
+          auto line_batched{std::move(batched).str()};
+          for (auto *line : {&line_scalar, &line_batched})
+            if (line->ends_with('\n')) line->pop_back();
+          auto const xs{fields(line_scalar)}, ys{fields(line_batched)};
+          bool okay{xs.size() == ys.size()};
+          for (std::size_t i{0u}; okay and i < xs.size(); ++i) {
+            if (xs[i] == ys[i]) continue;
+            auto const point{xs[i].find('.')};
+            if (point == xs[i].npos) { okay = false; break; }
+            auto const unit{std::pow(10., -static_cast<double>(
+              xs[i].size() - point - 1u))};
+            try {
+              okay = std::abs(std::stod(xs[i]) - std::stod(ys[i])) <=
+                1.5 * unit;
+            } catch (std::exception const &) { okay = false; }
+          }
+          suite.check(okay, "the batch aggregate of " + std::to_string(n) +
+            " samples of " + name(s) + " is \"" + line_batched +
+            "\" instead of \"" + line_scalar + "\"");
+        }
+      }, sensors::sensor_types_t{});
+  }
+
+  // Rejecting outliers and jumps, and following a step change or a real jump
+  // after a while
+  void filter_samples(Suite &suite) {
+    float constexpr threshold{3.f}, min_deviation{1.f}, max_rate{1.f};
+
+    filter::Hampel<5u> hampel{};
+    for (auto const x : {20.f, 20.1f, 19.9f, 20.f, 20.1f}) suite.check(
+      hampel.accept(x, threshold, min_deviation),
+      "a value before the window is full is rejected");
+    suite.check(hampel.accept(22.f, threshold, min_deviation),
+      "a value within the minimum deviation is rejected");
+    suite.check(not hampel.accept(40.f, threshold, min_deviation),
+      "an outlier is accepted");
+    suite.check(hampel.accept(20.f, threshold, min_deviation),
+      "a value after an outlier is rejected");
+    // The window now holds the outlier once, so a step to its value is taken
+    // once it makes up half of the window
+    std::vector<bool> accepted_step{};
+    for (std::size_t i{0u}; i < 3u; ++i)
+      accepted_step.push_back(hampel.accept(40.f, threshold, min_deviation));
+    suite.check(accepted_step == std::vector<bool>{false, false, true},
+      "a step change is not followed after half the window");
+
+    using cc::timestamp_duration_t;
+    filter::RateLimit rate_limit{};
+    timestamp_duration_t t{1700000000000};
+    suite.check(rate_limit.accept(20.f, t, max_rate),
+      "the first value is rejected");
+    t += cc::sampling_interval;
+    suite.check(rate_limit.accept(22.f, t, max_rate),
+      "a change within the rate is rejected");
+    // Samples taken without waiting count as one sampling interval apart
+    suite.check(rate_limit.accept(24.f, t, max_rate),
+      "a change within the rate of one sampling interval is rejected");
+    for (unsigned i{0u}; i < filter::RateLimit::max_rejected; ++i) {
+      t += cc::sampling_interval;
+      suite.check(not rate_limit.accept(40.f, t, max_rate),
+        "a jump is accepted after " + std::to_string(i) + " rejection(s)");
+    }
+    t += cc::sampling_interval;
+    suite.check(rate_limit.accept(40.f, t, max_rate),
+      "a jump is still rejected after the most rejections in a row");
+    t += cc::sampling_interval;
+    suite.check(rate_limit.accept(41.f, t, max_rate),
+      "a change within the rate after a jump is rejected");
+    suite.check(not rate_limit.accept(20.f, t, max_rate),
+      "a jump back is accepted");
+  }
+
+  // Rollups written by several runs, which rebuild the open hour and day when
+  // they start, against those written by a single run
+  void rollup_cascade(Suite &suite) {
+    using T = sensors::dht22;
+    using rollup::timestamp_t;
+    TemporaryDirectory const dir{};
+    std::string const name{"dht22_0"};
+    // Two hours up to the end of a day, with an aggregate every 30 s
+    timestamp_t const begin{std::chrono::days{20000} + std::chrono::hours{22}};
+    timestamp_t const end{begin + std::chrono::hours{2}};
+    timestamp_t const step{std::chrono::seconds{30}};
+    // The means of each minute and hour are exact in one decimal, so that the
+    // rows read back from the files fold into the same rollups. The counts of
+    // rejected values add up to the number of aggregates folded.
+    auto const aggregate_at{[](timestamp_t const t){
+        auto const minute{static_cast<float>(t / std::chrono::minutes{1} % 4)};
+        return T{{{t}}, 20.f + std::fmod(minute, 2.f), 50.f + minute, 1, 0};
+      }};
+    auto const run{[&](std::filesystem::path const &path_dir,
+        timestamp_t const from, timestamp_t const to){
+        rollup::Cascade<T> cascade{name, path_dir};
+        bool okay{cascade.rebuild(from)};
+        for (auto t{from}; t < to; t += step)
+          okay = cascade.push(aggregate_at(t), t) and okay;
+        return cascade.close_until(to) and okay;
+      }};
+
+    auto const path_dir_single{dir.path() / "single"};
+    auto const path_dir_runs{dir.path() / "runs"};
+    suite.check(rollup::create_directories(path_dir_single) and
+      rollup::create_directories(path_dir_runs), "creating directories failed");
+    suite.check(run(path_dir_single, begin, end), "the single run failed");
+    // The second run starts with an hour closed and the day open, the third
+    // one with both open
+    auto const half_time{begin + std::chrono::minutes{90}};
+    suite.check(run(path_dir_runs, begin, begin + std::chrono::hours{1}) and
+      run(path_dir_runs, begin + std::chrono::hours{1}, half_time) and
+      run(path_dir_runs, half_time, end), "the runs failed");
+
+    for (auto const level : rollup::levels) {
+      auto const read{[&](std::filesystem::path const &path_dir){
+          return archive::read_file(rollup::path_file_get(path_dir, level,
+            begin, name)).value_or(""); }};
+      auto const data_single{read(path_dir_single)};
+      suite.check(not data_single.empty(),
+        "the " + rollup::level_name(level) + " rollups are missing");
+      suite.check_equal(read(path_dir_runs), data_single,
+        "the " + rollup::level_name(level) + " rollups of several runs");
+    }
+  }
+
+  // The ticks at which an adaptive schedule samples a sensor whose readings
+  // are steady, change quickly or are near a control threshold
+  void adaptive_schedule(Suite &suite) {
+    using T = sensors::dht22;
+    unsigned constexpr ticks_per_interval{cc::adaptive_ticks_per_interval};
+    unsigned constexpr ticks_per_aggregate{
+      cc::samples_per_aggregate * ticks_per_interval};
+    unsigned constexpr ticks_max{
+      ticks_per_interval * cc::adaptive_max_slowdown};
+    // Without a minimum interval of the hardware, it may sample every tick
+    adaptive::Schedule<T> schedule{ticks_per_interval,
+      std::chrono::milliseconds{0}};
+
+    unsigned tick_run{0u};
+    std::optional<unsigned> tick_run_previous{};
+    // Runs `n_aggregates` aggregates, with the temperature read at each tick
+    // given by `temperature_at`, and returns the distances in ticks between
+    // the samples that do not start an aggregate and the ones before them
+    auto const run{[&](unsigned const n_aggregates, auto const &temperature_at,
+        bool const near_threshold){
+        std::vector<unsigned> gaps{};
+        bool due_at_start{true};
+        for (unsigned i{0u}; i < n_aggregates; ++i)
+          for (unsigned tick{0u}; tick < ticks_per_aggregate;
+              ++tick, ++tick_run) {
+            if (tick == 0u) due_at_start = schedule.due(tick) and due_at_start;
+            if (not schedule.due(tick)) continue;
+            if (tick > 0u and tick_run_previous.has_value())
+              gaps.push_back(tick_run - *tick_run_previous);
+            T const x{{{std::chrono::milliseconds{1700000000000} +
+                tick_run * cc::sampling_interval / ticks_per_interval}},
+              temperature_at(tick_run), 50.f};
+            schedule.update(x, tick, tick_run, near_threshold);
+            tick_run_previous = tick_run;
+          }
+        suite.check(due_at_start, "the first tick of an aggregate is not due");
+        return gaps;
+      }};
+    auto const all_equal{[](std::vector<unsigned> const &gaps,
+        unsigned const n){
+        return not gaps.empty() and std::all_of(gaps.cbegin(), gaps.cend(),
+          [n](unsigned const gap){ return gap == n; });
+      }};
+    auto const steady{[](unsigned){ return 20.f; }};
+
+    // Slows down as far as it may, but not beyond
+    auto const gaps_steady{run(20u, steady, false)};
+    suite.check(not gaps_steady.empty() and
+      std::ranges::max(gaps_steady) == ticks_max,
+      "steady readings are not sampled at the longest interval");
+    suite.check(std::ranges::min(gaps_steady) >= 1u,
+      "a tick is sampled twice");
+
+    // Back to every tick as soon as a change is seen
+    suite.check(all_equal(run(4u, [](unsigned const t){
+        return 20.f + static_cast<float>(t); }, false), 1u),
+      "changing readings are not sampled every tick");
+    suite.check(all_equal(run(4u, steady, true), 1u),
+      "readings near a threshold are not sampled every tick");
+
+    auto const gaps_rest{run(20u, steady, false)};
+    suite.check(not gaps_rest.empty() and
+      std::ranges::max(gaps_rest) == ticks_max,
+      "readings steady again are not sampled at the longest interval");
+  }
+
+  std::array<std::pair<std::string_view, void (*)(Suite &)>, 8> constexpr
+    suites{{
+      {"segment-index", segment_index},
+      {"codec", codec_files},
+      {"query", query_rows},
+      {"statistics", statistics_exact},
+      {"batch", batch_aggregation},
+      {"filter", filter_samples},
+      {"rollup", rollup_cascade},
+      {"adaptive", adaptive_schedule}}};
+
+  // Runs the suites named `names`, or all of them if there are none, and
+  // returns whether all of their checks passed
+  bool run(std::vector<std::string> const &names) {
+    for (auto const &name : names)
+      if (std::none_of(suites.cbegin(), suites.cend(),
+          [&](auto const &s){ return s.first == name; })) {
+        if constexpr (cc::log_errors) {
+          std::cerr << log_error_prefix << "unknown test suite \"" << name
+            << "\", the suites are";
+          for (auto const &s : suites) std::cerr << " `" << s.first << "`";
+          std::cerr << "." << std::endl;
+        }
+        return false;
+      }
+
+    bool okay{true};
+    for (auto const &[name, f] : suites) {
+      if (not names.empty() and std::find(names.cbegin(), names.cend(),
+          name) == names.cend()) continue;
+      Suite suite{name};
+      try { f(suite); }
+      catch (std::filesystem::filesystem_error const &e) {
+        suite.check(false, e.what());
+      }
+      okay = suite.finish() and okay;
+    }
+    return okay;
+  }
+} // namespace test
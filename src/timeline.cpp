@@ -0,0 +1,236 @@
+namespace timeline {
+  // Timeline of a `shortly` run, to see where the time of a tick went (a slow
+  // I2C read, a DHT timeout, writing, an LPD433 send thread, …). With
+  // `--timeline=<file>`, `Scope` objects record when they were alive, and at
+  // the end of the run, the events are written to <file> in the Chrome trace
+  // event format, which Perfetto (`https://ui.perfetto.dev`) and
+  // `chrome://tracing` open.
+  //
+  // Each thread appends to a buffer of its own, which only it writes to, so
+  // recording needs neither locks nor allocations except when a thread
+  // records its first event or fills a chunk of its buffer. When a thread
+  // exits, its buffer is handed on to the next new thread, so that the many
+  // short-lived sampling threads of `shortly` share a few tracks in the
+  // timeline. Tasks that take turns on one thread, i.e. the coroutines of
+  // `shortly --coroutines`, record to tracks of their own instead, as their
+  // scopes overlap without nesting. When disabled, a scope costs a relaxed
+  // atomic load.
+  //
+  // NOTE: Names and categories must outlive the timeline, e.g. be string
+  // literals or sensor instance names.
+
+  struct Event {
+    std::string_view category;
+    std::string_view name;
+    std::int64_t time_begin_in_ns;
+    std::int64_t duration_in_ns;
+    // E.g. the handle of an I/O call, or negative for none
+    long id;
+  };
+
+  // Events of one thread, in chunks that never move, so that `write` can read
+  // them while the thread keeps appending
+  class Buffer {
+    static std::size_t constexpr chunk_size{256u};
+
+    struct Chunk {
+      std::array<Event, chunk_size> events{};
+      std::atomic<std::size_t> size{0u};
+      std::unique_ptr<Chunk> next{};
+      std::atomic<Chunk *> next_published{nullptr};
+    };
+
+    Chunk head{};
+    Chunk *tail{&head};
+
+  public:
+    std::size_t const tid;
+    std::string thread_name{};
+
+    explicit Buffer(std::size_t const tid) : tid{tid} {}
+
+    void append(Event const &event) {
+      auto const n{tail->size.load(std::memory_order_relaxed)};
+      if (n == chunk_size) {
+        tail->next = std::make_unique<Chunk>();
+        tail->next_published.store(tail->next.get(),
+          std::memory_order_release);
+        tail = tail->next.get();
+        append(event);
+        return;
+      }
+      tail->events[n] = event;
+      tail->size.store(n + 1u, std::memory_order_release);
+    }
+
+    template <class F>
+    void for_each(F &&f) const {
+      for (Chunk const *chunk{&head}; chunk != nullptr;
+          chunk = chunk->next_published.load(std::memory_order_acquire)) {
+        auto const n{chunk->size.load(std::memory_order_acquire)};
+        for (std::size_t i{0u}; i < n; ++i) f(chunk->events[i]);
+      }
+    }
+  };
+
+  using clock_t = std::chrono::steady_clock;
+
+  std::atomic_bool enabled{false};
+  std::filesystem::path path_file{};
+  clock_t::time_point time_point_start{};
+  // NOTE: Only taken when a thread records its first event and when writing.
+  std::mutex mutex{};
+  std::deque<Buffer> buffers{};
+  std::vector<Buffer *> buffers_free{};
+  std::map<std::string_view, Buffer *> tracks{};
+
+  // The track that the events of this thread go to instead of its own buffer,
+  // if any
+  thread_local Buffer *track_current{nullptr};
+
+  struct ThreadBuffer {
+    Buffer *buffer{nullptr};
+
+    ~ThreadBuffer() {
+      if (buffer == nullptr) return;
+      std::lock_guard const lock{mutex};
+      buffers_free.push_back(buffer);
+    }
+  };
+  thread_local ThreadBuffer thread_buffer_{};
+
+  Buffer &thread_buffer() {
+    if (track_current != nullptr) return *track_current;
+    auto &b{thread_buffer_.buffer};
+    if (b == nullptr) {
+      std::lock_guard const lock{mutex};
+      if (buffers_free.empty()) b = &buffers.emplace_back(buffers.size());
+      else { b = buffers_free.back(); buffers_free.pop_back(); }
+    }
+    return *b;
+  }
+
+  std::int64_t now_in_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      clock_t::now() - time_point_start).count();
+  }
+
+  // Starts recording, for writing the timeline to `path_file_out` later,
+  // returning whether the file can be written
+  bool start(std::filesystem::path const &path_file_out) {
+    if (not util::safe_writeable(path_file_out)) return false;
+    path_file = path_file_out;
+    time_point_start = clock_t::now();
+    enabled.store(true, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Names the calling thread in the timeline
+  void name_thread(std::string_view const name) {
+    if (not enabled.load(std::memory_order_relaxed)) return;
+    auto &b{thread_buffer()};
+    std::lock_guard const lock{mutex};
+    b.thread_name = name;
+  }
+
+  // Returns the track named `name`, which is created on first use, or nothing
+  // if not recording
+  Buffer *track(std::string_view const name) {
+    if (not enabled.load(std::memory_order_relaxed)) return nullptr;
+    std::lock_guard const lock{mutex};
+    auto &b{tracks[name]};
+    if (b == nullptr) {
+      b = &buffers.emplace_back(buffers.size());
+      b->thread_name = name;
+    }
+    return b;
+  }
+
+  // Records the events of the calling thread to `track` from now on, or to
+  // its own buffer if that is null, returning the track switched from
+  // NOTE: A track must only be switched to by one thread at a time.
+  Buffer *switch_track(Buffer * const track) {
+    return std::exchange(track_current, track);
+  }
+
+  // Records the time from its construction to its destruction as an event
+  class Scope {
+    std::string_view category;
+    std::string_view name;
+    long id;
+    std::optional<std::int64_t> time_begin_in_ns{};
+
+  public:
+    Scope(std::string_view const category, std::string_view const name,
+        long const id = -1) : category{category}, name{name}, id{id} {
+      if (enabled.load(std::memory_order_relaxed))
+        time_begin_in_ns = now_in_ns();
+    }
+
+    ~Scope() {
+      if (not time_begin_in_ns.has_value()) return;
+      thread_buffer().append({category, name, *time_begin_in_ns,
+        now_in_ns() - *time_begin_in_ns, id});
+    }
+
+    Scope(Scope const &) = delete;
+    Scope &operator=(Scope const &) = delete;
+  };
+
+  // Writes the events recorded so far, returning whether that succeeded
+  bool write() {
+    if (not enabled.load(std::memory_order_relaxed)) return true;
+    std::ofstream out{};
+    if (not util::safe_open(out, path_file, std::ios::out | std::ios::trunc))
+      return false;
+
+    auto const microseconds{[](std::int64_t const ns){
+      return std::to_string(ns / 1000) + "." +
+        std::to_string(1000 + ns % 1000).substr(1u); }};
+    std::size_t n_events{0u};
+    bool first{true};
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    std::lock_guard const lock{mutex};
+    for (auto const &b : buffers) {
+      if (not b.thread_name.empty()) {
+        out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", "
+          << "\"ph\": \"M\", \"pid\": 1, \"tid\": " << b.tid
+          << ", \"args\": {\"name\": \"" << b.thread_name << "\"}}";
+        first = false;
+      }
+      b.for_each([&](Event const &e){
+          out << (first ? "" : ",\n") << "{\"name\": \"" << e.name
+            << "\", \"cat\": \"" << e.category << "\", \"ph\": \"X\", "
+            << "\"ts\": " << microseconds(e.time_begin_in_ns)
+            << ", \"dur\": " << microseconds(e.duration_in_ns)
+            << ", \"pid\": 1, \"tid\": " << b.tid;
+          if (e.id >= 0) out << ", \"args\": {\"id\": " << e.id << "}";
+          out << "}";
+          first = false;
+          ++n_events;
+        });
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    if (not out.good()) {
+      if constexpr (cc::log_errors) std::cerr << log_error_prefix
+        << "writing timeline to " << path_file << ": "
+        << util::ios_error_description(out.rdstate()) << "." << std::endl;
+      return false;
+    }
+    if constexpr (cc::log_info) std::cerr << log_info_prefix
+      << "Wrote " << n_events << " events to the timeline " << path_file
+      << "." << std::endl;
+    return true;
+  }
+
+  // Writes the timeline when it goes out of scope, i.e. after the scopes
+  // declared after it have recorded their events, however that happens
+  struct WriteOnExit {
+    WriteOnExit() = default;
+    WriteOnExit(WriteOnExit const &) = delete;
+    WriteOnExit &operator=(WriteOnExit const &) = delete;
+    ~WriteOnExit() { write(); }
+  };
+} // namespace timeline
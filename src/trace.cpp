@@ -0,0 +1,237 @@
+namespace trace {
+  // Record and replay of the raw I/O with the sensors, so that a problem seen
+  // on the Raspberry Pi can be reproduced anywhere, and so that changes to the
+  // sampling code can be checked against real readings.
+  //
+  // Every call from `io.cpp` into pigpio or the DHTXXD library goes through
+  // `call` or `call_read`, under a channel name such as `i2c_read:<handle>`.
+  // With `--record=<file>`, each call is written to the trace file with the
+  // monotonic time it started at (relative to the start of the trace), how
+  // long it took, its result and any bytes it read. With `--replay=<file>`, the
+  // hardware is not touched at all. Instead, each call returns the next event
+  // recorded on its channel, either at once or, with `--replay-real-time`,
+  // after as long as it took originally.
+  //
+  // Events are matched per channel, in order, since sensors are sampled
+  // concurrently and the order across channels varies between runs. Once a
+  // channel runs out of events, its calls fail.
+  //
+  // NOTE: Of the LPD433 receiver, only the codes polled by `shortly` are traced
+  // (see `io::lpd433_receive`). The edges they are decoded from are timed and
+  // decoded within the _433D library, and the codes it reports through
+  // callbacks to `lpd433-listen` come from a thread of its own, so neither is
+  // traced. Outputs (LPD433 transmitter, PWM) are still driven in replay.
+
+  enum struct Mode { off, record, replay };
+
+  // Result of failed calls in replay, as in pigpio
+  int constexpr result_exhausted{-1};
+
+  struct Event {
+    std::chrono::nanoseconds duration{};
+    int result{};
+    std::string data{};
+  };
+
+  using clock_t = std::chrono::steady_clock;
+
+  Mode mode{Mode::off};
+  bool real_time{false};
+  std::mutex mutex{};
+  std::ofstream out{};
+  std::unordered_map<std::string, std::deque<Event>> events{};
+  clock_t::time_point time_point_start{};
+
+  bool replaying() { return mode == Mode::replay; }
+
+  // Whether a replay runs as fast as possible
+  bool full_speed() { return mode == Mode::replay and not real_time; }
+
+  std::string to_hex(std::string_view const bytes) {
+    std::string hex{};
+    hex.reserve(2u * bytes.size());
+    for (auto const byte : bytes) {
+      char digits[3];
+      std::snprintf(digits, sizeof(digits), "%02x",
+        static_cast<unsigned>(static_cast<std::uint8_t>(byte)));
+      hex += digits;
+    }
+    return hex;
+  }
+
+  std::optional<std::string> from_hex(std::string_view const hex) {
+    if (hex.size() % 2u != 0u) return {};
+    std::string bytes(hex.size() / 2u, '\0');
+    for (std::size_t i{0u}; i < bytes.size(); ++i) {
+      unsigned byte{};
+      auto const [p, ec]{std::from_chars(hex.data() + 2u * i,
+        hex.data() + 2u * i + 2u, byte, 16)};
+      if (ec != std::errc{} or p != hex.data() + 2u * i + 2u) return {};
+      bytes[i] = static_cast<char>(byte);
+    }
+    return {bytes};
+  }
+
+  bool record(std::filesystem::path const &path_file) {
+    if (not util::safe_open(out, path_file, std::ios::out | std::ios::trunc))
+      return false;
+    out << "\"time\", \"duration\", \"channel\", \"result\", \"data\"\n";
+    mode = Mode::record;
+    time_point_start = clock_t::now();
+    return true;
+  }
+
+  bool replay(std::filesystem::path const &path_file,
+      bool const replay_real_time) {
+    std::ifstream fs{};
+    if (not util::safe_open(fs, path_file, std::ios::in)) return false;
+    std::string line{};
+    std::getline(fs, line);
+    std::size_t n_line{1u};
+    while (std::getline(fs, line)) {
+      ++n_line;
+      std::array<std::string_view, 5> columns{};
+      std::string_view rest{line};
+      bool okay{true};
+      for (std::size_t i{0u}; i < columns.size(); ++i) {
+        auto const pos{i + 1u < columns.size() ?
+          rest.find(cc::csv_delimiter_string) : rest.npos};
+        if (i + 1u < columns.size() and pos == rest.npos) okay = false;
+        columns[i] = rest.substr(0u, pos);
+        if (pos != rest.npos)
+          rest.remove_prefix(pos + cc::csv_delimiter_string.size());
+      }
+      long long duration{};
+      int result{};
+      std::optional<std::string> data_opt{};
+      if (okay) {
+        auto const parse{[](std::string_view const s, auto &x){
+          auto const end{s.data() + s.size()};
+          auto const [p, ec]{std::from_chars(s.data(), end, x)};
+          return ec == std::errc{} and p == end; }};
+        data_opt = from_hex(columns[4]);
+        okay = parse(columns[1], duration) and parse(columns[3], result) and
+          data_opt.has_value();
+      }
+      if (not okay) {
+        if constexpr (cc::log_errors) std::cerr << log_error_prefix
+          << "parsing line " << n_line << " of trace " << path_file << "."
+          << std::endl;
+        return false;
+      }
+      events[std::string{columns[2]}].push_back(
+        {std::chrono::nanoseconds{duration}, result, *data_opt});
+    }
+    mode = Mode::replay;
+    real_time = replay_real_time;
+    return true;
+  }
+
+  // The next event recorded on `channel`, if any is left
+  std::optional<Event> replay_next(std::string const &channel) {
+    std::lock_guard const lock{mutex};
+    auto &queue{events[channel]};
+    if (queue.empty()) {
+      if constexpr (cc::log_errors) logging::error("trace")
+        << "replaying " << channel << ": no more events in the trace.";
+      return {};
+    }
+    auto event{std::move(queue.front())};
+    queue.pop_front();
+    return {std::move(event)};
+  }
+
+  // Replays `event` into `data`, returning its result
+  int replay_into(Event const &event, char * const data,
+      std::size_t const capacity) {
+    std::copy_n(event.data.begin(), std::min(capacity, event.data.size()),
+      data);
+    return metrics::pigpio_result(event.result);
+  }
+
+  void write_event(std::string const &channel, clock_t::time_point const tic,
+      clock_t::time_point const toc, int const result,
+      std::string_view const data) {
+    std::lock_guard const lock{mutex};
+    out << std::chrono::duration_cast<std::chrono::nanoseconds>(
+        tic - time_point_start).count() << cc::csv_delimiter_string
+      << std::chrono::duration_cast<std::chrono::nanoseconds>(
+        toc - tic).count() << cc::csv_delimiter_string
+      << channel << cc::csv_delimiter_string
+      << result << cc::csv_delimiter_string
+      << to_hex(data) << '\n';
+  }
+
+  // Runs `f`, which returns the result of the call and how many bytes of
+  // `data` it has read, and records it, or replays the next event of the
+  // channel `<kind>:<id>` into `data` instead, returning its result. Negative
+  // results are counted as pigpio errors in the metrics.
+  template <class F>
+  int call_read(std::string_view const kind, long const id, F &&f,
+      char * const data, std::size_t const capacity) {
+    timeline::Scope const scope{"io", kind, id};
+    if (mode == Mode::off) return metrics::pigpio_result(f().first);
+
+    auto const channel{std::string{kind} + ":" + std::to_string(id)};
+    if (mode == Mode::replay) {
+      auto const event_opt{replay_next(channel)};
+      if (not event_opt.has_value())
+        return metrics::pigpio_result(result_exhausted);
+      if (real_time) std::this_thread::sleep_for(event_opt->duration);
+      return replay_into(*event_opt, data, capacity);
+    }
+
+    auto const tic{clock_t::now()};
+    auto const [result, n_data]{f()};
+    auto const toc{clock_t::now()};
+    write_event(channel, tic, toc, result, {data, std::min(n_data, capacity)});
+    return metrics::pigpio_result(result);
+  }
+
+  // Same, for a call that waits on the event loop of `engine`, as the task
+  // `call`, which is only run if the hardware is used
+  engine::Task<int> call_read_async(std::string_view const kind,
+      long const id, engine::Task<std::pair<int, std::size_t>> call,
+      char * const data, std::size_t const capacity) {
+    timeline::Scope const scope{"io", kind, id};
+    if (mode == Mode::off) {
+      auto const [result, _]{co_await call};
+      co_return metrics::pigpio_result(result);
+    }
+
+    auto const channel{std::string{kind} + ":" + std::to_string(id)};
+    if (mode == Mode::replay) {
+      auto const event_opt{replay_next(channel)};
+      if (not event_opt.has_value())
+        co_return metrics::pigpio_result(result_exhausted);
+      if (real_time) co_await engine::sleep_for(event_opt->duration);
+      co_return replay_into(*event_opt, data, capacity);
+    }
+
+    auto const tic{clock_t::now()};
+    auto const [result, n_data]{co_await call};
+    auto const toc{clock_t::now()};
+    write_event(channel, tic, toc, result,
+      std::string_view{data, std::min(n_data, capacity)});
+    co_return metrics::pigpio_result(result);
+  }
+
+  // Same, for calls that only return a result
+  template <class F>
+  int call(std::string_view const kind, long const id, F &&f) {
+    return call_read(kind, id,
+      [&](){ return std::pair{f(), std::size_t{0u}}; }, nullptr, 0u);
+  }
+
+  // Flushes the trace file and reports whether all of it was written
+  bool close() {
+    if (mode != Mode::record) return true;
+    std::lock_guard const lock{mutex};
+    out.flush();
+    if (out.good()) return true;
+    if constexpr (cc::log_errors) std::cerr << log_error_prefix
+      << "writing trace: " << util::ios_error_description(out.rdstate()) << "."
+      << std::endl;
+    return false;
+  }
+} // namespace trace